@@ -0,0 +1,75 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "rtweekend.h"
+
+#include <utility>
+
+class aabb { //axis-aligned bounding box, one interval per axis
+    public:
+        interval x, y, z;
+
+        aabb() {} //default box is empty since intervals are empty by default
+
+        aabb(const interval& ix, const interval& iy, const interval& iz) : x(ix), y(iy), z(iz) {}
+
+        aabb(const point3& a, const point3& b) {
+            //treat the two points as opposite corners, in any order
+            x = interval(fmin(a[0], b[0]), fmax(a[0], b[0]));
+            y = interval(fmin(a[1], b[1]), fmax(a[1], b[1]));
+            z = interval(fmin(a[2], b[2]), fmax(a[2], b[2]));
+        }
+
+        aabb(const aabb& box0, const aabb& box1) : x(box0.x, box1.x), y(box0.y, box1.y), z(box0.z, box1.z) {}
+
+        const interval& axis(int n) const {
+            if(n == 1)
+                return y;
+            if(n == 2)
+                return z;
+            return x;
+        }
+
+        point3 centroid() const {
+            return point3(0.5 * (x.min + x.max), 0.5 * (y.min + y.max), 0.5 * (z.min + z.max));
+        }
+
+        double surface_area() const {
+            //used by the SAH, an empty box has no area
+            if(x.size() < 0 || y.size() < 0 || z.size() < 0)
+                return 0;
+            return 2 * (x.size()*y.size() + y.size()*z.size() + z.size()*x.size());
+        }
+
+        int longest_axis() const {
+            if(x.size() > y.size())
+                return x.size() > z.size() ? 0 : 2;
+            return y.size() > z.size() ? 1 : 2;
+        }
+
+        bool hit(const ray& r, interval ray_t) const {
+            //slab test: clip the ray's t range against each pair of axis planes in turn
+            //if the range ever becomes empty the ray misses the box
+            for(int a = 0; a < 3; a++) {
+                auto invD = 1 / r.direction()[a];
+                auto orig = r.origin()[a];
+
+                auto t0 = (axis(a).min - orig) * invD;
+                auto t1 = (axis(a).max - orig) * invD;
+
+                if(invD < 0)
+                    std::swap(t0, t1);
+
+                if(t0 > ray_t.min)
+                    ray_t.min = t0;
+                if(t1 < ray_t.max)
+                    ray_t.max = t1;
+
+                if(ray_t.max <= ray_t.min)
+                    return false;
+            }
+            return true;
+        }
+};
+
+#endif
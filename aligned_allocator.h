@@ -0,0 +1,39 @@
+#ifndef ALIGNED_ALLOCATOR_H
+#define ALIGNED_ALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+template<typename T, size_t Alignment>
+class aligned_allocator { //std::vector allocator that starts every buffer on an Alignment byte boundary
+    //used for arrays that SIMD kernels load with aligned loads, Alignment 64 covers AVX-512 and a cache line
+    public:
+        using value_type = T;
+
+        template<typename U>
+        struct rebind {using other = aligned_allocator<U, Alignment>;};
+
+        aligned_allocator() = default;
+        template<typename U>
+        aligned_allocator(const aligned_allocator<U, Alignment>&) {}
+
+        T* allocate(size_t n) {
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+        }
+
+        void deallocate(T* p, size_t) {
+            ::operator delete(p, std::align_val_t(Alignment));
+        }
+};
+
+template<typename T, typename U, size_t Alignment>
+bool operator==(const aligned_allocator<T, Alignment>&, const aligned_allocator<U, Alignment>&) {return true;}
+
+template<typename T, typename U, size_t Alignment>
+bool operator!=(const aligned_allocator<T, Alignment>&, const aligned_allocator<U, Alignment>&) {return false;}
+
+template<typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T, 64>>;
+
+#endif
@@ -0,0 +1,341 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "framebuffer.h"
+#include "image_writer.h"
+#include "scene_file.h"
+#include "sphere_bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* animations
+
+renders a sequence of frames from one scene: the world and its BVH are built (or mapped) once, each frame
+only moves the camera, moves some spheres and refits the BVH, then traces. frame N is encoded and written
+on its own thread while frame N+1 traces
+
+text form, one statement per line, # starts a comment:
+
+frames 48                                                   number of frames, 0 to 47
+key 0 lookfrom 0 0 0 lookat 0 0 -1 vup 0 1 0 vfov 90        camera at a frame, any subset of the keys
+key 47 lookfrom 1 0.5 0.5                                   missing values are the previous key's, the scene's camera before the first
+move center 0 0 -1 radius 0.6 velocity 0 0.01 0             spheres with their center in the ball move by velocity every frame
+
+the scene's camera is frame 0 unless a key says otherwise, between keys the view is interpolated linearly
+and after the last key it holds. spheres move in a straight line from where the scene has them (frame 0),
+and only sphere_bvh scenes (--scene) can move, the built in scenes are a hittable_list
+
+every frame samples with seed + frame, so without a key 0 frame 0 is exactly the still image of the scene
+
+*/
+
+struct camera_pose { //what a key sets
+    point3 lookfrom;
+    point3 lookat;
+    vec3 vup;
+    double vfov;
+
+    static camera_pose of(const camera& cam) {return {cam.lookfrom, cam.lookat, cam.vup, cam.vfov};}
+
+    void apply(camera& cam) const {
+        cam.lookfrom = lookfrom;
+        cam.lookat = lookat;
+        cam.vup = vup;
+        cam.vfov = vfov;
+    }
+};
+
+inline camera_pose lerp(const camera_pose& a, const camera_pose& b, double t) {
+    //vup is not renormalized, the camera only uses its direction
+    return {a.lookfrom + t * (b.lookfrom - a.lookfrom), a.lookat + t * (b.lookat - a.lookat),
+            a.vup + t * (b.vup - a.vup), a.vfov + t * (b.vfov - a.vfov)};
+}
+
+enum : uint32_t {animation_key_vfov = 8}; //with the scene_view_* bits, which values a key sets
+
+struct animation_key {
+    int frame;
+    uint32_t given = 0;
+    camera_pose pose = {};
+};
+
+struct sphere_motion {
+    point3 center; //spheres within radius of center at frame 0 move
+    double radius;
+    vec3 velocity; //per frame
+};
+
+struct animation {
+    int frame_count = 1;
+    std::vector<animation_key> keys; //by frame
+    std::vector<sphere_motion> motions;
+
+    camera_pose pose_at(int frame, const camera_pose& base) const {
+        //the view at frame, base (the scene's camera) is frame 0 unless there is a key for it
+        std::vector<int> frames = {0};
+        std::vector<camera_pose> poses = {base}; //every key with the values it inherits filled in
+        for(const auto& key : keys) {
+            auto pose = poses.back();
+            if(key.given & scene_view_lookfrom) pose.lookfrom = key.pose.lookfrom;
+            if(key.given & scene_view_lookat) pose.lookat = key.pose.lookat;
+            if(key.given & scene_view_vup) pose.vup = key.pose.vup;
+            if(key.given & animation_key_vfov) pose.vfov = key.pose.vfov;
+            if(key.frame == 0) {
+                poses[0] = pose;
+                continue;
+            }
+            frames.push_back(key.frame);
+            poses.push_back(pose);
+        }
+        for(size_t k = 1; k < frames.size(); ++k) {
+            if(frame <= frames[k]) {
+                auto t = static_cast<double>(frame - frames[k-1]) / (frames[k] - frames[k-1]);
+                return lerp(poses[k-1], poses[k], t);
+            }
+        }
+        return poses.back(); //after the last key
+    }
+};
+
+class animation_text_parser : text_reader {
+    public:
+        using text_reader::text_reader;
+
+        bool parse(animation& anim, std::string& error) {
+            while(cursor < stop) {
+                ++line;
+                std::string keyword = word();
+                if(keyword.empty() || keyword[0] == '#') {
+                    skip_line();
+                    continue;
+                }
+
+                if(keyword == "frames") {
+                    double count;
+                    if(!number(count) || count < 1)
+                        return fail(error, "frames needs a count of at least 1");
+                    anim.frame_count = static_cast<int>(count);
+                } else if(keyword == "key") {
+                    animation_key key;
+                    double frame;
+                    if(!number(frame) || frame < 0)
+                        return fail(error, "key needs a frame number");
+                    key.frame = static_cast<int>(frame);
+                    for(std::string name = word(); !name.empty() && name[0] != '#'; name = word()) {
+                        if(name == "vfov") {
+                            if(!number(key.pose.vfov) || key.pose.vfov <= 0)
+                                return fail(error, "vfov needs an angle");
+                            key.given |= animation_key_vfov;
+                            continue;
+                        }
+                        vec3* target;
+                        if(name == "lookfrom") {target = &key.pose.lookfrom; key.given |= scene_view_lookfrom;}
+                        else if(name == "lookat") {target = &key.pose.lookat; key.given |= scene_view_lookat;}
+                        else if(name == "vup") {target = &key.pose.vup; key.given |= scene_view_vup;}
+                        else return fail(error, "unknown key setting " + name);
+                        if(!vector(*target))
+                            return fail(error, name + " needs x y z");
+                    }
+                    for(const auto& other : anim.keys)
+                        if(other.frame == key.frame)
+                            return fail(error, "a second key for frame " + std::to_string(key.frame));
+                    anim.keys.push_back(key);
+                    skip_line(); //the setting loop stopped at the end of the line or at a comment
+                    continue;
+                } else if(keyword == "move") {
+                    sphere_motion motion;
+                    bool center = false, radius = false, velocity = false;
+                    for(std::string name = word(); !name.empty() && name[0] != '#'; name = word()) {
+                        bool ok;
+                        if(name == "center") ok = center = vector(motion.center);
+                        else if(name == "radius") ok = radius = number(motion.radius);
+                        else if(name == "velocity") ok = velocity = vector(motion.velocity);
+                        else return fail(error, "unknown move setting " + name);
+                        if(!ok)
+                            return fail(error, "bad value for " + name);
+                    }
+                    if(!center || !radius || !velocity)
+                        return fail(error, "move needs center x y z radius r velocity x y z");
+                    anim.motions.push_back(motion);
+                    skip_line();
+                    continue;
+                } else {
+                    return fail(error, "unknown statement " + keyword);
+                }
+                auto rest = word();
+                if(!rest.empty() && rest[0] != '#')
+                    return fail(error, "trailing text after " + keyword);
+                skip_line();
+            }
+            for(const auto& key : anim.keys) {
+                if(key.frame >= anim.frame_count) {
+                    error = "key for frame " + std::to_string(key.frame) + " of " + std::to_string(anim.frame_count) + " frames";
+                    return false;
+                }
+            }
+            std::sort(anim.keys.begin(), anim.keys.end(), [](const animation_key& a, const animation_key& b) {return a.frame < b.frame;});
+            return true;
+        }
+
+    private:
+        bool vector(vec3& v) {
+            double x, y, z;
+            if(!number(x) || !number(y) || !number(z))
+                return false;
+            v = vec3(x, y, z);
+            return true;
+        }
+};
+
+inline bool load_animation(const std::string& path, animation& anim, std::string& error) {
+    std::string text;
+    if(!read_file(path, text)) {
+        error = path + ": can't read";
+        return false;
+    }
+    animation_text_parser parser(text.c_str(), text.c_str() + text.size());
+    if(!parser.parse(anim, error)) {
+        error = path + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+class sphere_animator { //moves the spheres of the motions and keeps the BVH fitted to them
+    public:
+        sphere_animator(sphere_bvh& bvh, const std::vector<sphere_motion>& motions) : world(bvh) {
+            //a sphere in several balls moves with the first
+            std::vector<bool> taken(world.arrays().slots, false);
+            for(const auto& motion : motions) {
+                for(auto slot : world.slots_within(motion.center, motion.radius)) {
+                    if(taken[slot])
+                        continue;
+                    taken[slot] = true;
+                    movers.push_back({slot, world.sphere_center(slot), motion.velocity});
+                }
+            }
+        }
+
+        size_t moving() const {return movers.size();}
+
+        void set_frame(int frame) {
+            //positions come from frame 0 every time, so frames can be rendered in any order
+            if(movers.empty())
+                return;
+            for(const auto& m : movers)
+                world.move_sphere(m.slot, m.start + frame * m.velocity);
+            world.refit();
+        }
+
+    private:
+        struct mover {
+            uint32_t slot;
+            point3 start;
+            vec3 velocity;
+        };
+
+        sphere_bvh& world;
+        std::vector<mover> movers;
+};
+
+inline std::string frame_path(const std::string& pattern, int frame) {
+    //the last run of '#' in the file name becomes the zero padded frame number, without one _0000 goes before the extension
+    auto name = pattern.find_last_of('/') + 1; //0 without a directory
+    auto last = pattern.find_last_of('#');
+    if(last == std::string::npos || last < name) {
+        auto dot = pattern.find_last_of('.');
+        auto insert_at = dot == std::string::npos || dot < name ? pattern.size() : dot;
+        return frame_path(pattern.substr(0, insert_at) + "_####" + pattern.substr(insert_at), frame);
+    }
+    auto first = last;
+    while(first > name && pattern[first - 1] == '#')
+        --first;
+    auto number = std::to_string(frame);
+    auto width = last - first + 1;
+    if(number.size() < width)
+        number.insert(0, width - number.size(), '0');
+    return pattern.substr(0, first) + number + pattern.substr(last + 1);
+}
+
+inline bool render_frames(camera& cam, const hittable& world, const animation& anim, sphere_bvh* movable, int first_frame, int last_frame) {
+    //renders frames first_frame..last_frame to cam.output_path with the frame number filled in (see frame_path),
+    //false if a frame couldn't be written
+    using namespace std::chrono;
+    auto start = steady_clock::now();
+    auto base = camera_pose::of(cam);
+    auto base_seed = cam.seed;
+    auto output_pattern = cam.output_path;
+    auto heatmap_pattern = cam.heatmap_path;
+    auto aov_pattern = cam.aov_path;
+
+    std::unique_ptr<sphere_animator> animator;
+    if(movable && !anim.motions.empty()) {
+        animator = std::make_unique<sphere_animator>(*movable, anim.motions);
+        std::clog << animator->moving() << " spheres move\n";
+    }
+
+    cam.defer_output = true;
+    framebuffer pending; //the frame being written while the next one traces
+    std::string pending_path;
+    std::thread writer;
+    bool written = true; //every write so far succeeded, only read once the writer is joined
+    double refit_ms = 0, wait_ms = 0;
+    auto finish_write = [&] {
+        if(!writer.joinable())
+            return;
+        auto wait_start = steady_clock::now();
+        writer.join();
+        wait_ms += duration_cast<microseconds>(steady_clock::now() - wait_start).count() / 1000.0;
+    };
+
+    bool ok = true;
+    for(int frame = first_frame; frame <= last_frame; ++frame) {
+        anim.pose_at(frame, base).apply(cam);
+        cam.seed = base_seed + frame;
+        cam.output_path = frame_path(output_pattern, frame);
+        if(!heatmap_pattern.empty())
+            cam.heatmap_path = frame_path(heatmap_pattern, frame);
+        if(!aov_pattern.empty())
+            cam.aov_path = frame_path(aov_pattern, frame);
+        if(animator) {
+            auto refit_start = steady_clock::now();
+            animator->set_frame(frame);
+            if(!cam.lights.empty())
+                cam.lights = movable->lights(); //lamps may be among the spheres that moved
+            refit_ms += duration_cast<microseconds>(steady_clock::now() - refit_start).count() / 1000.0;
+        }
+
+        std::clog << "frame " << frame << " (" << frame - first_frame + 1 << '/' << last_frame - first_frame + 1 << ")\n";
+        if(!cam.render(world)) {
+            ok = false;
+            break;
+        }
+
+        finish_write();
+        pending = cam.result();
+        pending_path = cam.output_path;
+        writer = std::thread([&pending, &pending_path, &written, format = cam.output_format] {
+            if(!write_image(pending_path, pending, format)) {
+                std::clog << "\nfailed to write the image to " << pending_path << '\n';
+                written = false;
+            }
+        });
+    }
+    finish_write();
+    cam.defer_output = false;
+
+    auto seconds = duration_cast<milliseconds>(steady_clock::now() - start).count() / 1000.0;
+    std::clog << "frames done in " << seconds << " seconds (" << refit_ms << " ms moving spheres and refitting, "
+              << wait_ms << " ms waiting for the image writer)\n";
+    return ok && written;
+}
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/* scene arena
+
+storage for the objects a scene is built from. every type gets its own pool of 64 byte aligned chunks and
+objects are constructed back to back in them, so the spheres of a scene sit next to each other in memory
+instead of each one in its own make_shared block with a control block in front of it
+
+make<T> hands out a shared_ptr<T> that doesn't own: it has no control block, copying it touches no reference
+count, and it stays valid for as long as the arena (or a copy of it taken after the first make, copies share
+the pools) is alive.
+hittable_list carries an arena for that, everything made with world.arena.make<T>() lives as long as world:
+
+    hittable_list world;
+    auto ground = world.arena.make<lambertian>(color(0.5,0.5,0.5));
+    world.add(world.arena.make<sphere>(point3(0,-100.5,-1), 100, ground));
+
+a list built over those objects (a BVH, the list a scene function returns) has to take the arena along,
+see scenes.h. objects are destroyed and the chunks freed together when the last copy of the arena goes
+
+*/
+
+class arena_pool_base {
+    public:
+        virtual ~arena_pool_base() = default;
+        virtual size_t bytes() const = 0;
+};
+
+template<typename T>
+class arena_pool : public arena_pool_base { //the objects of one type, in chunks that never move
+    public:
+        static constexpr size_t alignment = alignof(T) > 64 ? alignof(T) : 64;
+
+        ~arena_pool() override {
+            //newest first, the reverse of construction like any other scope
+            for(auto c = chunks.rbegin(); c != chunks.rend(); ++c) {
+                for(size_t i = c->used; i > 0; --i)
+                    c->data[i - 1].~T();
+                ::operator delete(c->data, std::align_val_t(alignment));
+            }
+        }
+
+        template<typename... Args>
+        T* construct(Args&&... args) {
+            if(chunks.empty() || chunks.back().used == chunks.back().capacity)
+                add_chunk(chunks.empty() ? first_chunk : 2 * chunks.back().capacity);
+            auto& c = chunks.back();
+            T* object = new(c.data + c.used) T(std::forward<Args>(args)...);
+            ++c.used; //only once the constructor returned, a throwing one leaves nothing to destroy
+            return object;
+        }
+
+        void reserve(size_t count) {
+            //the next count objects go into one chunk
+            if(chunks.empty() || chunks.back().capacity - chunks.back().used < count)
+                add_chunk(std::max(count, first_chunk));
+        }
+
+        size_t bytes() const override {
+            size_t total = 0;
+            for(const auto& c : chunks)
+                total += c.capacity * sizeof(T);
+            return total;
+        }
+
+    private:
+        static constexpr size_t first_chunk = 64;
+
+        struct chunk {
+            T* data;
+            size_t capacity;
+            size_t used;
+        };
+
+        std::vector<chunk> chunks;
+
+        void add_chunk(size_t capacity) {
+            auto data = static_cast<T*>(::operator new(capacity * sizeof(T), std::align_val_t(alignment)));
+            chunks.push_back({data, capacity, 0});
+        }
+};
+
+class scene_arena {
+    public:
+        template<typename T, typename... Args>
+        std::shared_ptr<T> make(Args&&... args) {
+            T* object = pool<T>().construct(std::forward<Args>(args)...);
+            return std::shared_ptr<T>(std::shared_ptr<void>(), object); //aliasing an empty pointer: no control block, no ownership
+        }
+
+        template<typename T>
+        void reserve(size_t count) {pool<T>().reserve(count);} //for builders that know how many of a type are coming
+
+        size_t bytes() const { //chunk memory of every pool, used or not
+            size_t total = 0;
+            if(state)
+                for(const auto& entry : state->by_type)
+                    if(entry)
+                        total += entry->bytes();
+            return total;
+        }
+
+    private:
+        struct pools {
+            std::vector<std::unique_ptr<arena_pool_base>> by_type; //indexed by type_slot
+        };
+
+        std::shared_ptr<pools> state; //created on the first make, so an unused arena costs a null pointer
+
+        static size_t next_type_slot() {
+            static std::atomic<size_t> count{0};
+            return count++;
+        }
+
+        template<typename T>
+        static size_t type_slot() {
+            //a small index per type, numbered on first use, so finding a pool is an array access instead of a hash
+            static const size_t slot = next_type_slot();
+            return slot;
+        }
+
+        template<typename T>
+        arena_pool<T>& pool() {
+            if(!state)
+                state = std::make_shared<pools>();
+            auto slot = type_slot<T>();
+            if(slot >= state->by_type.size())
+                state->by_type.resize(slot + 1);
+            auto& entry = state->by_type[slot];
+            if(!entry)
+                entry = std::make_unique<arena_pool<T>>();
+            return static_cast<arena_pool<T>&>(*entry);
+        }
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include "rtweekend.h"
+
+#include "arena.h"
+#include "bvh.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "sphere.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace std::chrono;
+
+/* arena benchmark
+
+the same random sphere field, every sphere with its own material like the grid scene, built three ways:
+  heap        each sphere and material its own make_shared, into a fresh heap
+  fragmented  the same, into a heap that already had many small blocks allocated and half of them freed,
+              so the allocator hands out scattered holes the way it does in a process that has been running
+              (loading scenes, growing vectors) for a while
+  arena       spheres and materials made in a scene_arena, contiguous per type
+
+reports build and teardown time, then rays/sec through the plain hittable_list (which follows one
+pointer per sphere) and through a flat_bvh, and checks every layout reports the same closest hits
+
+*/
+
+static double seconds_since(high_resolution_clock::time_point start) {
+    return duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+}
+
+static double rays_per_second(const hittable& world, const std::vector<ray>& rays, double budget) {
+    size_t traced = 0;
+    auto start = high_resolution_clock::now();
+    double elapsed = 0;
+    do {
+        for(const auto& r : rays) {
+            hit_record rec;
+            world.hit(r, interval(0.001, infinity), rec);
+            ++traced;
+            if((traced & 255) == 0 && (elapsed = seconds_since(start)) > budget)
+                break;
+        }
+        elapsed = seconds_since(start);
+    } while(elapsed < budget);
+    return traced / elapsed;
+}
+
+static int mismatches(const hittable& a, const hittable& b, const std::vector<ray>& rays) {
+    int count = 0;
+    for(const auto& r : rays) {
+        hit_record rec_a, rec_b;
+        bool hit_a = a.hit(r, interval(0.001, infinity), rec_a);
+        bool hit_b = b.hit(r, interval(0.001, infinity), rec_b);
+        if(hit_a != hit_b || (hit_a && (rec_a.t != rec_b.t || rec_a.mat->surface_albedo()[0] != rec_b.mat->surface_albedo()[0])))
+            ++count;
+    }
+    return count;
+}
+
+struct sphere_spec {
+    point3 center;
+    double radius;
+    color albedo;
+};
+
+enum class layout {heap, fragmented, arena};
+
+static hittable_list build(const std::vector<sphere_spec>& specs, layout how) {
+    hittable_list list;
+    if(how == layout::arena) {
+        list.arena.reserve<sphere>(specs.size());
+        list.arena.reserve<lambertian>(specs.size());
+    }
+    for(const auto& spec : specs) {
+        if(how == layout::arena)
+            list.add(list.arena.make<sphere>(spec.center, spec.radius, list.arena.make<lambertian>(spec.albedo)));
+        else
+            list.add(make_shared<sphere>(spec.center, spec.radius, make_shared<lambertian>(spec.albedo)));
+    }
+    return list;
+}
+
+static std::vector<void*> fragment_heap(size_t blocks, sampler& s) {
+    //allocates blocks of 16 to 256 bytes and frees a random half, what's kept is freed after the build
+    std::vector<void*> all(blocks);
+    for(auto& p : all)
+        p = std::malloc(16 + 16 * (s.next_u64() % 16));
+    std::vector<void*> kept;
+    for(auto p : all) {
+        if(s.next_u64() & 1)
+            std::free(p);
+        else
+            kept.push_back(p);
+    }
+    return kept;
+}
+
+int main() {
+    sampler s(2024);
+    const char* names[] = {"heap", "fragmented", "arena"};
+
+    std::printf("%10s %11s %10s %12s %13s %13s %9s\n", "spheres", "layout", "build ms", "teardown ms", "list rays/s", "bvh rays/s", "mismatch");
+    for(int n : {1000, 10000, 100000, 1000000}) {
+        auto extent = 0.5 * std::cbrt(static_cast<double>(n));
+        std::vector<sphere_spec> specs(n);
+        for(auto& spec : specs) {
+            spec.center = point3(s.random_double(-extent,extent), s.random_double(-extent,extent), s.random_double(-extent,extent));
+            spec.radius = s.random_double(0.05, 0.3);
+            spec.albedo = color(s.random_double(), s.random_double(), s.random_double());
+        }
+        std::vector<ray> rays;
+        for(int i = 0; i < 4096; ++i) {
+            auto origin = 2 * extent * unit_vector(vec3(s.random_double(-1,1), s.random_double(-1,1), s.random_double(-1,1)));
+            auto target = vec3(s.random_double(-extent,extent), s.random_double(-extent,extent), s.random_double(-extent,extent));
+            rays.push_back(ray(origin, target - origin));
+        }
+        std::vector<ray> check(rays.begin(), rays.begin() + (n > 10000 ? 64 : 1024));
+
+        auto reference = build(specs, layout::heap); //what every layout's BVH is checked against
+        //fragmented last, the heap it leaves behind would slow down whatever is built after it
+        for(auto how : {layout::heap, layout::arena, layout::fragmented}) {
+            std::vector<void*> noise;
+            if(how == layout::fragmented)
+                noise = fragment_heap(8 * static_cast<size_t>(n), s);
+
+            auto start = high_resolution_clock::now();
+            auto list = std::make_unique<hittable_list>(build(specs, how));
+            auto build_ms = 1000 * seconds_since(start);
+            auto bvh = std::make_unique<flat_bvh>(*list);
+
+            //the flat list is linear in n, past 10k spheres it only measures itself
+            auto list_rate = n <= 10000 ? rays_per_second(*list, rays, 0.3) : 0;
+            auto bvh_rate = rays_per_second(*bvh, rays, 0.3);
+            auto mismatch = mismatches(reference, *bvh, check);
+
+            start = high_resolution_clock::now();
+            bvh.reset();
+            list.reset();
+            auto teardown_ms = 1000 * seconds_since(start);
+            for(auto p : noise)
+                std::free(p);
+
+            std::printf("%10d %11s %10.2f %12.2f %13.0f %13.0f %9d\n", n, names[static_cast<int>(how)], build_ms, teardown_ms,
+                list_rate, bvh_rate, mismatch);
+            std::fflush(stdout);
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#include "rtweekend.h"
+
+#include "bvh.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "sphere.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace std::chrono;
+
+/* BVH benchmark
+
+compares rays/sec of the flat hittable_list, the pointer based bvh_node and the linearized flat_bvh
+over the same random sphere field as the sphere count grows from 10 to 1M, and checks they all
+report the same closest hits
+
+*/
+
+static double seconds_since(high_resolution_clock::time_point start) {
+    return duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+}
+
+static std::vector<ray> make_rays(int count, double extent, sampler& s) {
+    //rays start on a shell around the field and aim at random points inside it
+    std::vector<ray> rays;
+    rays.reserve(count);
+    for(int i = 0; i < count; ++i) {
+        auto origin = 2 * extent * unit_vector(vec3(s.random_double(-1,1), s.random_double(-1,1), s.random_double(-1,1)));
+        auto target = vec3(s.random_double(-extent,extent), s.random_double(-extent,extent), s.random_double(-extent,extent));
+        rays.push_back(ray(origin, target - origin));
+    }
+    return rays;
+}
+
+static double rays_per_second(const hittable& world, const std::vector<ray>& rays, double budget) {
+    //keep tracing the batch until the time budget is spent, at least one full pass
+    size_t traced = 0;
+    auto start = high_resolution_clock::now();
+    double elapsed = 0;
+    do {
+        for(const auto& r : rays) {
+            hit_record rec;
+            world.hit(r, interval(0.001, infinity), rec);
+            ++traced;
+            if((traced & 255) == 0 && (elapsed = seconds_since(start)) > budget)
+                break;
+        }
+        elapsed = seconds_since(start);
+    } while(elapsed < budget);
+    return traced / elapsed;
+}
+
+static int mismatches(const hittable& a, const hittable& b, const std::vector<ray>& rays) {
+    int count = 0;
+    for(const auto& r : rays) {
+        hit_record rec_a, rec_b;
+        bool hit_a = a.hit(r, interval(0.001, infinity), rec_a);
+        bool hit_b = b.hit(r, interval(0.001, infinity), rec_b);
+        if(hit_a != hit_b || (hit_a && rec_a.t != rec_b.t))
+            ++count;
+    }
+    return count;
+}
+
+int main() {
+    sampler s(2024);
+    auto mat = make_shared<lambertian>(color(0.5,0.5,0.5));
+
+    std::printf("%10s %10s %10s %13s %13s %13s %10s %10s %9s\n", "spheres", "build ms", "flat ms",
+        "list rays/s", "bvh rays/s", "flat rays/s", "bvh KB", "flat KB", "mismatch");
+    for(int n : {10, 100, 1000, 10000, 100000, 1000000}) {
+        //constant density: roughly one sphere per unit cube
+        auto extent = 0.5 * std::cbrt(static_cast<double>(n));
+        hittable_list list;
+        for(int i = 0; i < n; ++i) {
+            auto center = point3(s.random_double(-extent,extent), s.random_double(-extent,extent), s.random_double(-extent,extent));
+            list.add(make_shared<sphere>(center, s.random_double(0.05, 0.3), mat));
+        }
+
+        auto build_start = high_resolution_clock::now();
+        bvh_node bvh(list);
+        auto build_ms = 1000 * seconds_since(build_start);
+
+        build_start = high_resolution_clock::now();
+        flat_bvh flat(list);
+        auto flat_ms = 1000 * seconds_since(build_start);
+
+        //a pointer node is n-1 make_shared blocks (object + control block), flat nodes are one array
+        auto bvh_kb = (n - 1) * (sizeof(bvh_node) + 16) / 1024.0;
+        auto flat_kb = flat.memory_bytes() / 1024.0;
+
+        auto rays = make_rays(4096, extent, s);
+        auto list_rate = rays_per_second(list, rays, 0.5);
+        auto bvh_rate = rays_per_second(bvh, rays, 0.5);
+        auto flat_rate = rays_per_second(flat, rays, 0.5);
+
+        std::vector<ray> check(rays.begin(), rays.begin() + (n > 100000 ? 64 : 1024));
+        std::printf("%10d %10.2f %10.2f %13.0f %13.0f %13.0f %10.1f %10.1f %9d\n", n, build_ms, flat_ms,
+            list_rate, bvh_rate, flat_rate, bvh_kb, flat_kb, mismatches(list, bvh, check) + mismatches(list, flat, check));
+        std::fflush(stdout);
+    }
+}
@@ -0,0 +1,115 @@
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "denoise.h"
+#include "scenes.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+using namespace std::chrono;
+
+/* denoise benchmark
+
+quality against time: renders the sphere grid once at a high sample count as the reference, then at
+increasing sample counts with the first hit buffers, and reports the error of the plain and the denoised
+image against the reference next to the time each took. the denoiser runs at every SIMD level the cpu has,
+all of them have to produce the same image (mismatch counts the pixels where one differs from scalar)
+
+usage: denoise_bench [--width w] [--reference spp] [--threads n]
+
+error is the RMSE of the displayed values (gamma 2, clamped to [0,1]) over every channel
+
+*/
+
+static double display_rmse(const framebuffer& image, const framebuffer& reference) {
+    double sum = 0;
+    for(size_t p = 0; p < image.size(); ++p) {
+        auto a = image.average(p), b = reference.average(p);
+        for(int k = 0; k < 3; ++k) {
+            auto d = std::clamp(linear_to_gamma(std::max(a[k], 0.0)), 0.0, 1.0) - std::clamp(linear_to_gamma(std::max(b[k], 0.0)), 0.0, 1.0);
+            sum += d * d;
+        }
+    }
+    return std::sqrt(sum / (3.0 * image.size()));
+}
+
+static size_t mismatches(const framebuffer& a, const framebuffer& b) {
+    size_t count = 0;
+    for(size_t p = 0; p < a.size(); ++p) {
+        const auto &x = a.sum(p), &y = b.sum(p);
+        count += x.x() != y.x() || x.y() != y.y() || x.z() != y.z();
+    }
+    return count;
+}
+
+static double seconds_since(steady_clock::time_point start) {
+    return duration_cast<microseconds>(steady_clock::now() - start).count() / 1000000.0;
+}
+
+int main(int argc, char* argv[]) {
+    int width = 400;
+    int reference_spp = 1024;
+    int threads = 0;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--width" && i + 1 < argc)
+            width = std::stoi(argv[++i]);
+        else if(arg == "--reference" && i + 1 < argc)
+            reference_spp = std::stoi(argv[++i]);
+        else if(arg == "--threads" && i + 1 < argc)
+            threads = std::stoi(argv[++i]);
+        else {
+            std::cerr << "usage: denoise_bench [--width w] [--reference spp] [--threads n]\n";
+            return 1;
+        }
+    }
+
+    auto world = sphere_grid_scene();
+    camera cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = width;
+    cam.max_depth = 50;
+    cam.thread_count = threads;
+    cam.defer_output = true;
+    cam.seed = 1; //the reference's noise is independent of the images measured against it
+
+    std::cerr << "reference, " << reference_spp << " samples per pixel\n";
+    cam.samples_per_pixel = reference_spp;
+    cam.render(world);
+    auto reference = cam.result();
+    cam.seed = 0;
+    cam.denoising = true;
+
+    auto level = detected_simd_level();
+    std::printf("%6s %10s %10s %12s %12s %12s %14s %9s\n", "spp", "render s", "raw rmse", "scalar ms", "avx2 ms", "avx512 ms", "denoised rmse", "mismatch");
+    for(int spp : {1, 2, 4, 8, 16, 32, 64, 128, 256}) {
+        std::cerr << spp << " samples per pixel\n";
+        cam.samples_per_pixel = spp;
+        cam.render(world);
+        const auto& raw = cam.raw_result();
+        const auto& aovs = cam.aov_result();
+
+        //the same filter at each level, single threaded so the times compare kernels
+        framebuffer scalar;
+        double ms[3] = {0, 0, 0};
+        size_t mismatch = 0;
+        simd_level levels[3] = {simd_level::scalar, simd_level::avx2, simd_level::avx512};
+        for(int l = 0; l < 3; ++l) {
+            if(levels[l] > level)
+                continue;
+            auto start = steady_clock::now();
+            auto filtered = denoise(raw, aovs, cam.denoiser, nullptr, levels[l]);
+            ms[l] = 1000 * seconds_since(start);
+            if(l == 0)
+                scalar = filtered;
+            else
+                mismatch += mismatches(scalar, filtered);
+        }
+        std::printf("%6d %10.3f %10.5f %12.2f %12.2f %12.2f %14.5f %9zu\n", spp, cam.render_time(), display_rmse(raw, reference),
+            ms[0], ms[1], ms[2], display_rmse(scalar, reference), mismatch);
+        std::fflush(stdout);
+    }
+}
@@ -0,0 +1,147 @@
+#include "rtweekend.h"
+
+#include "hittable_list.h"
+#include "material.h"
+#include "sphere.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+/* hit_record benchmark
+
+per candidate hit cost of the old hit_record (shared_ptr<material>, copied out of every sphere
+hit and again out of hittable_list's temporary record) against the current one (raw material
+pointer, filled in place). rays run down a row of spheres ordered far to near, so every sphere is
+a new closest hit and pays the full record cost; all spheres share one material like the grid in
+main.cpp, so threads fight over the same reference count
+
+*/
+
+class legacy_hit_record { //hit_record as it was, owning a reference to the material
+    public:
+        point3 p;
+        vec3 normal;
+        double t;
+        bool front_face;
+        shared_ptr<material> mat;
+
+        void set_face_normal(const ray& r, const vec3& outward_normal) {
+            front_face = dot(r.direction(), outward_normal) < 0;
+            normal = front_face ? outward_normal : -outward_normal;
+        }
+};
+
+class legacy_sphere { //sphere::hit as it was, copying the shared_ptr into the record
+    public:
+        legacy_sphere(point3 _center, double _radius, shared_ptr<material> _material) : center(_center), radius(_radius), mat(_material) {}
+
+        virtual ~legacy_sphere() = default;
+
+        virtual bool hit(const ray& r, interval ray_t, legacy_hit_record& rec) const {
+            vec3 oc = r.origin() - center;
+            auto a = r.direction().length_squared();
+            auto half_b = dot(oc, r.direction());
+            auto c = oc.length_squared() - radius*radius;
+            auto discriminant = half_b*half_b - a*c;
+            if(discriminant < 0)
+                return false;
+            auto sqrtd = sqrt(discriminant);
+            auto root = (-half_b - sqrtd) / a;
+            if(!ray_t.surrounds(root)) {
+                root = (-half_b + sqrtd) / a;
+                if(!ray_t.surrounds(root))
+                    return false;
+            }
+            rec.t = root;
+            rec.p = r.at(rec.t);
+            rec.set_face_normal(r, (rec.p - center) / radius);
+            rec.mat = mat;
+            return true;
+        }
+
+    private:
+        point3 center;
+        double radius;
+        shared_ptr<material> mat;
+};
+
+static bool legacy_list_hit(const std::vector<shared_ptr<legacy_sphere>>& objects, const ray& r, interval ray_t, legacy_hit_record& rec) {
+    //hittable_list::hit as it was, through a temporary record copied into rec on every hit
+    legacy_hit_record temp_rec;
+    bool hit_anything = false;
+    auto closest_so_far = ray_t.max;
+    for(const auto& object : objects) {
+        if(object->hit(r, interval(ray_t.min, closest_so_far), temp_rec)) {
+            hit_anything = true;
+            closest_so_far = temp_rec.t;
+            rec = temp_rec;
+        }
+    }
+    return hit_anything;
+}
+
+template<typename F>
+static double ns_per_hit_once(int threads, long long hits_per_thread, F trace) {
+    std::vector<std::thread> workers;
+    std::atomic<int> ready(0);
+    auto start = high_resolution_clock::now();
+    for(int t = 0; t < threads; ++t) {
+        workers.emplace_back([&] {
+            ++ready;
+            while(ready < threads) {}
+            trace();
+        });
+    }
+    for(auto& w : workers)
+        w.join();
+    auto ns = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+    return static_cast<double>(ns) / hits_per_thread; //wall time per hit on each thread
+}
+
+template<typename F>
+static double ns_per_hit(int threads, long long hits_per_thread, F trace) {
+    //best of several runs, to keep scheduler noise out of small per hit differences
+    double best = infinity;
+    for(int run = 0; run < 7; ++run)
+        best = fmin(best, ns_per_hit_once(threads, hits_per_thread, trace));
+    return best;
+}
+
+int main() {
+    const int row = 64; //spheres per ray, all hit
+    const int rays = 20000;
+    auto mat = make_shared<lambertian>(color(0.5,0.5,0.5));
+
+    std::vector<shared_ptr<legacy_sphere>> legacy;
+    hittable_list current;
+    for(int k = row - 1; k >= 0; --k) { //far to near, so each one is closer than the last
+        legacy.push_back(make_shared<legacy_sphere>(point3(0, 0, -1.0 - k), 0.4, mat));
+        current.add(make_shared<sphere>(point3(0, 0, -1.0 - k), 0.4, mat));
+    }
+    ray r(point3(0,0,0), vec3(0,0,-1));
+    long long hits_per_thread = static_cast<long long>(row) * rays;
+
+    int max_threads = static_cast<int>(std::thread::hardware_concurrency());
+    if(max_threads < 4)
+        max_threads = 4;
+
+    std::printf("%8s %18s %18s\n", "threads", "shared_ptr ns/hit", "raw ptr ns/hit");
+    for(int threads = 1; threads <= max_threads; threads *= 2) {
+        auto before = ns_per_hit(threads, hits_per_thread, [&] {
+            legacy_hit_record rec;
+            for(int i = 0; i < rays; ++i)
+                legacy_list_hit(legacy, r, interval(0.001, infinity), rec);
+        });
+        auto after = ns_per_hit(threads, hits_per_thread, [&] {
+            hit_record rec;
+            for(int i = 0; i < rays; ++i)
+                current.hit(r, interval(0.001, infinity), rec);
+        });
+        std::printf("%8d %18.2f %18.2f\n", threads, before, after);
+    }
+}
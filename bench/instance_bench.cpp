@@ -0,0 +1,163 @@
+#include "rtweekend.h"
+
+#include "instance.h"
+#include "material.h"
+#include "sphere_bvh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace std::chrono;
+
+/* instance benchmark
+
+one object of 48 spheres placed n times, each copy turned and scaled its own way, as
+  flat       every copy's spheres transformed into world space and built into one sphere_bvh
+  instanced  the object built once as a sphere_bvh (the BLAS) and an instance_bvh over n instances of it (the TLAS)
+turns and uniform scales keep spheres spheres, so both are the same scene
+
+reports memory and build time, rays/sec, the cost of moving every copy a little (flat: move every sphere and
+refit, or rebuild; instanced: set every transform and refit, or rebuild the top level) and checks both report
+the same closest hits, t within a relative 1e-9 since the instanced rays go through a transform and back
+
+*/
+
+static double seconds_since(high_resolution_clock::time_point start) {
+    return duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+}
+
+static double rays_per_second(const hittable& world, const std::vector<ray>& rays, double budget) {
+    size_t traced = 0;
+    auto start = high_resolution_clock::now();
+    double elapsed = 0;
+    do {
+        for(const auto& r : rays) {
+            hit_record rec;
+            world.hit(r, interval(0.001, infinity), rec);
+            ++traced;
+        }
+        elapsed = seconds_since(start);
+    } while(elapsed < budget);
+    return traced / elapsed;
+}
+
+static int mismatches(const hittable& a, const hittable& b, const std::vector<ray>& rays) {
+    int count = 0;
+    for(const auto& r : rays) {
+        hit_record rec_a, rec_b;
+        bool hit_a = a.hit(r, interval(0.001, infinity), rec_a);
+        bool hit_b = b.hit(r, interval(0.001, infinity), rec_b);
+        if(hit_a != hit_b || (hit_a && std::fabs(rec_a.t - rec_b.t) > 1e-9 * rec_a.t))
+            ++count;
+    }
+    return count;
+}
+
+static size_t sphere_bvh_bytes(const sphere_bvh& bvh) {
+    const auto& a = bvh.arrays();
+    return a.node_count * sizeof(flat_bvh_node) + a.slots * (5 * sizeof(real) + sizeof(uint32_t));
+}
+
+int main() {
+    sampler s(2024);
+    std::vector<material> mats = {lambertian(color(0.5,0.5,0.5))};
+
+    std::vector<sphere_record> object; //a ball of 48 spheres around the origin
+    while(object.size() < 48) {
+        point3 p(s.random_double(-1,1), s.random_double(-1,1), s.random_double(-1,1));
+        if(p.length_squared() <= 1)
+            object.push_back({0.4 * p, s.random_double(0.05, 0.12), 0});
+    }
+
+    std::printf("%8s %10s %10s %10s %12s %12s %12s %13s %9s\n", "copies", "layout", "MB", "build ms", "refit ms",
+        "rebuild ms", "rays/s", "moved rays/s", "mismatch");
+    for(int n : {100, 1000, 10000, 100000}) {
+        auto extent = 0.6 * std::cbrt(static_cast<double>(n));
+        std::vector<affine_transform> places(n);
+        std::vector<vec3> offsets(n), velocities(n);
+        std::vector<double> scales(n);
+        for(int i = 0; i < n; ++i) {
+            offsets[i] = vec3(s.random_double(-extent,extent), s.random_double(-extent,extent), s.random_double(-extent,extent));
+            velocities[i] = 0.2 * vec3(s.random_double(-1,1), s.random_double(-1,1), s.random_double(-1,1));
+            scales[i] = s.random_double(0.5, 1.5);
+            places[i] = affine_transform::translate(offsets[i])
+                      * affine_transform::rotate(vec3(s.random_double(-1,1), s.random_double(-1,1), s.random_double(-1,1)), s.random_double(0, 360))
+                      * affine_transform::scale(scales[i]);
+        }
+        std::vector<ray> rays;
+        for(int i = 0; i < 4096; ++i) {
+            auto origin = 2 * extent * unit_vector(vec3(s.random_double(-1,1), s.random_double(-1,1), s.random_double(-1,1)));
+            auto target = vec3(s.random_double(-extent,extent), s.random_double(-extent,extent), s.random_double(-extent,extent));
+            rays.push_back(ray(origin, target - origin));
+        }
+
+        //flat
+        auto start = high_resolution_clock::now();
+        std::vector<sphere_record> spheres;
+        spheres.reserve(n * object.size());
+        for(int i = 0; i < n; ++i)
+            for(const auto& sp : object)
+                spheres.push_back({places[i].point(sp.center), sp.radius * scales[i], sp.material});
+        sphere_bvh flat(spheres, mats);
+        auto flat_build_ms = 1000 * seconds_since(start);
+        auto flat_mb = sphere_bvh_bytes(flat) / 1e6;
+        auto flat_rate = rays_per_second(flat, rays, 0.3);
+
+        //instanced
+        start = high_resolution_clock::now();
+        auto blas = make_shared<sphere_bvh>(object, mats);
+        instance_bvh tlas;
+        for(int i = 0; i < n; ++i)
+            tlas.add(blas, places[i]);
+        tlas.build();
+        auto instanced_build_ms = 1000 * seconds_since(start);
+        auto instanced_mb = (sphere_bvh_bytes(*blas) + tlas.memory_bytes()) / 1e6;
+        auto instanced_rate = rays_per_second(tlas, rays, 0.3);
+        auto mismatch = mismatches(flat, tlas, rays);
+
+        //every copy moves by its velocity
+        std::vector<affine_transform> moved(n);
+        for(int i = 0; i < n; ++i)
+            moved[i] = affine_transform::translate(velocities[i]) * places[i];
+
+        start = high_resolution_clock::now();
+        const auto& arrays = flat.arrays();
+        for(uint32_t slot = 0; slot < arrays.slots; ++slot) {
+            if(std::isnan(arrays.cx[slot]))
+                continue;
+            //the arrays don't record which copy a sphere came from, any offset per sphere costs the same
+            flat.move_sphere(slot, flat.sphere_center(slot) + velocities[slot % n]);
+        }
+        flat.refit();
+        auto flat_refit_ms = 1000 * seconds_since(start);
+
+        start = high_resolution_clock::now();
+        std::vector<sphere_record> moved_spheres;
+        moved_spheres.reserve(n * object.size());
+        for(int i = 0; i < n; ++i)
+            for(const auto& sp : object)
+                moved_spheres.push_back({moved[i].point(sp.center), sp.radius * scales[i], sp.material});
+        sphere_bvh flat_rebuilt(moved_spheres, mats);
+        auto flat_rebuild_ms = 1000 * seconds_since(start);
+        auto flat_moved_rate = rays_per_second(flat_rebuilt, rays, 0.3);
+
+        start = high_resolution_clock::now();
+        for(int i = 0; i < n; ++i)
+            tlas.set_transform(i, moved[i]);
+        tlas.refit();
+        auto instanced_refit_ms = 1000 * seconds_since(start);
+        auto refit_rate = rays_per_second(tlas, rays, 0.3);
+        auto moved_mismatch = mismatches(flat_rebuilt, tlas, rays);
+
+        start = high_resolution_clock::now();
+        tlas.build();
+        auto instanced_rebuild_ms = 1000 * seconds_since(start);
+
+        std::printf("%8d %10s %10.2f %10.2f %12.2f %12.2f %12.0f %13.0f %9d\n", n, "flat", flat_mb, flat_build_ms,
+            flat_refit_ms, flat_rebuild_ms, flat_rate, flat_moved_rate, 0);
+        std::printf("%8d %10s %10.2f %10.2f %12.2f %12.2f %12.0f %13.0f %9d\n", n, "instanced", instanced_mb, instanced_build_ms,
+            instanced_refit_ms, instanced_rebuild_ms, instanced_rate, refit_rate, mismatch + moved_mismatch);
+        std::fflush(stdout);
+    }
+}
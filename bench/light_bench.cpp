@@ -0,0 +1,97 @@
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "scenes.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+/* light sampling benchmark
+
+error against samples per pixel with and without next event estimation (camera::light_sampling, lights.h):
+renders lit_scene under a dim sky once at a high sample count with light sampling as the reference, then
+both ways at increasing sample counts, and reports each image's error against the reference next to its
+render time (what the shadow rays cost per sample)
+
+usage: light_bench [--width w] [--reference spp] [--sky brightness] [--threads n]
+
+the reference uses Sobol with its own seed like sampler_bench, error is the RMSE of the displayed values.
+the last line is how many times the samples bsdf sampling needs for nee's error at the highest count
+(error falls with the square root of the samples), and the same at equal render time
+
+*/
+
+static double display_rmse(const framebuffer& image, const framebuffer& reference) {
+    double sum = 0;
+    for(size_t p = 0; p < image.size(); ++p) {
+        auto a = image.average(p), b = reference.average(p);
+        for(int k = 0; k < 3; ++k) {
+            auto d = std::clamp(linear_to_gamma(std::max(a[k], 0.0)), 0.0, 1.0) - std::clamp(linear_to_gamma(std::max(b[k], 0.0)), 0.0, 1.0);
+            sum += d * d;
+        }
+    }
+    return std::sqrt(sum / (3.0 * image.size()));
+}
+
+int main(int argc, char* argv[]) {
+    int width = 160;
+    int reference_spp = 2048;
+    double sky = 0.02;
+    int threads = 0;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--width" && i + 1 < argc)
+            width = std::stoi(argv[++i]);
+        else if(arg == "--reference" && i + 1 < argc)
+            reference_spp = std::stoi(argv[++i]);
+        else if(arg == "--sky" && i + 1 < argc)
+            sky = std::stod(argv[++i]);
+        else if(arg == "--threads" && i + 1 < argc)
+            threads = std::stoi(argv[++i]);
+        else {
+            std::cerr << "usage: light_bench [--width w] [--reference spp] [--sky brightness] [--threads n]\n";
+            return 1;
+        }
+    }
+
+    auto world = lit_scene();
+    camera cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = width;
+    cam.max_depth = 20;
+    cam.thread_count = threads;
+    cam.sky_brightness = sky;
+    cam.lights = world.lights;
+    cam.defer_output = true;
+
+    std::cerr << "reference, " << reference_spp << " samples per pixel\n";
+    cam.seed = 1;
+    cam.sampling = sample_pattern::sobol;
+    cam.light_sampling = true;
+    cam.samples_per_pixel = reference_spp;
+    cam.render(world);
+    auto reference = cam.result();
+    cam.seed = 0;
+    cam.sampling = sample_pattern::independent;
+
+    std::printf("%6s %12s %8s %12s %8s\n", "spp", "bsdf", "s", "nee", "s");
+    double error[2] = {0, 0}, seconds[2] = {0, 0};
+    for(int spp : {1, 4, 16, 64}) {
+        std::cerr << spp << " samples per pixel\n";
+        std::printf("%6d", spp);
+        for(int nee = 0; nee < 2; ++nee) {
+            cam.light_sampling = nee == 1;
+            cam.samples_per_pixel = spp;
+            cam.render(world);
+            error[nee] = display_rmse(cam.result(), reference);
+            seconds[nee] = cam.render_time();
+            std::printf(" %12.5f %8.3f", error[nee], seconds[nee]);
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+    auto samples = (error[0] / error[1]) * (error[0] / error[1]);
+    std::printf("bsdf sampling needs %.1fx the samples, %.1fx the time for the same error\n", samples, samples * seconds[0] / seconds[1]);
+}
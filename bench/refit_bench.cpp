@@ -0,0 +1,119 @@
+#include "rtweekend.h"
+
+#include "material.h"
+#include "sphere_bvh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace std::chrono;
+
+/* refit benchmark
+
+what animation.h does between frames: moves a share of a random sphere field and refits the sphere_bvh,
+against building it again from scratch. also traces the same rays through the refitted and the rebuilt
+tree, the refitted one is slower as the moved spheres get further from where the tree put them, and
+checks both report the same closest hits
+
+*/
+
+static double seconds_since(high_resolution_clock::time_point start) {
+    return duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+}
+
+static double rays_per_second(const hittable& world, const std::vector<ray>& rays, double budget) {
+    size_t traced = 0;
+    auto start = high_resolution_clock::now();
+    double elapsed = 0;
+    do {
+        for(const auto& r : rays) {
+            hit_record rec;
+            world.hit(r, interval(0.001, infinity), rec);
+            ++traced;
+        }
+        elapsed = seconds_since(start);
+    } while(elapsed < budget);
+    return traced / elapsed;
+}
+
+static int mismatches(const hittable& a, const hittable& b, const std::vector<ray>& rays) {
+    int count = 0;
+    for(const auto& r : rays) {
+        hit_record rec_a, rec_b;
+        bool hit_a = a.hit(r, interval(0.001, infinity), rec_a);
+        bool hit_b = b.hit(r, interval(0.001, infinity), rec_b);
+        if(hit_a != hit_b || (hit_a && rec_a.t != rec_b.t))
+            ++count;
+    }
+    return count;
+}
+
+int main() {
+    sampler s(2024);
+    std::vector<material> mats = {lambertian(color(0.5,0.5,0.5))};
+
+    std::printf("%10s %8s %10s %10s %10s %15s %15s %9s\n", "spheres", "moved", "frames", "build ms", "refit ms",
+        "refit rays/s", "rebuilt rays/s", "mismatch");
+    for(int n : {10000, 100000, 1000000}) {
+        auto extent = 0.5 * std::cbrt(static_cast<double>(n));
+        std::vector<sphere_record> spheres(n);
+        for(auto& sp : spheres) {
+            sp.center = point3(s.random_double(-extent,extent), s.random_double(-extent,extent), s.random_double(-extent,extent));
+            sp.radius = s.random_double(0.05, 0.3);
+            sp.material = 0;
+        }
+        std::vector<ray> rays;
+        for(int i = 0; i < 4096; ++i) {
+            auto origin = 2 * extent * unit_vector(vec3(s.random_double(-1,1), s.random_double(-1,1), s.random_double(-1,1)));
+            auto target = vec3(s.random_double(-extent,extent), s.random_double(-extent,extent), s.random_double(-extent,extent));
+            rays.push_back(ray(origin, target - origin));
+        }
+
+        for(double share : {0.01, 0.1, 1.0}) {
+            //every frame the moved spheres go a tenth of a unit further in their own direction
+            sphere_bvh refitted(spheres, mats);
+            std::vector<uint32_t> slots;
+            std::vector<point3> origin;
+            std::vector<vec3> velocity;
+            for(uint32_t slot = 0; slot < refitted.arrays().slots; ++slot) {
+                if(std::isnan(refitted.arrays().cx[slot]) || s.random_double() >= share)
+                    continue;
+                slots.push_back(slot);
+                origin.push_back(refitted.sphere_center(slot));
+                velocity.push_back(0.1 * random_unit_vector(s));
+            }
+
+            for(int frames : {1, 10, 100}) {
+                auto refit_start = high_resolution_clock::now();
+                for(int f = 1; f <= frames; ++f) {
+                    for(size_t k = 0; k < slots.size(); ++k)
+                        refitted.move_sphere(slots[k], origin[k] + f * velocity[k]);
+                    refitted.refit();
+                }
+                auto refit_ms = 1000 * seconds_since(refit_start) / frames;
+
+                //the same positions built from scratch, the slots of the built arrays aren't the input order
+                std::vector<sphere_record> now;
+                for(uint32_t slot = 0; slot < refitted.arrays().slots; ++slot) {
+                    if(std::isnan(refitted.arrays().cx[slot]))
+                        continue;
+                    now.push_back({refitted.sphere_center(slot), refitted.arrays().radii[slot], 0});
+                }
+                auto build_start = high_resolution_clock::now();
+                sphere_bvh rebuilt(now, mats);
+                auto build_ms = 1000 * seconds_since(build_start);
+
+                std::vector<ray> check(rays.begin(), rays.begin() + 1024);
+                std::printf("%10d %7.0f%% %10d %10.2f %10.3f %15.0f %15.0f %9d\n", n, 100 * share, frames, build_ms, refit_ms,
+                    rays_per_second(refitted, rays, 0.3), rays_per_second(rebuilt, rays, 0.3), mismatches(refitted, rebuilt, check));
+                std::fflush(stdout);
+
+                //back to frame 0 for the next run
+                for(size_t k = 0; k < slots.size(); ++k)
+                    refitted.move_sphere(slots[k], origin[k]);
+                refitted.refit();
+            }
+        }
+    }
+}
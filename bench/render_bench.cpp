@@ -0,0 +1,130 @@
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "scenes.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+/* render benchmark suite
+
+renders each canonical scene twice: once with max_depth 1 (camera rays only) for primary ray
+throughput, then with the full bounce budget. prints one JSON document on stdout so runs from
+different commits can be diffed or compared by a script; progress goes to stderr
+
+usage: render_bench [--width w] [--spp n] [--threads n] [--scenes grid,glass,field10k,field100k,field1m,instances]
+
+built with -DRT_STATS (see stats.h) so it can report intersection tests per ray,
+the counters cost a few percent of throughput compared to imageoutput
+
+*/
+
+#ifndef RT_GIT_REV
+#define RT_GIT_REV "unknown"
+#endif
+
+struct bench_scene {
+    std::string name;
+    hittable_list (*build)();
+};
+
+static hittable_list field10k() {return sphere_field_scene(10000);}
+static hittable_list field100k() {return sphere_field_scene(100000);}
+static hittable_list field1m() {return sphere_field_scene(1000000);}
+static hittable_list instances() {return instanced_scene(2500);}
+
+int main(int argc, char* argv[]) {
+    int width = 320;
+    int spp = 16;
+    int threads = 0;
+    std::string only;
+
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--width" && i + 1 < argc)
+            width = std::stoi(argv[++i]);
+        else if(arg == "--spp" && i + 1 < argc)
+            spp = std::stoi(argv[++i]);
+        else if(arg == "--threads" && i + 1 < argc)
+            threads = std::stoi(argv[++i]);
+        else if(arg == "--scenes" && i + 1 < argc)
+            only = "," + std::string(argv[++i]) + ",";
+        else {
+            std::cerr << "usage: render_bench [--width w] [--spp n] [--threads n] [--scenes grid,glass,field10k,field100k,field1m,instances]\n";
+            return 1;
+        }
+    }
+
+    std::vector<bench_scene> scenes = {
+        {"grid", sphere_grid_scene},
+        {"glass", glass_scene},
+        {"field10k", field10k},
+        {"field100k", field100k},
+        {"field1m", field1m},
+        {"instances", instances},
+    };
+
+    if(threads <= 0) //what the camera resolves 0 to, recorded as such so results from different machines say so
+        threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    camera cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = width;
+    cam.samples_per_pixel = spp;
+    cam.thread_count = threads;
+    cam.output_path = "/dev/null";
+
+    std::printf("{\n  \"revision\": \"%s\",\n  \"precision\": \"%s\",\n  \"width\": %d,\n  \"spp\": %d,\n  \"threads\": %d,\n  \"scenes\": [", RT_GIT_REV, sizeof(real) == sizeof(float) ? "float" : "double", width, spp, threads);
+
+    bool first = true;
+    for(const auto& scene : scenes) {
+        if(!only.empty() && only.find("," + scene.name + ",") == std::string::npos)
+            continue;
+        std::cerr << scene.name << ": building\n";
+
+        auto build_start = high_resolution_clock::now();
+        auto world = scene.build();
+        auto build_seconds = duration_cast<microseconds>(high_resolution_clock::now() - build_start).count() / 1000000.0;
+
+        //camera rays only
+        std::cerr << scene.name << ": primary rays\n";
+        cam.max_depth = 1;
+        cam.render(world);
+        auto primary_rate = cam.rays_traced() / cam.render_time();
+
+        //full paths, counting intersection work
+        std::cerr << scene.name << ": full render\n";
+        cam.max_depth = 50;
+        reset_stats();
+        auto wall_start = high_resolution_clock::now();
+        cam.render(world);
+        auto wall_seconds = duration_cast<microseconds>(high_resolution_clock::now() - wall_start).count() / 1000000.0;
+        auto counts = collect_stats();
+        auto rays = static_cast<double>(cam.rays_traced());
+
+        std::printf("%s\n    {\n", first ? "" : ",");
+        std::printf("      \"name\": \"%s\",\n", scene.name.c_str());
+        std::printf("      \"build_seconds\": %.6f,\n", build_seconds);
+        std::printf("      \"wall_seconds\": %.6f,\n", wall_seconds);
+        std::printf("      \"render_seconds\": %.6f,\n", cam.render_time());
+        std::printf("      \"primary_rays_per_second\": %.1f,\n", primary_rate);
+        std::printf("      \"rays\": %lld,\n", cam.rays_traced());
+        std::printf("      \"rays_per_second\": %.1f,\n", rays / cam.render_time());
+        std::printf("      \"samples_per_second\": %.1f,\n", cam.samples_taken() / cam.render_time());
+        std::printf("      \"rays_per_sample\": %.4f,\n", rays / cam.samples_taken());
+        std::printf("      \"primitive_tests_per_ray\": %.4f,\n", counts.primitive_tests / rays);
+        std::printf("      \"node_tests_per_ray\": %.4f\n", counts.node_tests / rays);
+        std::printf("    }");
+        std::fflush(stdout);
+        first = false;
+    }
+    std::printf("\n  ]\n}\n");
+}
@@ -0,0 +1,89 @@
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "scenes.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+/* sampler benchmark
+
+error against samples per pixel for every sample pattern: renders the sphere grid once at a high sample
+count as the reference, then with each pattern at increasing sample counts, and reports each image's error
+against the reference next to its render time (what the pattern costs per sample)
+
+usage: sampler_bench [--width w] [--reference spp] [--threads n]
+
+the reference is Sobol with its own seed, so it shares no points with any image measured against it and its
+own error stays well below theirs. error is the RMSE of the displayed values (gamma 2, clamped to [0,1])
+over every channel
+
+*/
+
+static double display_rmse(const framebuffer& image, const framebuffer& reference) {
+    double sum = 0;
+    for(size_t p = 0; p < image.size(); ++p) {
+        auto a = image.average(p), b = reference.average(p);
+        for(int k = 0; k < 3; ++k) {
+            auto d = std::clamp(linear_to_gamma(std::max(a[k], 0.0)), 0.0, 1.0) - std::clamp(linear_to_gamma(std::max(b[k], 0.0)), 0.0, 1.0);
+            sum += d * d;
+        }
+    }
+    return std::sqrt(sum / (3.0 * image.size()));
+}
+
+int main(int argc, char* argv[]) {
+    int width = 200;
+    int reference_spp = 4096;
+    int threads = 0;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--width" && i + 1 < argc)
+            width = std::stoi(argv[++i]);
+        else if(arg == "--reference" && i + 1 < argc)
+            reference_spp = std::stoi(argv[++i]);
+        else if(arg == "--threads" && i + 1 < argc)
+            threads = std::stoi(argv[++i]);
+        else {
+            std::cerr << "usage: sampler_bench [--width w] [--reference spp] [--threads n]\n";
+            return 1;
+        }
+    }
+
+    auto world = sphere_grid_scene();
+    camera cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = width;
+    cam.max_depth = 50;
+    cam.thread_count = threads;
+    cam.defer_output = true;
+
+    std::cerr << "reference, " << reference_spp << " samples per pixel\n";
+    cam.seed = 1;
+    cam.sampling = sample_pattern::sobol;
+    cam.samples_per_pixel = reference_spp;
+    cam.render(world);
+    auto reference = cam.result();
+    cam.seed = 0;
+
+    const char* names[] = {"independent", "stratified", "sobol", "blue noise"};
+    sample_pattern patterns[] = {sample_pattern::independent, sample_pattern::stratified, sample_pattern::sobol, sample_pattern::blue_noise};
+    std::printf("%6s", "spp");
+    for(auto name : names)
+        std::printf(" %12s %8s", name, "s");
+    std::printf("\n");
+    for(int spp : {1, 2, 4, 8, 16, 32, 64, 128, 256}) {
+        std::cerr << spp << " samples per pixel\n";
+        std::printf("%6d", spp);
+        for(auto pattern : patterns) {
+            cam.sampling = pattern;
+            cam.samples_per_pixel = spp;
+            cam.render(world);
+            std::printf(" %12.5f %8.3f", display_rmse(cam.result(), reference), cam.render_time());
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+}
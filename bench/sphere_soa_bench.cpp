@@ -0,0 +1,119 @@
+#include "rtweekend.h"
+
+#include "bvh.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "sphere.h"
+#include "sphere_soa.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace std::chrono;
+
+/* sphere_soa benchmark
+
+part 1: one ray against a flat group of N spheres, scalar sphere::hit through hittable_list
+        versus sphere_soa with each SIMD kernel the cpu supports
+part 2: sphere_soa as BVH leaves, flat_bvh over single spheres versus flat_bvh over groups
+
+*/
+
+static double seconds_since(high_resolution_clock::time_point start) {
+    return duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+}
+
+static double rays_per_second(const hittable& world, const std::vector<ray>& rays, double budget) {
+    size_t traced = 0;
+    auto start = high_resolution_clock::now();
+    double elapsed = 0;
+    do {
+        for(const auto& r : rays) {
+            hit_record rec;
+            world.hit(r, interval(0.001, infinity), rec);
+        }
+        traced += rays.size();
+        elapsed = seconds_since(start);
+    } while(elapsed < budget);
+    return traced / elapsed;
+}
+
+static int mismatches(const hittable& a, const hittable& b, const std::vector<ray>& rays) {
+    //SIMD kernels may round the last bit differently, so compare t with a relative tolerance
+    int count = 0;
+    for(const auto& r : rays) {
+        hit_record rec_a, rec_b;
+        bool hit_a = a.hit(r, interval(0.001, infinity), rec_a);
+        bool hit_b = b.hit(r, interval(0.001, infinity), rec_b);
+        if(hit_a != hit_b || (hit_a && fabs(rec_a.t - rec_b.t) > 1e-9 * rec_a.t))
+            ++count;
+    }
+    return count;
+}
+
+static std::vector<sphere_desc> make_field(int n, double extent, shared_ptr<material> mat, sampler& s) {
+    std::vector<sphere_desc> spheres;
+    for(int i = 0; i < n; ++i) {
+        auto center = point3(s.random_double(-extent,extent), s.random_double(-extent,extent), s.random_double(-extent,extent));
+        spheres.push_back(sphere_desc{center, s.random_double(0.05, 0.3), mat});
+    }
+    return spheres;
+}
+
+static std::vector<ray> make_rays(int count, double extent, sampler& s) {
+    std::vector<ray> rays;
+    for(int i = 0; i < count; ++i) {
+        auto origin = 2 * extent * unit_vector(vec3(s.random_double(-1,1), s.random_double(-1,1), s.random_double(-1,1)));
+        auto target = vec3(s.random_double(-extent,extent), s.random_double(-extent,extent), s.random_double(-extent,extent));
+        rays.push_back(ray(origin, target - origin));
+    }
+    return rays;
+}
+
+int main() {
+    sampler s(7);
+    auto mat = make_shared<lambertian>(color(0.5,0.5,0.5));
+    const char* level_names[] = {"scalar", "sse2", "avx2", "avx512"};
+    auto detected = detected_simd_level();
+    std::printf("cpu supports up to %s\n\n", level_names[static_cast<int>(detected)]);
+
+    std::printf("flat group, rays/sec\n%8s %13s", "spheres", "sphere::hit");
+    for(int l = 0; l <= static_cast<int>(detected); ++l)
+        std::printf(" %13s", level_names[l]);
+    std::printf(" %9s\n", "mismatch");
+    for(int n : {8, 64, 512, 4096}) {
+        auto extent = 0.5 * std::cbrt(static_cast<double>(n));
+        auto spheres = make_field(n, extent, mat, s);
+        hittable_list list;
+        sphere_soa group;
+        for(const auto& sp : spheres) {
+            list.add(make_shared<sphere>(sp.center, sp.radius, sp.mat));
+            group.add(sp.center, sp.radius, sp.mat);
+        }
+        auto rays = make_rays(4096, extent, s);
+
+        std::printf("%8d %13.0f", n, rays_per_second(list, rays, 0.3));
+        int bad = 0;
+        for(int l = 0; l <= static_cast<int>(detected); ++l) {
+            group.set_simd_level(static_cast<simd_level>(l));
+            std::printf(" %13.0f", rays_per_second(group, rays, 0.3));
+            bad += mismatches(list, group, rays);
+        }
+        std::printf(" %9d\n", bad);
+    }
+
+    std::printf("\nflat_bvh leaves, 100000 spheres, rays/sec (%s kernel)\n", level_names[static_cast<int>(detected)]);
+    auto extent = 0.5 * std::cbrt(100000.0);
+    auto spheres = make_field(100000, extent, mat, s);
+    auto rays = make_rays(16384, extent, s);
+    hittable_list list;
+    for(const auto& sp : spheres)
+        list.add(make_shared<sphere>(sp.center, sp.radius, sp.mat));
+    flat_bvh single(list);
+    std::printf("%14s %13.0f\n", "single sphere", rays_per_second(single, rays, 0.5));
+    for(size_t group_size : {4, 8, 16, 32}) {
+        flat_bvh grouped(make_sphere_groups(spheres, group_size));
+        std::printf("%11zu/grp %13.0f  mismatch %d\n", group_size, rays_per_second(grouped, rays, 0.5), mismatches(single, grouped, rays));
+    }
+}
@@ -0,0 +1,121 @@
+#include "rtweekend.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace std::chrono;
+
+/* vec3 benchmark
+
+nanoseconds per operation for the vector operations a bounce is made of, in double and float, over arrays
+of 1024 random vectors (so the loads are real and nothing folds away), plus the sphere sampling functions
+against the rejection sampling they replaced. built twice: bench/vec3_bench with the scalar vec3 and
+bench/vec3_bench_simd with -DRT_SIMD_VEC3 -mavx2 (see vec3.h), run both to compare
+
+*/
+
+#ifdef RT_SIMD_VEC3
+static const char* build_name = "simd";
+#else
+static const char* build_name = "scalar";
+#endif
+
+static const int count = 1024;
+
+template<typename Op>
+static double ns_per_op(Op&& op) {
+    //repeat the whole array until 0.2 s have passed
+    long long ops = 0;
+    auto start = high_resolution_clock::now();
+    double elapsed = 0;
+    do {
+        for(int i = 0; i < count; ++i)
+            op(i);
+        ops += count;
+        elapsed = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+    } while(elapsed < 2e8);
+    return elapsed / ops;
+}
+
+template<typename T>
+static void vector_ops(const char* type) {
+    using V = basic_vec3<T>;
+    sampler s(7);
+    std::vector<V> a(count), b(count), out(count);
+    std::vector<T> scalars(count), dots(count);
+    for(int i = 0; i < count; ++i) {
+        a[i] = V(s.random_double(-1,1), s.random_double(-1,1), s.random_double(-1,1));
+        b[i] = V(s.random_double(-1,1), s.random_double(-1,1), s.random_double(-1,1));
+        scalars[i] = static_cast<T>(s.random_double(0.5, 2));
+    }
+    auto checksum = [&] {
+        double sum = 0;
+        for(int i = 0; i < count; ++i)
+            sum += out[i].x() + out[i].y() + out[i].z() + dots[i];
+        return sum;
+    };
+
+    struct row {const char* name; double ns;};
+    std::vector<row> rows = {
+        {"a + b", ns_per_op([&](int i) {out[i] = a[i] + b[i];})},
+        {"a * b", ns_per_op([&](int i) {out[i] = a[i] * b[i];})},
+        {"t * a", ns_per_op([&](int i) {out[i] = scalars[i] * a[i];})},
+        {"a / t", ns_per_op([&](int i) {out[i] = a[i] / scalars[i];})},
+        {"a += b", ns_per_op([&](int i) {out[i] += b[i];})},
+        {"dot", ns_per_op([&](int i) {dots[i] = dot(a[i], b[i]);})},
+        {"cross", ns_per_op([&](int i) {out[i] = cross(a[i], b[i]);})},
+        {"length", ns_per_op([&](int i) {dots[i] = a[i].length();})},
+        {"unit_vector", ns_per_op([&](int i) {out[i] = unit_vector(a[i]);})},
+        {"reflect", ns_per_op([&](int i) {out[i] = reflect(a[i], b[i]);})},
+        {"throughput*att", ns_per_op([&](int i) {out[i] = out[i] * a[i];})}, //ray_color's per bounce product
+    };
+    for(const auto& r : rows)
+        std::printf("%8s %6s %16s %10.3f\n", build_name, type, r.name, r.ns);
+    std::printf("%8s %6s %16s %10.3g\n", build_name, type, "(checksum)", checksum());
+}
+
+static vec3 rejection_unit_vector(sampler& s) {
+    //the sampling random_unit_vector replaced: a point in the cube until it's in the ball, then normalized
+    while(true) {
+        auto p = vec3(s.random_double(-1,1), s.random_double(-1,1), s.random_double(-1,1));
+        if(p.length_squared() < 1)
+            return unit_vector(p);
+    }
+}
+
+static vec3 rejection_on_hemisphere(const vec3& normal, sampler& s) {
+    auto v = rejection_unit_vector(s);
+    return dot(v, normal) > 0 ? v : -v;
+}
+
+static void sampling_ops() {
+    sampler s(11);
+    std::vector<vec3> normals(count), out(count);
+    for(auto& n : normals)
+        n = unit_vector(vec3(s.random_double(-1,1), s.random_double(-1,1), s.random_double(-1,1)));
+
+    struct row {const char* name; double ns;};
+    std::vector<row> rows = {
+        {"random_double", ns_per_op([&](int i) {out[i] = vec3(s.random_double(), 0, 0);})},
+        {"unit (reject)", ns_per_op([&](int i) {out[i] = rejection_unit_vector(s);})},
+        {"unit (direct)", ns_per_op([&](int i) {out[i] = random_unit_vector(s);})},
+        {"ball (direct)", ns_per_op([&](int i) {out[i] = random_in_unit_sphere(s);})},
+        {"hemi (reject)", ns_per_op([&](int i) {out[i] = rejection_on_hemisphere(normals[i], s);})},
+        {"hemi (direct)", ns_per_op([&](int i) {out[i] = random_on_hemisphere(normals[i], s);})},
+        {"lambert (direct)", ns_per_op([&](int i) {out[i] = normals[i] + random_unit_vector(s);})},
+    };
+    double sum = 0;
+    for(const auto& v : out)
+        sum += v.x() + v.y() + v.z();
+    for(const auto& r : rows)
+        std::printf("%8s %6s %16s %10.3f\n", build_name, "real", r.name, r.ns);
+    std::printf("%8s %6s %16s %10.3g\n", build_name, "real", "(checksum)", sum);
+}
+
+int main() {
+    std::printf("%8s %6s %16s %10s\n", "build", "type", "operation", "ns/op");
+    vector_ops<double>("double");
+    vector_ops<float>("float");
+    sampling_ops();
+}
@@ -0,0 +1,64 @@
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "scenes.h"
+
+#include <cstdio>
+
+/* wavefront benchmark
+
+renders the default sphere grid with the depth first integrator and with the wavefront integrator
+at several batch sizes, and reports rays/sec, samples/sec and how far apart the two images are
+(both are unbiased estimates of the same image, so only noise should separate them)
+
+*/
+
+static double image_mean(const framebuffer& fb) {
+    double total = 0;
+    for(size_t p = 0; p < fb.size(); ++p)
+        total += luminance(fb.average(p));
+    return total / fb.size();
+}
+
+static double rms_difference(const framebuffer& a, const framebuffer& b) {
+    //in display (gamma) space
+    double total = 0;
+    for(size_t p = 0; p < a.size(); ++p) {
+        auto ca = a.average(p);
+        auto cb = b.average(p);
+        for(int c = 0; c < 3; ++c) {
+            auto d = sqrt(fmax(ca[c], 0)) - sqrt(fmax(cb[c], 0));
+            total += d*d;
+        }
+    }
+    return sqrt(total / (3 * a.size()));
+}
+
+int main() {
+    auto world = sphere_grid_scene();
+
+    camera cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 400;
+    cam.samples_per_pixel = 32;
+    cam.max_depth = 50;
+    cam.thread_count = 1; //integrator throughput per core
+    cam.output_path = "/dev/null";
+
+    std::printf("%-22s %12s %12s %10s %12s %12s\n", "integrator", "Mrays/s", "Msamples/s", "seconds", "mean lum", "rms vs depth");
+
+    cam.render(world);
+    auto depth_first = cam.result();
+    std::printf("%-22s %12.3f %12.3f %10.3f %12.5f %12s\n", "depth first", cam.rays_traced() / cam.render_time() / 1e6,
+        cam.samples_taken() / cam.render_time() / 1e6, cam.render_time(), image_mean(depth_first), "-");
+
+    cam.wavefront = true;
+    for(int batch : {256, 1024, 4096, 16384}) {
+        cam.wavefront_batch_size = batch;
+        cam.render(world);
+        char name[32];
+        std::snprintf(name, sizeof(name), "wavefront batch %d", batch);
+        std::printf("%-22s %12.3f %12.3f %10.3f %12.5f %12.5f\n", name, cam.rays_traced() / cam.render_time() / 1e6,
+            cam.samples_taken() / cam.render_time() / 1e6, cam.render_time(), image_mean(cam.result()), rms_difference(depth_first, cam.result()));
+    }
+}
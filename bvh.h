@@ -0,0 +1,380 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+struct bvh_primitive { //build-time record, bounds and centroid are computed once instead of per split
+    aabb box;
+    point3 centroid;
+    size_t index; //into the object list the hierarchy is built over
+};
+
+inline std::vector<bvh_primitive> make_bvh_primitives(const std::vector<shared_ptr<hittable>>& objects) {
+    std::vector<bvh_primitive> prims(objects.size());
+    for(size_t i = 0; i < objects.size(); ++i) {
+        prims[i].box = objects[i]->bounding_box();
+        prims[i].centroid = prims[i].box.centroid();
+        prims[i].index = i;
+    }
+    return prims;
+}
+
+inline size_t sah_split(std::vector<bvh_primitive>& prims, size_t start, size_t end, double& split_cost, int& split_axis) {
+    //splits prims[start,end) in place with the surface area heuristic over binned centroids
+    //returns the index of the first primitive on the right, split_cost is the expected number of
+    //primitive tests below this node for a ray that hits it (area(child)/area(node) * count(child) summed)
+    //and split_axis the axis the children are separated along (left child lower)
+    static const int bin_count = 16; //candidate split planes per axis are the bin boundaries
+
+    aabb node_bounds, centroid_bounds;
+    for(size_t i = start; i < end; ++i) {
+        node_bounds = aabb(node_bounds, prims[i].box);
+        centroid_bounds = aabb(centroid_bounds, aabb(prims[i].centroid, prims[i].centroid));
+    }
+
+    auto bin_index = [](double c, const interval& bounds) {
+        auto b = static_cast<int>(bin_count * (c - bounds.min) / bounds.size());
+        return b < bin_count ? b : bin_count - 1;
+    };
+
+    int best_axis = -1;
+    int best_split = 0;
+    double best_cost = infinity;
+
+    for(int axis = 0; axis < 3; ++axis) {
+        const auto& bounds = centroid_bounds.axis(axis);
+        if(bounds.size() <= 0)
+            continue; //every centroid on the same plane, nothing to split on this axis
+
+        aabb bin_bounds[bin_count];
+        size_t bin_counts[bin_count] = {};
+        for(size_t i = start; i < end; ++i) {
+            auto b = bin_index(prims[i].centroid[axis], bounds);
+            bin_bounds[b] = aabb(bin_bounds[b], prims[i].box);
+            bin_counts[b]++;
+        }
+
+        //sweep from the right to get the cost of everything right of each boundary
+        double right_cost[bin_count];
+        aabb right_box;
+        size_t right_count = 0;
+        for(int b = bin_count - 1; b > 0; --b) {
+            right_box = aabb(right_box, bin_bounds[b]);
+            right_count += bin_counts[b];
+            right_cost[b] = right_box.surface_area() * right_count;
+        }
+
+        //then sweep from the left, split k puts bins [0,k) left and [k,bin_count) right
+        aabb left_box;
+        size_t left_count = 0;
+        for(int k = 1; k < bin_count; ++k) {
+            left_box = aabb(left_box, bin_bounds[k-1]);
+            left_count += bin_counts[k-1];
+            if(left_count == 0 || left_count == end - start)
+                continue;
+            auto cost = left_box.surface_area() * left_count + right_cost[k];
+            if(cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = k;
+            }
+        }
+    }
+
+    size_t mid = start + (end - start) / 2;
+    if(best_axis < 0) {
+        //all centroids coincide, any split is as good as another
+        split_cost = static_cast<double>(end - start);
+        split_axis = node_bounds.longest_axis();
+        return mid;
+    }
+
+    auto area = node_bounds.surface_area();
+    split_cost = area > 0 ? best_cost / area : static_cast<double>(end - start);
+    split_axis = best_axis;
+
+    const auto& bounds = centroid_bounds.axis(best_axis);
+    auto first_right = std::partition(prims.begin() + start, prims.begin() + end,
+        [&](const bvh_primitive& p) {return bin_index(p.centroid[best_axis], bounds) < best_split;});
+    return static_cast<size_t>(first_right - prims.begin());
+}
+
+class bvh_node : public hittable { //bounding volume hierarchy over a hittable_list
+    //each node holds a box around everything below it, a ray that misses the box skips the whole subtree
+    //so a hit costs O(log N) box tests instead of testing every object like hittable_list does
+    //splits are chosen with the surface area heuristic (SAH) over binned centroids
+    public:
+        bvh_node(const hittable_list& list) {
+            auto prims = make_bvh_primitives(list.objects);
+            build(list.objects, prims, 0, prims.size());
+        }
+
+        bvh_node(const std::vector<shared_ptr<hittable>>& objects, std::vector<bvh_primitive>& prims, size_t start, size_t end) {
+            build(objects, prims, start, end);
+        }
+
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+            RT_STAT(hit_calls, 1);
+            RT_STAT(node_tests, 1);
+            if(!bbox.hit(r, ray_t))
+                return false;
+
+            //only accept right hits closer than the left one
+            bool hit_left = left->hit(r, ray_t, rec);
+            bool hit_right = right->hit(r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
+
+            return hit_left || hit_right;
+        }
+
+        bool occluded(const ray& r, interval ray_t) const override {
+            RT_STAT(node_tests, 1);
+            return bbox.hit(r, ray_t) && (left->occluded(r, ray_t) || (right != left && right->occluded(r, ray_t)));
+        }
+
+        aabb bounding_box() const override {return bbox;}
+
+    private:
+        shared_ptr<hittable> left;
+        shared_ptr<hittable> right;
+        aabb bbox;
+
+        void build(const std::vector<shared_ptr<hittable>>& objects, std::vector<bvh_primitive>& prims, size_t start, size_t end) {
+            //builds the subtree over prims[start,end), reordering that range in place
+            size_t object_span = end - start;
+
+            if(object_span == 1) {
+                left = right = objects[prims[start].index];
+            } else if(object_span == 2) {
+                left = objects[prims[start].index];
+                right = objects[prims[start+1].index];
+            } else {
+                double split_cost;
+                int split_axis;
+                auto mid = sah_split(prims, start, end, split_cost, split_axis);
+                left = make_shared<bvh_node>(objects, prims, start, mid);
+                right = make_shared<bvh_node>(objects, prims, mid, end);
+            }
+
+            bbox = aabb(left->bounding_box(), right->bounding_box());
+        }
+};
+
+struct alignas(32) flat_bvh_node { //exactly 32 bytes so two nodes share a cache line
+    float bounds_min[3]; //float bounds rounded outwards, so the box never shrinks
+    float bounds_max[3];
+    uint32_t offset; //leaf: first primitive, interior: second child (the first child is the next node)
+    uint16_t count; //primitives in a leaf, 0 for interior nodes
+    uint8_t axis; //split axis of an interior node, decides which child is nearer to a ray
+    uint8_t pad;
+};
+
+static_assert(sizeof(flat_bvh_node) == 32, "flat_bvh_node should fill half a cache line");
+
+inline bool flat_node_hit(const flat_bvh_node& node, const point3& orig, const vec3& inv_dir, interval ray_t) {
+    //slab test against the node box, same as aabb::hit but with the reciprocal direction hoisted out
+    for(int a = 0; a < 3; a++) {
+        auto t0 = (node.bounds_min[a] - orig[a]) * inv_dir[a];
+        auto t1 = (node.bounds_max[a] - orig[a]) * inv_dir[a];
+        if(inv_dir[a] < 0)
+            std::swap(t0, t1);
+        if(t0 > ray_t.min)
+            ray_t.min = t0;
+        if(t1 < ray_t.max)
+            ray_t.max = t1;
+        if(ray_t.max <= ray_t.min)
+            return false;
+    }
+    return true;
+}
+
+inline void set_node_bounds(flat_bvh_node& node, const aabb& box) {
+    //float bounds rounded outwards so the node box always contains box
+    for(int a = 0; a < 3; a++) {
+        auto lo = static_cast<float>(box.axis(a).min);
+        auto hi = static_cast<float>(box.axis(a).max);
+        node.bounds_min[a] = lo > box.axis(a).min ? std::nextafter(lo, -std::numeric_limits<float>::infinity()) : lo;
+        node.bounds_max[a] = hi < box.axis(a).max ? std::nextafter(hi, std::numeric_limits<float>::infinity()) : hi;
+    }
+}
+
+const int flat_bvh_max_depth = 64; //levels a flat BVH may have, its traversal stack holds one entry per level
+
+inline int ceil_log2(size_t n) {
+    int bits = 0;
+    while((size_t(1) << bits) < n)
+        ++bits;
+    return bits;
+}
+
+struct flat_bvh_leaf_rule { //when build_flat_bvh stops splitting
+    size_t max_leaf_size;
+    double traversal_cost; //of a box test relative to a primitive test, infinity makes every run of max_leaf_size a leaf
+};
+
+template <class EmitLeaf>
+uint32_t build_flat_bvh(std::vector<flat_bvh_node>& nodes, std::vector<bvh_primitive>& prims, size_t start, size_t end,
+                        const flat_bvh_leaf_rule& rule, const EmitLeaf& emit_leaf, int depth = 1) {
+    //appends the subtree over prims[start,end) depth first and returns the index of its root. emit_leaf(node,
+    //start, end) stores a leaf's primitives wherever the caller keeps them and sets node.offset and node.count.
+    //SAH splits as long as they leave room below, then median splits, which need at most ceil(log2 count)
+    //more levels, so no node ends up deeper than flat_bvh_max_depth whatever the primitives look like
+    auto node_index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(flat_bvh_node());
+
+    aabb box;
+    for(size_t i = start; i < end; ++i)
+        box = aabb(box, prims[i].box);
+    set_node_bounds(nodes[node_index], box);
+
+    size_t count = end - start;
+    size_t mid = start;
+    double split_cost = 0;
+    int split_axis = 0;
+    bool make_leaf = count == 1 || (count <= rule.max_leaf_size && rule.traversal_cost >= count);
+    if(!make_leaf) {
+        if(depth + ceil_log2(count) < flat_bvh_max_depth) {
+            mid = sah_split(prims, start, end, split_cost, split_axis);
+        } else {
+            //close to the stack size, split by count on the longest axis so the rest fits
+            split_axis = box.longest_axis();
+            mid = start + count / 2;
+            std::nth_element(prims.begin() + start, prims.begin() + mid, prims.begin() + end,
+                [split_axis](const bvh_primitive& a, const bvh_primitive& b) {return a.centroid[split_axis] < b.centroid[split_axis];});
+        }
+        //stop splitting once testing everything here is cheaper than descending
+        make_leaf = count <= rule.max_leaf_size && rule.traversal_cost + split_cost >= count;
+    }
+
+    if(make_leaf) {
+        emit_leaf(nodes[node_index], start, end);
+        return node_index;
+    }
+
+    nodes[node_index].axis = static_cast<uint8_t>(split_axis);
+    nodes[node_index].count = 0;
+
+    build_flat_bvh(nodes, prims, start, mid, rule, emit_leaf, depth + 1);
+    auto right = build_flat_bvh(nodes, prims, mid, end, rule, emit_leaf, depth + 1);
+    nodes[node_index].offset = right;
+    return node_index;
+}
+
+template <bool AnyHit, class Leaf>
+bool traverse_flat_bvh(const flat_bvh_node* nodes, const ray& r, interval& ray_t, const Leaf& leaf) {
+    //walks a tree from build_flat_bvh with a fixed stack, pushing the far child and continuing with the near
+    //one. leaf(node, ray_t) tests a leaf's primitives, returns whether any was hit and shrinks ray_t.max to the
+    //closest. AnyHit stops at the first leaf that reports a hit (shadow rays), otherwise ray_t ends at the closest
+    auto orig = r.origin();
+    auto dir = r.direction();
+    vec3 inv_dir(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+    bool dir_is_neg[3] = {inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0};
+
+    uint32_t stack[flat_bvh_max_depth];
+    int stack_top = 0;
+    uint32_t current = 0;
+    bool hit_anything = false;
+
+    while(true) {
+        const auto& node = nodes[current];
+        RT_STAT(node_tests, 1);
+        if(flat_node_hit(node, orig, inv_dir, ray_t)) {
+            if(node.count > 0) {
+                if(leaf(node, ray_t)) {
+                    if(AnyHit)
+                        return true;
+                    hit_anything = true;
+                }
+            } else {
+                assert(stack_top < flat_bvh_max_depth);
+                if(dir_is_neg[node.axis]) {
+                    stack[stack_top++] = current + 1;
+                    current = node.offset;
+                } else {
+                    stack[stack_top++] = node.offset;
+                    current = current + 1;
+                }
+                continue;
+            }
+        }
+        if(stack_top == 0)
+            return hit_anything;
+        current = stack[--stack_top];
+    }
+}
+
+class flat_bvh : public hittable { //linearized BVH, same SAH build as bvh_node
+    //nodes live depth first in one contiguous array and point to each other by index instead of shared_ptr,
+    //traversal walks them with a small fixed stack and visits the child nearer to the ray first
+    //so the closest hit shrinks ray_t early and the far child's box test usually culls it
+    public:
+        flat_bvh(const hittable_list& list) {
+            auto prims = make_bvh_primitives(list.objects);
+            primitives.reserve(prims.size());
+            nodes.reserve(prims.empty() ? 0 : 2 * prims.size() - 1);
+            if(!prims.empty()) {
+                build_flat_bvh(nodes, prims, 0, prims.size(), flat_bvh_leaf_rule{max_leaf_size, traversal_cost},
+                    [&](flat_bvh_node& node, size_t start, size_t end) {
+                        node.offset = static_cast<uint32_t>(primitives.size());
+                        node.count = static_cast<uint16_t>(end - start);
+                        for(size_t i = start; i < end; ++i)
+                            primitives.push_back(list.objects[prims[i].index]);
+                    });
+            }
+            bbox = list.bounding_box();
+        }
+
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+            RT_STAT(hit_calls, 1);
+            if(nodes.empty())
+                return false;
+            return traverse_flat_bvh<false>(nodes.data(), r, ray_t, [&](const flat_bvh_node& node, interval& t) {
+                bool hit_anything = false;
+                for(uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                    if(primitives[i]->hit(r, t, rec)) {
+                        hit_anything = true;
+                        t.max = rec.t;
+                    }
+                }
+                return hit_anything;
+            });
+        }
+
+        bool occluded(const ray& r, interval ray_t) const override {
+            //the same walk as hit, done at the first primitive that reports anything
+            RT_STAT(hit_calls, 1);
+            if(nodes.empty())
+                return false;
+            return traverse_flat_bvh<true>(nodes.data(), r, ray_t, [&](const flat_bvh_node& node, interval& t) {
+                for(uint32_t i = node.offset; i < node.offset + node.count; ++i)
+                    if(primitives[i]->occluded(r, t))
+                        return true;
+                return false;
+            });
+        }
+
+        aabb bounding_box() const override {return bbox;}
+
+        size_t node_count() const {return nodes.size();}
+        size_t memory_bytes() const {return nodes.size() * sizeof(flat_bvh_node) + primitives.size() * sizeof(shared_ptr<hittable>);}
+
+    private:
+        static const int max_leaf_size = 4;
+        static constexpr double traversal_cost = 0.125; //cost of a box test relative to a primitive test
+
+        std::vector<flat_bvh_node> nodes;
+        std::vector<shared_ptr<hittable>> primitives; //reordered so every leaf's primitives are adjacent
+        aabb bbox;
+};
+
+#endif
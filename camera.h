@@ -3,12 +3,28 @@
 
 #include "rtweekend.h"
 
+#include "checkpoint.h"
 #include "color.h"
+#include "denoise.h"
+#include "framebuffer.h"
 #include "hittable.h"
+#include "image_writer.h"
+#include "lights.h"
 #include "material.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "wavefront.h"
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 using namespace std::chrono;
 
@@ -20,97 +36,753 @@ class camera {
         int samples_per_pixel = 10; //random samples for each pixel
         int max_depth = 10; //maximum number of ray bounces into scene (otherwise a ray could take a ton of bounces 
         //...(way too many) before it descends into the void)
+        double rr_threshold = 0.1; //russian roulette once a path's throughput drops below this (0 = off)
+        int rr_min_depth = 5; //bounces every path gets before russian roulette may end it
 
-        void render(const hittable& world) {
+        //view, the defaults are the original fixed camera: at the origin looking down -z with a 90 degree vertical view
+        double vfov = 90; //vertical view angle (field of view) in degrees
+        point3 lookfrom = point3(0,0,0); //point the camera is looking from
+        point3 lookat = point3(0,0,-1); //point the camera is looking at, its distance is the focal length
+        vec3 vup = vec3(0,1,0); //camera relative "up" direction
+
+        int thread_count = 0; //render threads (0 = one per hardware thread, 1 = render on the calling thread)
+        int tile_size = 16; //tiles are tile_size x tile_size pixel squares handed out to the threads
+        uint64_t seed = 0; //every pixel derives its own sampler stream from this, so output doesn't depend on thread count
+        //where a sample's pixel position, bounce directions and roulette draws come from (see sample_patterns.h),
+        //independent is plain random numbers. stratified sets have sample_count points, the frame's samples per
+        //pixel: 0 means samples_per_pixel, a render job sets it to the whole frame's since its samples_per_pixel is
+        //only its own range, so the jobs of a frame draw from the same sets a single render would
+        sample_pattern sampling = sample_pattern::independent;
+        int sample_count = 0;
+
+        //adaptive sampling: every pixel takes at least min_samples and at most samples_per_pixel samples,
+        //stopping early once the standard error of its mean drops below noise_threshold (in display units,
+        //i.e. after gamma, so 0.004 is about one 8 bit step)
+        bool adaptive_sampling = false;
+        int min_samples = 16;
+        double noise_threshold = 0.004;
+
+        //wavefront integrator: trace batches of up to wavefront_batch_size paths one bounce at a time,
+        //shading them grouped by material (see wavefront.h); fixed samples_per_pixel, no adaptive sampling
+        bool wavefront = false;
+        int wavefront_batch_size = 4096;
+
+        //progressive mode: pass_samples > 0 renders the whole image in passes of pass_samples samples per pixel
+        //until samples_per_pixel, writing output_path as a preview after each pass and saving the accumulation
+        //buffer to checkpoint_path at most every checkpoint_interval seconds (and after the last pass).
+        //resume loads checkpoint_path first and only adds the samples it is missing. every sample gets its own
+        //sampler stream, so the result doesn't depend on the pass size or on how often the render was resumed,
+        //adaptive sampling is off in this mode. a checkpoint records the settings its samples were taken with
+        //(checkpoint_settings) and resume refuses one that doesn't match, or a render that denoises or writes
+        //aovs, the checkpoint doesn't keep those buffers. scene_hash identifies the scene in those settings,
+        //whoever builds it sets it (imageoutput hashes the scene file), the camera adds its own view
+        int pass_samples = 0;
+        std::string checkpoint_path;
+        double checkpoint_interval = 60;
+        bool resume = false;
+        uint64_t scene_hash = 0;
+
+        //distributed rendering: this process renders one job of a frame split across several (see rtmerge.cpp and
+        //render_jobs.sh). a job covers tiles first_tile..last_tile (row major, -1 = up to the last tile) and samples
+        //[sample_offset, sample_offset + samples_per_pixel) of each of their pixels, every sample from its own stream
+        //like progressive passes, and saves its raw accumulation buffer to partial_path in the checkpoint format.
+        //jobs that cover every tile and sample once add up to exactly the samples of a single render.
+        //no progressive passes or adaptive sampling in a job
+        int first_tile = 0;
+        int last_tile = -1;
+        int sample_offset = 0;
+        std::string partial_path;
+
+        //denoising (see denoise.h): record the first hit's albedo, normal and distance for every sample and filter
+        //the image with them before writing it. aov_path also writes those buffers, as <aov_path>_albedo.pfm,
+        //_normal.pfm and _depth.pfm. not in a render job, the partial buffers don't carry them
+        bool denoising = false;
+        denoise_settings denoiser;
+        std::string aov_path;
+
+        //light: a path that hits an emitter (diffuse_light) picks up what it emits, and the sky gives the light
+        //of every path that escapes. light_sampling also samples lights at every diffuse hit, tracing a shadow
+        //ray that stops at the first thing in the way (next event estimation) and weighing that sample against
+        //the bounce's own by multiple importance sampling, see lights.h. the lights sampled are the emissive
+        //spheres in lights (a scene's hittable_list::lights or sphere_bvh::lights) and the sky unless it is black.
+        //sky_brightness scales the sky, lower it for a scene lit by its lamps
+        bool light_sampling = false;
+        std::vector<sphere_light> lights;
+        double sky_brightness = 1;
+
+        image_format output_format = image_format::ppm_ascii; //P3 by default for compatibility, see image_writer.h
+        std::string output_path; //empty writes to stdout
+        std::string heatmap_path; //RT_STATS builds only: P6 image of how long each tile took, brightest = slowest
+        bool defer_output = false; //render() leaves the image in result() for the caller to write, see animation.h
+
+        bool render(const hittable& world) {
+            //false if the image or a checkpoint couldn't be written, or the checkpoint to resume doesn't fit
 
             auto start = high_resolution_clock::now();
 
             initialize();
+            if(job() && (progressive() || adaptive_sampling || collect_aovs())) {
+                std::clog << "a render job can't use progressive passes, adaptive sampling or denoising\n";
+                return false;
+            }
+            if(progressive() && resume && collect_aovs()) {
+                std::clog << "a resumed render can't denoise or write aovs, the checkpoint only holds the image\n";
+                return false;
+            }
 
-            std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n"; //ppm header
+            //tiles accumulate into the framebuffer in whatever order the threads finish them,
+            //the image is only encoded and written out once every tile is done
+            image = framebuffer(image_width, image_height);
+            aovs = collect_aovs() ? aov_buffers(image_width, image_height) : aov_buffers();
+            denoised = framebuffer();
+            int first_sample = 0;
+            if(progressive() && resume && !resume_checkpoint(first_sample))
+                return false;
 
-            for(int j = 0; j < image_height; ++j) {
-                std::clog << "\rscanlines remaining: " << (image_height - j) << ' ' << std::flush; //progress indicator log
-                for(int i = 0; i < image_width; ++i) {
-                    color pixel_color(0,0,0);
-                    for(int sample = 0; sample < samples_per_pixel; ++sample) {
-                        ray r = get_ray(i, j);
-                        pixel_color += ray_color(r, max_depth, world);
+            int tiles_x = (image_width + tile_size - 1) / tile_size;
+            int tiles_y = (image_height + tile_size - 1) / tile_size;
+            int tile_count = tiles_x * tiles_y;
+            int tile_begin = std::clamp(first_tile, 0, tile_count); //the job's tiles, all of them outside distributed renders
+            int tile_end = last_tile < 0 ? tile_count : std::clamp(last_tile + 1, tile_begin, tile_count);
+            std::atomic<int> tiles_remaining(tile_end - tile_begin);
+            std::atomic<long long> samples_spent(0);
+            std::atomic<long long> rays_spent(0);
+            std::mutex log_lock;
+            std::vector<long long> tile_costs; //nanoseconds per tile over every pass, stats builds only
+            if constexpr(stats_enabled) {
+                reset_stats();
+                tile_costs.assign(tile_count, 0);
+            }
+
+            auto run_tile = [&](int tile, int pass_first, int pass_count) {
+                steady_clock::time_point tile_start;
+                if constexpr(stats_enabled)
+                    tile_start = steady_clock::now();
+                int x0 = (tile % tiles_x) * tile_size;
+                int y0 = (tile / tiles_x) * tile_size;
+                auto counts = wavefront ? render_tile_wavefront(world, x0, y0, pass_first, pass_count)
+                            : progressive() || job() ? render_tile_pass(world, x0, y0, pass_first, pass_count)
+                                            : render_tile(world, x0, y0);
+                samples_spent += counts.samples;
+                rays_spent += counts.rays;
+                if constexpr(stats_enabled) {
+                    auto cost = duration_cast<nanoseconds>(steady_clock::now() - tile_start).count();
+                    tile_costs[tile] += cost;
+                    RT_STAT(tile_ns, cost);
+                }
+                int remaining = --tiles_remaining;
+                std::lock_guard<std::mutex> guard(log_lock);
+                std::clog << "\rtiles remaining: " << remaining << ' ' << std::flush; //progress indicator log
+            };
+
+            int threads = thread_count > 0 ? thread_count : static_cast<int>(std::thread::hardware_concurrency());
+            std::unique_ptr<thread_pool> pool; //kept across passes, none when rendering on this thread
+            if(threads > 1)
+                pool = std::make_unique<thread_pool>(threads);
+            auto run_pass = [&](int pass_first, int pass_count) {
+                tiles_remaining = tile_end - tile_begin;
+                if(!pool) {
+                    for(int tile = tile_begin; tile < tile_end; ++tile)
+                        run_tile(tile, pass_first, pass_count);
+                    return;
+                }
+                for(int tile = tile_begin; tile < tile_end; ++tile)
+                    pool->submit([&run_tile, tile, pass_first, pass_count] {run_tile(tile, pass_first, pass_count);});
+                pool->wait();
+            };
+
+            bool ok = true;
+            if(!progressive()) {
+                run_pass(sample_offset, samples_per_pixel);
+            } else {
+                auto last_checkpoint = steady_clock::now();
+                for(int done = first_sample; done < samples_per_pixel;) {
+                    int count = std::min(pass_samples, samples_per_pixel - done);
+                    run_pass(done, count);
+                    done += count;
+                    std::clog << "\rpass done: " << done << '/' << samples_per_pixel << " samples per pixel\n";
+
+                    bool last = done >= samples_per_pixel;
+                    auto since_checkpoint = duration_cast<milliseconds>(steady_clock::now() - last_checkpoint).count() / 1000.0;
+                    if(!checkpoint_path.empty() && (last || since_checkpoint >= checkpoint_interval)) {
+                        if(!save_checkpoint(checkpoint_path, image, {seed, static_cast<uint32_t>(done), 0, checkpoint_settings_now()})) {
+                            std::clog << "failed to write the checkpoint to " << checkpoint_path << '\n';
+                            ok = false;
+                        }
+                        last_checkpoint = steady_clock::now();
                     }
-                    write_color(std::cout, pixel_color, samples_per_pixel);
+                    if(!last && !output_path.empty()) //no previews on stdout, they would all end up in one stream
+                        write_output();
                 }
             }
+            auto render_stop = high_resolution_clock::now();
+            if(denoising) {
+                denoised = denoise(image, aovs, denoiser, pool.get());
+                std::clog << "\rdenoised in " << duration_cast<microseconds>(high_resolution_clock::now() - render_stop).count() / 1000.0 << " ms\n";
+            }
+            pool.reset(); //joins the workers, which also folds their stats into the totals
+
+            total_samples = samples_spent;
+            total_rays = rays_spent;
+            render_seconds = duration_cast<microseconds>(render_stop - start).count() / 1000000.0;
+            if(!partial_path.empty()) {
+                checkpoint_state range{seed, static_cast<uint32_t>(sample_offset + samples_per_pixel), static_cast<uint32_t>(sample_offset),
+                                       checkpoint_settings_now()};
+                if(!save_checkpoint(partial_path, image, range)) {
+                    std::clog << "\nfailed to write the partial buffer to " << partial_path << '\n';
+                    ok = false;
+                }
+            }
+            if(!defer_output && (partial_path.empty() || !output_path.empty())) //a job only writes an image when asked for one
+                ok = write_output() && ok;
+            if(!aov_path.empty())
+                ok = write_aovs() && ok;
+
             auto stop = high_resolution_clock::now();
             auto duration = duration_cast<microseconds>(stop - start);
             auto seconds = duration.count() / 1000000.0;
             std::clog << "\rdone!                 \n";
-            std::clog << "time elapsed: " << seconds << " seconds\n";
+            auto fixed_budget = static_cast<double>(samples_per_pixel) * image_width * image_height;
+            std::clog << "samples taken: " << total_samples << " (" << total_samples / (fixed_budget / samples_per_pixel)
+                      << " per pixel, " << 100.0 * total_samples / fixed_budget << "% of samples_per_pixel)\n";
+            std::clog << "rays traced: " << total_rays << " (" << total_rays / render_seconds / 1e6 << " Mrays/s)\n";
+            std::clog << "time elapsed: " << seconds << " seconds (" << (threads > 1 ? threads : 1) << " threads, "
+                      << duration_cast<microseconds>(stop - render_stop).count() / 1000.0 << " ms writing the image)\n";
+            if constexpr(stats_enabled) {
+                print_stats(std::clog, collect_stats());
+                if(!heatmap_path.empty())
+                    write_heatmap(tile_costs, tiles_x);
+            }
+            return ok;
+        }
+
+        //rendering driven by a scheduler outside the camera (see render_service.h): start_tiles sets up the view and
+        //an empty image, render_tile_at then renders one tile (0 to tile_total()-1) and can be called from any
+        //threads in any order as long as every tile is rendered once, finish_tiles denoises and writes the output
+        //like render() does. a whole frame only, no progressive passes or render jobs, and nothing is logged
+        bool start_tiles() {
+            initialize();
+            if(job() || progressive())
+                return false;
+            image = framebuffer(image_width, image_height);
+            aovs = collect_aovs() ? aov_buffers(image_width, image_height) : aov_buffers();
+            denoised = framebuffer();
+            return true;
+        }
+
+        void render_tile_at(const hittable& world, int tile, long long& samples, long long& rays) {
+            //adds the tile's samples and rays to the counts
+            int tiles_x = (image_width + tile_size - 1) / tile_size;
+            int x0 = (tile % tiles_x) * tile_size;
+            int y0 = (tile / tiles_x) * tile_size;
+            auto counts = wavefront ? render_tile_wavefront(world, x0, y0, 0, samples_per_pixel) : render_tile(world, x0, y0);
+            samples += counts.samples;
+            rays += counts.rays;
+        }
+
+        bool finish_tiles(long long samples, long long rays, double seconds) {
+            //false if the image or the AOVs couldn't be written
+            if(denoising)
+                denoised = denoise(image, aovs, denoiser);
+            total_samples = samples;
+            total_rays = rays;
+            render_seconds = seconds;
+            bool ok = defer_output || write_output();
+            if(!aov_path.empty())
+                ok = write_aovs() && ok;
+            return ok;
+        }
+
+        int tile_total() const { //tiles in the image at the current settings, what first_tile and last_tile count
+            return ((image_width + tile_size - 1) / tile_size) * ((computed_height() + tile_size - 1) / tile_size);
+        }
+
+        const framebuffer& result() const {return denoised.size() > 0 ? denoised : image;} //the last rendered image, as written
+        const framebuffer& raw_result() const {return image;} //the last rendered image before denoising
+        const aov_buffers& aov_result() const {return aovs;} //empty unless denoising or aov_path
+        long long samples_taken() const {return total_samples;} //camera rays traced by the last render
+        long long rays_traced() const {return total_rays;} //every ray segment (camera rays and bounces) of the last render
+        double render_time() const {return render_seconds;} //seconds spent tracing in the last render, not counting output
+
+        bool write_output() const {
+            //encode the framebuffer and write it with a single write() to output_path or stdout
+            bool ok;
+            if(output_path.empty()) {
+                std::cout.flush(); //anything already queued on cout goes before the image
+                ok = write_image(STDOUT_FILENO, result(), output_format);
+            } else {
+                ok = write_image(output_path, result(), output_format);
+            }
+            if(!ok)
+                std::clog << "\nfailed to write the image to " << (output_path.empty() ? "stdout" : output_path) << '\n';
+            return ok;
+        }
+
+        bool write_aovs() const {
+            //PFM, the normals and distances don't fit an 8 bit image
+            bool ok = true;
+            for(auto [buffer, suffix] : {std::pair(&aovs.albedo, "_albedo.pfm"), std::pair(&aovs.normal, "_normal.pfm"), std::pair(&aovs.depth, "_depth.pfm")}) {
+                if(!write_image(aov_path + suffix, *buffer, image_format::pfm)) {
+                    std::clog << "failed to write " << aov_path + suffix << '\n';
+                    ok = false;
+                }
+            }
+            return ok;
+        }
+
+        bool write_heatmap(const std::vector<long long>& tile_costs, int tiles_x) const {
+            //every pixel of a tile gets that tile's cost on a black-red-yellow-white ramp, relative to the slowest tile,
+            //at the render's resolution so the two images line up
+            auto slowest = std::max<long long>(1, *std::max_element(tile_costs.begin(), tile_costs.end()));
+            framebuffer heat(image_width, image_height);
+            for(int j = 0; j < image_height; ++j) {
+                for(int i = 0; i < image_width; ++i) {
+                    auto t = static_cast<double>(tile_costs[(j / tile_size) * tiles_x + i / tile_size]) / slowest;
+                    auto r = std::clamp(3 * t, 0.0, 1.0);
+                    auto g = std::clamp(3 * t - 1, 0.0, 1.0);
+                    auto b = std::clamp(3 * t - 2, 0.0, 1.0);
+                    heat.set(heat.index(i, j), color(r*r, g*g, b*b), 1); //squared so the output gamma leaves the ramp linear
+                }
+            }
+            bool ok = write_image(heatmap_path, heat, image_format::ppm_binary);
+            if(!ok)
+                std::clog << "failed to write the heatmap to " << heatmap_path << '\n';
+            return ok;
         }
 
     private:
         //private variables
         int image_height;
+        int sample_set_size; //sample_count resolved, what begin_sample gets
+        framebuffer image;
+        aov_buffers aovs; //first hit features, when collecting them
+        framebuffer denoised; //image filtered with aovs, empty when not denoising
+        gradient_sky sky;
+        light_set light_samples; //what light_sampling samples, empty without it
+        long long total_samples = 0;
+        long long total_rays = 0;
+        double render_seconds = 0;
+
+        int computed_height() const {
+            //calculate image height
+            int height = static_cast<int>(image_width / aspect_ratio);
+            return (height < 1) ? 1 : height;
+        }
+
+        bool progressive() const {return pass_samples > 0;}
+        bool collect_aovs() const {return denoising || !aov_path.empty();}
+        bool job() const {return first_tile > 0 || last_tile >= 0 || sample_offset > 0 || !partial_path.empty();}
+
+        checkpoint_settings checkpoint_settings_now() const {
+            //what this render's samples estimate, as checkpoints and partial buffers record it
+            checkpoint_settings settings;
+            settings.sampling = static_cast<uint32_t>(sampling);
+            settings.sample_count = static_cast<uint32_t>(sample_set_size);
+            settings.max_depth = max_depth;
+            settings.rr_min_depth = rr_min_depth;
+            settings.rr_threshold = rr_threshold;
+            settings.light_sampling = light_sampling;
+            settings.sky_brightness = sky_brightness;
+            double view[] = {lookfrom.x(), lookfrom.y(), lookfrom.z(), lookat.x(), lookat.y(), lookat.z(),
+                             vup.x(), vup.y(), vup.z(), vfov};
+            settings.scene_hash = hash_bytes(reinterpret_cast<const char*>(view), sizeof(view), scene_hash);
+            return settings;
+        }
+
+        bool resume_checkpoint(int& first_sample) {
+            //load checkpoint_path into the framebuffer, a missing checkpoint just means nothing to resume yet
+            framebuffer saved;
+            checkpoint_state state;
+            if(::access(checkpoint_path.c_str(), F_OK) != 0) {
+                std::clog << "no checkpoint at " << checkpoint_path << ", starting from scratch\n";
+                return true;
+            }
+            if(!load_checkpoint(checkpoint_path, saved, state)) {
+                std::clog << "can't read the checkpoint " << checkpoint_path << '\n';
+                return false;
+            }
+            for(size_t p = 0; p < saved.size(); ++p) {
+                if(saved.samples(p) != state.samples_done) { //only the samples of some tiles or some sample range
+                    std::clog << checkpoint_path << " doesn't hold the first " << state.samples_done
+                              << " samples of every pixel, a partial buffer of a distributed render? merge those with rtmerge\n";
+                    return false;
+                }
+            }
+            if(saved.width() != image_width || saved.height() != image_height || state.seed != seed) {
+                std::clog << "checkpoint " << checkpoint_path << " is " << saved.width() << 'x' << saved.height()
+                          << " with seed " << state.seed << ", this render is " << image_width << 'x' << image_height
+                          << " with seed " << seed << '\n';
+                return false;
+            }
+            //a stratified render resumed to more samples keeps the checkpoint's sets, see checkpoint.h
+            if(sampling == sample_pattern::stratified && state.settings.sample_count != static_cast<uint32_t>(sample_set_size)) {
+                std::clog << "keeping the checkpoint's stratified sets of " << state.settings.sample_count << " samples\n";
+                sample_set_size = static_cast<int>(state.settings.sample_count);
+            }
+            auto mismatch = state.settings.mismatch(checkpoint_settings_now());
+            if(!mismatch.empty()) {
+                std::clog << "checkpoint " << checkpoint_path << " was rendered with a different " << mismatch << '\n';
+                return false;
+            }
+            image = std::move(saved);
+            first_sample = static_cast<int>(state.samples_done);
+            std::clog << "resuming at " << first_sample << " samples per pixel\n";
+            return true;
+        }
+
+        struct render_counts {
+            long long samples = 0;
+            long long rays = 0;
+        };
         point3 center; //camera center
         point3 pixel00_loc; //location of top left pixel 0,0
         vec3 pixel_delta_u; //offset to right pixel
         vec3 pixel_delta_v; //offset to pixel below
 
         void initialize() {
-            //calculate image height
-            image_height = static_cast<int>(image_width / aspect_ratio);
-            image_height = (image_height < 1) ? 1 : image_height;
+            image_height = computed_height();
+            sample_set_size = sample_count > 0 ? sample_count : samples_per_pixel;
 
-            center = point3(0,0,0);
+            center = lookfrom;
 
             //viewport aspect ratio may differ from aspect_ratio so we use calculated image aspect ratio to determine final viewport width
-            auto viewport_height = 2.0; //arbitrary value
+            auto focal_length = (lookfrom - lookat).length();
+            auto h = tan(degrees_to_radians(vfov) / 2);
+            auto viewport_height = 2 * h * focal_length;
             auto viewport_width = viewport_height * (static_cast<double>(image_width) / image_height);
-            auto focal_length = 1.0;
+
+            //orthonormal basis of the camera frame: u right, v up, w pointing backwards (away from lookat)
+            auto w = unit_vector(lookfrom - lookat);
+            auto u = unit_vector(cross(vup, w));
+            auto v = cross(w, u);
 
             //calculate viewport width and height vectors 
-            auto viewport_u = vec3(viewport_width, 0,0);
-            auto viewport_v = vec3(0, -viewport_height, 0);
+            auto viewport_u = viewport_width * u;
+            auto viewport_v = viewport_height * -v;
 
             //calculate width and height delta vectors (pixel to pixel)
             pixel_delta_u = viewport_u / image_width;
             pixel_delta_v = viewport_v / image_height;
 
             //calculate location of upper left (first) pixel
-            auto viewport_upper_left = center - vec3(0, 0, focal_length) - viewport_u/2 - viewport_v/2;
+            auto viewport_upper_left = center - focal_length * w - viewport_u/2 - viewport_v/2;
             pixel00_loc = viewport_upper_left + 0.5 * (pixel_delta_u + pixel_delta_v);
 
+            sky.brightness = sky_brightness;
+            light_samples = light_sampling ? light_set(lights, sky, lookat) : light_set(); //lights picked by what they give around lookat
+        }
+
+        render_counts render_tile(const hittable& world, int x0, int y0) {
+            //render every pixel of the tile starting at x0,y0, clipped to the image edges
+            //returns how many samples and rays the tile took
+            render_counts counts;
+            int x1 = std::min(x0 + tile_size, image_width);
+            int y1 = std::min(y0 + tile_size, image_height);
+            for(int j = y0; j < y1; ++j) {
+                for(int i = x0; i < x1; ++i) {
+                    auto pixel_index = static_cast<size_t>(j) * image_width + i;
+                    sampler pixel_sampler(seed, pixel_index, 0);
+
+                    color pixel_color(0,0,0);
+                    aov_sample features;
+                    auto* first_hit = aovs.empty() ? nullptr : &features;
+                    int sample = 0;
+                    double mean = 0, m2 = 0; //running luminance mean and sum of squared deviations (welford)
+                    while(sample < samples_per_pixel) {
+                        pixel_sampler.begin_sample(sampling, seed, i, j, sample, sample_set_size);
+                        ray r = get_ray(i, j, pixel_sampler);
+                        auto sample_color = ray_color(r, max_depth, world, pixel_sampler, counts.rays, first_hit);
+                        pixel_color += sample_color;
+                        if(first_hit)
+                            features.add_radiance(sample_color);
+                        ++sample;
+
+                        if(adaptive_sampling) {
+                            auto y = luminance(sample_color);
+                            auto delta = y - mean;
+                            mean += delta / sample;
+                            m2 += delta * (y - mean);
+                            if(sample >= min_samples && converged(mean, m2, sample))
+                                break;
+                        }
+                    }
+                    image.set(pixel_index, pixel_color, sample);
+                    if(first_hit)
+                        aovs.set(pixel_index, features, sample);
+                    counts.samples += sample;
+                }
+            }
+            return counts;
+        }
+
+        render_counts render_tile_pass(const hittable& world, int x0, int y0, int first_sample, int sample_count) {
+            //one progressive pass over the tile: samples [first_sample, first_sample+sample_count) of every pixel,
+            //each from its own stream so passes can be split or resumed anywhere
+            render_counts counts;
+            int x1 = std::min(x0 + tile_size, image_width);
+            int y1 = std::min(y0 + tile_size, image_height);
+            for(int j = y0; j < y1; ++j) {
+                for(int i = x0; i < x1; ++i) {
+                    auto pixel_index = image.index(i, j);
+                    color pixel_color(0,0,0);
+                    aov_sample features;
+                    auto* first_hit = aovs.empty() ? nullptr : &features;
+                    for(int sample = first_sample; sample < first_sample + sample_count; ++sample) {
+                        sampler sample_sampler(seed, pixel_index, sample + 1); //stream 0 is render_tile's
+                        sample_sampler.begin_sample(sampling, seed, i, j, sample, sample_set_size);
+                        ray r = get_ray(i, j, sample_sampler);
+                        auto sample_color = ray_color(r, max_depth, world, sample_sampler, counts.rays, first_hit);
+                        pixel_color += sample_color;
+                        if(first_hit)
+                            features.add_radiance(sample_color);
+                    }
+                    image.add(pixel_index, pixel_color, sample_count);
+                    if(first_hit)
+                        aovs.add(pixel_index, features, sample_count);
+                    counts.samples += sample_count;
+                }
+            }
+            return counts;
+        }
+
+        render_counts render_tile_wavefront(const hittable& world, int x0, int y0, int first_sample, int sample_count) {
+            //same tile as render_tile, traced breadth first in batches (see wavefront.h)
+            //samples [first_sample, first_sample+sample_count) of every pixel, all of them outside progressive mode
+            render_counts counts;
+            int x1 = std::min(x0 + tile_size, image_width);
+            int y1 = std::min(y0 + tile_size, image_height);
+            int tile_width = x1 - x0;
+            size_t tile_pixels = static_cast<size_t>(tile_width) * (y1 - y0);
+            size_t total_paths = tile_pixels * sample_count;
+            std::vector<color> sums(tile_pixels, color(0,0,0));
+            std::vector<aov_sample> features(aovs.empty() ? 0 : tile_pixels);
+
+            wavefront_batch batch;
+            size_t batch_size = wavefront_batch_size > 0 ? wavefront_batch_size : 1;
+            auto keep_going = [this](wavefront_path& path) {return survives_roulette(path.throughput, path.s);};
+            auto finish = [&](const wavefront_path& path) { //a path ended, what it gathered is the sample's color
+                sums[path.pixel] += path.radiance;
+                if(!features.empty())
+                    features[path.pixel].add_radiance(path.radiance);
+            };
+            bool sample_lights = !light_samples.empty();
+
+            for(size_t first = 0; first < total_paths; first += batch_size) {
+                //camera rays for paths [first, first+batch_size), path id = local pixel * sample_count + sample
+                batch.paths.clear();
+                for(size_t id = first; id < std::min(first + batch_size, total_paths); ++id) {
+                    auto local = static_cast<uint32_t>(id / sample_count);
+                    auto sample = first_sample + id % sample_count;
+                    int i = x0 + static_cast<int>(local % tile_width);
+                    int j = y0 + static_cast<int>(local / tile_width);
+                    wavefront_path path;
+                    path.s = sampler(seed, image.index(i, j), sample + 1); //stream 0 is the depth first integrator's
+                    path.s.begin_sample(sampling, seed, i, j, static_cast<uint32_t>(sample), sample_set_size);
+                    path.r = get_ray(i, j, path.s);
+                    path.throughput = color(1,1,1);
+                    path.radiance = color(0,0,0);
+                    path.scatter_pdf = 0;
+                    path.pixel = local;
+                    batch.paths.push_back(path);
+                }
+                counts.samples += batch.paths.size();
+
+                for(int bounce = 0; bounce < max_depth && !batch.paths.empty(); ++bounce) {
+                    //intersect the whole batch, escaped paths pick up the sky
+                    batch.hits.resize(batch.paths.size());
+                    for(auto& bin : batch.bins)
+                        bin.clear();
+                    for(size_t k = 0; k < batch.paths.size(); ++k) {
+                        auto& path = batch.paths[k];
+                        if(world.hit(path.r, interval(0.001, infinity), batch.hits[k])) {
+                            const auto& rec = batch.hits[k];
+                            batch.bins[static_cast<int>(rec.mat->kind())].push_back(static_cast<uint32_t>(k));
+                            if(bounce == 0 && !features.empty())
+                                features[path.pixel].add(rec.mat->surface_albedo(), rec.normal, rec.t * path.r.direction().length());
+                        } else {
+                            RT_STAT(sky_escapes, 1);
+                            path.radiance += sky_light(path.r, path.throughput, path.scatter_pdf, path.scatter_normal);
+                            finish(path);
+                            if(bounce == 0 && !features.empty())
+                                features[path.pixel].add(sky_color(path.r), vec3(0,0,0), 0);
+                        }
+                    }
+                    counts.rays += batch.paths.size();
+
+                    //paths on a light end there, with light sampling the diffuse hits sample one
+                    for(auto k : batch.bins[static_cast<int>(material_kind::diffuse_light)]) {
+                        RT_STAT(light_hits, 1);
+                        auto& path = batch.paths[k];
+                        path.radiance += emitted_light(path.r, batch.hits[k], path.throughput, path.scatter_pdf);
+                        finish(path);
+                    }
+                    if(sample_lights) {
+                        for(auto k : batch.bins[static_cast<int>(material_kind::lambertian)]) {
+                            auto& path = batch.paths[k];
+                            path.radiance += path.throughput * sample_light(batch.hits[k], world, path.s, counts.rays);
+                        }
+                    }
+
+                    //shade each material's bin in its own loop, roulette only applies from rr_min_depth on
+                    batch.next.clear();
+                    auto shade_depth = bounce + 1 >= rr_min_depth;
+                    auto survive = [&](wavefront_path& path) {
+                        if(!shade_depth || keep_going(path))
+                            return true;
+                        RT_STAT(roulette_terminations, 1);
+                        return false;
+                    };
+                    shade_bin<material_kind::lambertian>(batch, survive, finish, sample_lights);
+                    shade_bin<material_kind::metal>(batch, survive, finish, sample_lights);
+                    shade_bin<material_kind::dielectric>(batch, survive, finish, sample_lights);
+                    std::swap(batch.paths, batch.next);
+                }
+                RT_STAT(depth_cap_terminations, batch.paths.size());
+                for(const auto& path : batch.paths)
+                    finish(path);
+            }
+
+            for(size_t local = 0; local < tile_pixels; ++local) {
+                int i = x0 + static_cast<int>(local % tile_width);
+                int j = y0 + static_cast<int>(local / tile_width);
+                image.add(image.index(i, j), sums[local], sample_count);
+                if(!features.empty())
+                    aovs.add(image.index(i, j), features[local], sample_count);
+            }
+            return counts;
+        }
+
+        bool survives_roulette(color& throughput, sampler& s) const {
+            //russian roulette: once the path can only add a little light, continue it with probability p
+            //and boost the survivors by 1/p, which keeps the expected value (no bias) but stops
+            //spending bounces on paths that barely contribute
+            auto p = fmax(throughput.x(), fmax(throughput.y(), throughput.z()));
+            if(p >= rr_threshold)
+                return true;
+            if(s.sample_1d() >= p)
+                return false;
+            throughput /= p;
+            return true;
+        }
+
+        bool converged(double mean, double m2, int n) const {
+            //standard error of the mean luminance, carried through the sqrt gamma curve (d sqrt(x) = dx / 2 sqrt(x))
+            //so dark pixels, where the eye and the 8 bit output are more sensitive, need a tighter estimate
+            auto variance = m2 / (n - 1);
+            auto standard_error = sqrt(variance / n);
+            return standard_error / (2 * sqrt(fmax(mean, 1e-4))) < noise_threshold;
         }
 
-        color ray_color(const ray& r, int depth, const hittable& world) const {
-            hit_record rec;
+        color ray_color(const ray& r, int depth, const hittable& world, sampler& s, long long& rays, aov_sample* first_hit = nullptr) const {
+            //iterative path tracer: instead of recursing once per bounce, carry the product of every
+            //attenuation so far (the path throughput) and multiply it into whatever light the path reaches
+            //first_hit, when given, also gets what the camera ray hit added to it (see denoise.h)
+            //radiance gathers the light met on the way: emitters hit, the lights sampled at diffuse hits, the sky
+            color throughput(1,1,1);
+            color radiance(0,0,0);
+            ray current = r;
+            double scatter_pdf = 0; //density the last bounce picked current with when light sampling, 0 otherwise
+            vec3 scatter_normal; //and the normal it left from, the sky's density depends on it
+            bool sample_lights = !light_samples.empty();
 
             //if ray bounces exceeded, no more light gathered
-            if(depth <= 0)
-                return color(0,0,0);
-            //next we use 0.001 to ignore hits that are very close to the intersection point as a result of floating point rounding errors
-            //because these result in points on the surface that get darkened too many times ("shadow acne")
-            if(world.hit(r, interval(0.001, infinity), rec)) { //then render the hittable
+            for(int bounce = 0; bounce < depth; ++bounce) {
+                hit_record rec;
+                ++rays;
+                //next we use 0.001 to ignore hits that are very close to the intersection point as a result of floating point rounding errors
+                //because these result in points on the surface that get darkened too many times ("shadow acne")
+                bool hit_something;
+                {
+                    RT_TIMED_SCOPE(intersect_ns);
+                    hit_something = world.hit(current, interval(0.001, infinity), rec);
+                }
+                if(bounce == 0 && first_hit) {
+                    if(hit_something)
+                        first_hit->add(rec.mat->surface_albedo(), rec.normal, rec.t * current.direction().length());
+                    else
+                        first_hit->add(sky_color(current), vec3(0,0,0), 0);
+                }
+                if(!hit_something) {
+                    RT_STAT(sky_escapes, 1);
+                    return radiance + sky_light(current, throughput, scatter_pdf, scatter_normal);
+                }
+                if(rec.mat->emits()) {
+                    RT_STAT(light_hits, 1);
+                    return radiance + emitted_light(current, rec, throughput, scatter_pdf);
+                }
+                if(sample_lights && rec.mat->samples_lights())
+                    radiance += throughput * sample_light(rec, world, s, rays);
+
                 //each normal is the vector from the center to the surface point, where the ray origin is moved to the surface and normalized
                 //or the opposite when it gets flipped inside out
-
                 ray scattered;
                 color attenuation;
-                if(rec.mat->scatter(r, rec, attenuation, scattered))
-                    return attenuation * ray_color(scattered, depth-1, world);
-                return color(0,0,0);
+                bool scatters;
+                {
+                    RT_TIMED_SCOPE(scatter_ns);
+                    scatters = rec.mat->scatter(current, rec, attenuation, scattered, s);
+                }
+                if(!scatters) {
+                    RT_STAT(absorbed, 1);
+                    return radiance;
+                }
+                throughput = throughput * attenuation;
+                scatter_pdf = sample_lights && rec.mat->samples_lights() ? rec.mat->scatter_pdf(rec, scattered.direction()) : 0;
+                scatter_normal = rec.normal;
+                current = scattered;
+
+                if(bounce + 1 >= rr_min_depth && !survives_roulette(throughput, s)) {
+                    RT_STAT(roulette_terminations, 1);
+                    return radiance;
+                }
             }
-            //if it didn't hit, make a sky gradient
-            vec3 unit_direction = unit_vector(r.direction());
-            auto a = 0.5 * (unit_direction.y() + 1.0);
-            //linear interpolation = (1 - a) * startValue + a * endValue   where 0.0<=a<=1.0
-                                //white                 //blue
-            return (1.0 - a) * color(1.0,1.0,1.0) + a * color(0.5,0.7,1.0);
+            RT_STAT(depth_cap_terminations, 1);
+            return radiance;
+        }
+
+        color sample_light(const hit_record& rec, const hittable& world, sampler& s, long long& rays) const {
+            //next event estimation at a diffuse hit: one light sample's light reflected back along the path, its
+            //multiple importance weight included. black when the sample is blocked or below the surface
+            light_sample light;
+            if(!light_samples.sample(rec.p, rec.normal, s, light))
+                return color(0,0,0);
+            double bsdf_pdf;
+            auto reflectance = rec.mat->reflected(rec, light.direction, bsdf_pdf);
+            if(bsdf_pdf <= 0)
+                return color(0,0,0);
+            ++rays;
+            RT_STAT(shadow_rays, 1);
+            //stops short of the light so its own surface doesn't block it
+            if(world.occluded(ray(rec.p, light.direction), interval(0.001, light.distance * (1 - 1e-4))))
+                return color(0,0,0);
+            return reflectance * light.radiance * (power_heuristic(light.pdf, bsdf_pdf) / light.pdf);
+        }
+
+        color emitted_light(const ray& r, const hit_record& rec, const color& throughput, double scatter_pdf) const {
+            //what a path reaching an emitter gets, weighed against light sampling when the last bounce sampled lights
+            auto emitted = throughput * rec.mat->emitted(rec);
+            if(scatter_pdf > 0)
+                emitted = emitted * power_heuristic(scatter_pdf, light_samples.pdf_sphere(r.origin(), rec.p));
+            return emitted;
+        }
+
+        color sky_light(const ray& r, const color& throughput, double scatter_pdf, const vec3& scatter_normal) const {
+            //same for a path leaving the scene, scatter_normal is the normal at r's origin
+            auto background = throughput * sky_color(r);
+            if(scatter_pdf > 0)
+                background = background * power_heuristic(scatter_pdf, light_samples.pdf_sky(r.direction(), scatter_normal));
+            return background;
+        }
+
+        color sky_color(const ray& r) const {
+            //if it didn't hit, make a sky gradient (see lights.h)
+            return sky.radiance(r.direction());
         }
 
-        ray get_ray(int i, int j) const {
+        ray get_ray(int i, int j, sampler& s) const {
             //get a randomly sampled camera ray for pixel at i,j
             auto pixel_center = pixel00_loc + (i * pixel_delta_u) + (j * pixel_delta_v);
-            auto pixel_sample = pixel_center + pixel_sample_square();
+            auto pixel_sample = pixel_center + pixel_sample_square(s);
 
             auto ray_origin = center;
             auto ray_direction = pixel_sample - ray_origin;
@@ -118,10 +790,12 @@ class camera {
             return ray(ray_origin, ray_direction);
         }
 
-        vec3 pixel_sample_square() const {
+        vec3 pixel_sample_square(sampler& s) const {
             //return a random point in the square surrounding a pixel at the origin
-            auto px = -0.5 + random_double();
-            auto py = -0.5 + random_double();
+            double px, py;
+            s.sample_2d(px, py);
+            px -= 0.5;
+            py -= 0.5;
             return (px * pixel_delta_u) + (py * pixel_delta_v);
         }
 };
@@ -0,0 +1,189 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "rtweekend.h"
+
+#include "framebuffer.h"
+#include "image_writer.h"
+#include "sampler.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/* accumulation checkpoints
+
+a progressive render periodically saves its framebuffer (the raw linear sample sums and per pixel sample
+counts, not the encoded image) so a later run can load it and keep adding samples
+
+layout, host byte order (little endian on everything we run on):
+    checkpoint_header, the settings that decide what a sample estimates included
+    width*height sums, 3 doubles each, row major from the top left like framebuffer
+    width*height sample counts, uint32 each
+
+the sampler state is not stored per pixel: progressive passes give every sample its own stream,
+sampler(seed, pixel, sample + 1), so seed and samples_done are all it takes to carry on exactly where
+the last run stopped. a resume to the samples_per_pixel the render started with matches a render that was
+never interrupted bit for bit. one that raises it does too, except with stratified sampling: the samples
+past the checkpoint's continue in further sets of the checkpoint's size (stratified among themselves), where
+a single run would have drawn one set of the new size
+
+the header also records the settings that change what a sample estimates (checkpoint_settings), a resume
+or a merge refuses buffers whose settings differ from its own, they would average two different estimators
+
+the partial buffers of a distributed render (camera::partial_path) use the same layout: they hold samples
+[first_sample, samples_done) of the pixels in the job's tiles, the other pixels have a count of 0, and
+rtmerge adds them up
+
+*/
+
+struct checkpoint_settings { //what the samples in a buffer estimate, besides the seed and the image size
+    uint32_t sampling = 0; //sample_pattern
+    uint32_t sample_count = 0; //the stratified set size, camera::sample_count resolved
+    int32_t max_depth = 0;
+    int32_t rr_min_depth = 0;
+    double rr_threshold = 0;
+    uint32_t light_sampling = 0;
+    uint32_t pad = 0;
+    double sky_brightness = 0;
+    uint64_t scene_hash = 0; //the scene and the camera view, see camera::scene_hash
+
+    std::string mismatch(const checkpoint_settings& other) const {
+        //the first setting that differs from other, empty when none does
+        if(sampling != other.sampling) return "sample pattern";
+        if(sampling == static_cast<uint32_t>(sample_pattern::stratified) && sample_count != other.sample_count) return "stratified set size";
+        if(max_depth != other.max_depth) return "max_depth";
+        if(rr_min_depth != other.rr_min_depth || rr_threshold != other.rr_threshold) return "russian roulette";
+        if(light_sampling != other.light_sampling) return "light sampling";
+        if(sky_brightness != other.sky_brightness) return "sky brightness";
+        if(scene_hash != other.scene_hash) return "scene or camera view";
+        return "";
+    }
+};
+
+struct checkpoint_header {
+    char magic[8]; //"RTACCUM2", 1 had no settings
+    uint32_t width;
+    uint32_t height;
+    uint64_t seed;
+    uint32_t samples_done; //samples per pixel already in the sums, or the end of a partial buffer's sample range
+    uint32_t first_sample; //0 except in partial buffers
+    checkpoint_settings settings;
+};
+
+struct checkpoint_state {
+    uint64_t seed = 0;
+    uint32_t samples_done = 0;
+    uint32_t first_sample = 0;
+    checkpoint_settings settings;
+};
+
+inline constexpr char checkpoint_magic[8] = {'R', 'T', 'A', 'C', 'C', 'U', 'M', '2'};
+
+inline uint64_t hash_bytes(const char* data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+    //64 bit FNV-1a, continues from hash so several pieces can go into one
+    for(size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline bool hash_file(const std::string& path, uint64_t& hash) {
+    //the contents of the file at path, what identifies a scene file in checkpoints
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    hash = hash_bytes(nullptr, 0);
+    std::vector<char> chunk(1 << 16);
+    while(true) {
+        auto got = ::read(fd, chunk.data(), chunk.size());
+        if(got < 0 && errno == EINTR)
+            continue;
+        if(got <= 0) {
+            ::close(fd);
+            return got == 0;
+        }
+        hash = hash_bytes(chunk.data(), static_cast<size_t>(got), hash);
+    }
+}
+
+inline bool save_checkpoint(const std::string& path, const framebuffer& fb, const checkpoint_state& state) {
+    //written to path.tmp then renamed over path, so a render killed mid-save keeps the previous checkpoint
+    checkpoint_header header = {};
+    std::memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+    header.width = static_cast<uint32_t>(fb.width());
+    header.height = static_cast<uint32_t>(fb.height());
+    header.seed = state.seed;
+    header.samples_done = state.samples_done;
+    header.first_sample = state.first_sample;
+    header.settings = state.settings;
+
+    auto pixels = fb.size();
+    std::string buffer(sizeof(header) + pixels * (3 * sizeof(double) + sizeof(uint32_t)), '\0');
+    auto* out = &buffer[0];
+    std::memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    for(size_t p = 0; p < pixels; ++p) {
+        const auto& c = fb.sum(p);
+        double rgb[3] = {c.x(), c.y(), c.z()};
+        std::memcpy(out, rgb, sizeof(rgb));
+        out += sizeof(rgb);
+    }
+    for(size_t p = 0; p < pixels; ++p) {
+        auto count = fb.samples(p);
+        std::memcpy(out, &count, sizeof(count));
+        out += sizeof(count);
+    }
+
+    auto temp_path = path + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return false;
+    bool ok = write_all(fd, buffer.data(), buffer.size()) && ::fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    if(ok)
+        ok = std::rename(temp_path.c_str(), path.c_str()) == 0;
+    if(!ok)
+        std::remove(temp_path.c_str());
+    return ok;
+}
+
+inline bool load_checkpoint(const std::string& path, framebuffer& fb, checkpoint_state& state) {
+    //replaces fb with the checkpoint's buffer, false if the file is missing, truncated or not a checkpoint
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    checkpoint_header header;
+    bool ok = read_all(fd, reinterpret_cast<char*>(&header), sizeof(header))
+           && std::memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) == 0;
+    std::vector<double> sums;
+    std::vector<uint32_t> counts;
+    if(ok) {
+        auto pixels = static_cast<size_t>(header.width) * header.height;
+        sums.resize(pixels * 3);
+        counts.resize(pixels);
+        ok = read_all(fd, reinterpret_cast<char*>(sums.data()), sums.size() * sizeof(double))
+          && read_all(fd, reinterpret_cast<char*>(counts.data()), counts.size() * sizeof(uint32_t));
+    }
+    ::close(fd);
+    if(!ok)
+        return false;
+
+    fb = framebuffer(static_cast<int>(header.width), static_cast<int>(header.height));
+    for(size_t p = 0; p < counts.size(); ++p)
+        fb.set(p, framebuffer::sum_type(sums[3*p], sums[3*p + 1], sums[3*p + 2]), counts[p]);
+    state.seed = header.seed;
+    state.samples_done = header.samples_done;
+    state.first_sample = header.first_sample;
+    state.settings = header.settings;
+    return true;
+}
+
+#endif
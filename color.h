@@ -2,7 +2,6 @@
 #define COLOR_H
 
 #include "vec3.h"
-#include <iostream>
 
 using color = vec3; //alias for clarity
 
@@ -10,27 +9,15 @@ inline double linear_to_gamma(double linear_component) {
     return sqrt(linear_component);
 }
 
-void write_color(std::ostream &out, color pixel_color, int samples_per_pixel) {
-    auto r = pixel_color.x();
-    auto g = pixel_color.y();
-    auto b = pixel_color.z();
-
-    //divide color by number of samples (for antialiasing)
-    auto scale = 1.0 / samples_per_pixel;
-    r *= scale;
-    g *= scale;
-    b *= scale;
-
-    //gamma correction: apply linear to gamma transform (images in gamma space can be viewed more accurately)
-    r = linear_to_gamma(r);
-    g = linear_to_gamma(g);
-    b = linear_to_gamma(b);
+inline double luminance(const color& c) {
+    //rec. 709 weights, how bright a linear color looks
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
 
-    //write each pixel
+inline int color_to_byte(double linear_component) {
+    //gamma correct and quantize one averaged channel to 0-255
     static const interval intensity(0.000, 0.999);
-    out << static_cast<int>(256 * intensity.clamp(r)) << ' ' 
-        << static_cast<int>(256 * intensity.clamp(g)) << ' '
-        << static_cast<int>(256 * intensity.clamp(b)) << '\n';
+    return static_cast<int>(256 * intensity.clamp(linear_to_gamma(linear_component)));
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,454 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include "rtweekend.h"
+
+#include "aligned_allocator.h"
+#include "color.h"
+#include "framebuffer.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/* denoising
+
+the camera can record what every sample's camera ray hit first (aov_buffers: albedo, normal and distance,
+averaged per pixel like the color, plus the second moment of the sample luminance) and filter the image
+with them after rendering. the filter is the edge avoiding a-trous wavelet (Dammertz et al. 2010): a 5x5
+B3 spline kernel applied iterations times with its taps spread 1, 2, 4, 8... pixels apart, so five passes
+reach 64 pixels wide at 25 taps per pixel each. a tap's weight drops with the difference in normal,
+distance and albedo to the center pixel, so the filter averages within a surface but not across edges
+
+the color difference is measured against the pixel's own noise, as in SVGF (Schied et al. 2017): every
+pixel starts with the variance of its mean from the sample moments, and each pass filters the variance
+along with the color (with the squared weights), so the color weights tighten as the noise goes away.
+a noisy pixel gets averaged with its surface, a clean edge in the lighting (a shadow border) stays
+
+the filter runs on the illumination: the color divided by the albedo, multiplied back in at the end, so
+material edges stay sharp however hard the lighting gets smoothed. the sky has its own color as albedo,
+a normal and distance of 0
+
+it trades noise for some blur: on the sphere grid 8 samples denoised come out about as close to a
+reference as 32 plain ones, but from about 200 samples on the plain image is closer (bench/denoise_bench)
+
+the planes are float, the rows run on the camera's threads and the interior of each row (where no tap
+leaves the image) on AVX2 or AVX-512 when the cpu has it, same result as the scalar loop bit for bit
+
+*/
+
+struct aov_sample { //first hit features of a pixel's samples, summed like their color
+    color albedo = color(0,0,0);
+    vec3 normal = vec3(0,0,0);
+    double depth = 0; //distance from the camera
+    double luminance2 = 0; //squared luminance of each sample's color
+
+    void add(const color& a, const vec3& n, double d) {
+        albedo += a;
+        normal += n;
+        depth += d;
+    }
+
+    void add_radiance(const color& c) {
+        auto y = luminance(c);
+        luminance2 += y * y;
+    }
+};
+
+class aov_buffers { //per pixel albedo, normal and distance of the first hit, averaged over the pixel's samples
+    //framebuffers so they average, merge and write out like the image, the distance goes in all three channels
+    public:
+        framebuffer albedo;
+        framebuffer normal;
+        framebuffer depth;
+        framebuffer moments; //mean squared sample luminance in x, the denoiser's noise estimate
+
+        aov_buffers() {}
+        aov_buffers(int w, int h) : albedo(w, h), normal(w, h), depth(w, h), moments(w, h) {}
+
+        bool empty() const {return albedo.size() == 0;}
+
+        void set(size_t pixel, const aov_sample& sum, uint32_t sample_count) {
+            albedo.set(pixel, sum.albedo, sample_count);
+            normal.set(pixel, sum.normal, sample_count);
+            depth.set(pixel, vec3(sum.depth, sum.depth, sum.depth), sample_count);
+            moments.set(pixel, vec3(sum.luminance2, 0, 0), sample_count);
+        }
+
+        void add(size_t pixel, const aov_sample& sum, uint32_t sample_count) {
+            albedo.add(pixel, sum.albedo, sample_count);
+            normal.add(pixel, sum.normal, sample_count);
+            depth.add(pixel, vec3(sum.depth, sum.depth, sum.depth), sample_count);
+            moments.add(pixel, vec3(sum.luminance2, 0, 0), sample_count);
+        }
+};
+
+struct denoise_settings {
+    int iterations = 5; //filter passes, the taps of pass i are 2^i pixels apart
+    double sigma_color = 16; //illumination difference, in standard deviations of the center pixel's noise
+    double sigma_normal = 0.3;
+    double sigma_depth = 0.05; //relative to the center pixel's distance, per pixel of tap spacing
+    double sigma_albedo = 0.1;
+};
+
+struct atrous_planes { //one pass's input, a float plane per channel
+    const float* r;
+    const float* g;
+    const float* b;
+    const float* variance; //of the illumination luminance
+    const float* albedo_r;
+    const float* albedo_g;
+    const float* albedo_b;
+    const float* nx;
+    const float* ny;
+    const float* nz;
+    const float* depth;
+    int width;
+    int height;
+};
+
+struct atrous_output {
+    float* r;
+    float* g;
+    float* b;
+    float* variance;
+};
+
+struct atrous_weights { //1 / sigma^2 of the current pass
+    float color;
+    float normal;
+    float depth;
+    float albedo;
+};
+
+//B3 spline taps, the 2D kernel is their outer product
+inline constexpr float atrous_taps[5] = {1.0f/16, 1.0f/4, 3.0f/8, 1.0f/4, 1.0f/16};
+
+//keeps the color weight finite where a pixel has no noise at all (the sky, a single sample)
+inline constexpr float atrous_variance_floor = 1e-6f;
+
+//exp(-x) for x >= 0 to about 1e-6 relative: 2^(-x log2 e) split into a power of two and a polynomial for 2^f, f in [0,1)
+//the vector kernels evaluate the same operations in the same order, so every level filters identically
+inline constexpr float exp_log2e = 1.44269504f;
+inline constexpr float exp2_poly[6] = {1.0f, 0.693147182f, 0.240226507f, 0.0555041087f, 0.00961812911f, 0.00133335581f};
+
+inline float fast_exp_neg(float x) {
+    auto t = -std::min(x, 80.0f) * exp_log2e;
+    auto whole = std::floor(t);
+    auto f = t - whole;
+    auto p = exp2_poly[0] + f * (exp2_poly[1] + f * (exp2_poly[2] + f * (exp2_poly[3] + f * (exp2_poly[4] + f * exp2_poly[5]))));
+    auto bits = static_cast<uint32_t>(static_cast<int32_t>(whole) + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+inline void atrous_pixel(const atrous_planes& in, const atrous_output& out, int x, int y, int step, const atrous_weights& w) {
+    //one filtered pixel, taps past the image edge are clamped onto it
+    auto p = static_cast<size_t>(y) * in.width + x;
+    float r = in.r[p], g = in.g[p], b = in.b[p];
+    float ar = in.albedo_r[p], ag = in.albedo_g[p], ab = in.albedo_b[p];
+    float nx = in.nx[p], ny = in.ny[p], nz = in.nz[p];
+    float d = in.depth[p];
+    float color_weight = w.color / (in.variance[p] + atrous_variance_floor);
+    float depth_weight = w.depth / std::max(d * d, 1e-4f);
+    float sum_r = 0, sum_g = 0, sum_b = 0, sum_v = 0, sum_w = 0;
+    for(int ty = 0; ty < 5; ++ty) {
+        int qy = std::clamp(y + (ty - 2) * step, 0, in.height - 1);
+        for(int tx = 0; tx < 5; ++tx) {
+            int qx = std::clamp(x + (tx - 2) * step, 0, in.width - 1);
+            auto q = static_cast<size_t>(qy) * in.width + qx;
+            float dr = in.r[q] - r, dg = in.g[q] - g, db = in.b[q] - b;
+            float dnx = in.nx[q] - nx, dny = in.ny[q] - ny, dnz = in.nz[q] - nz;
+            float dd = in.depth[q] - d;
+            float dar = in.albedo_r[q] - ar, dag = in.albedo_g[q] - ag, dab = in.albedo_b[q] - ab;
+            float e = color_weight * (dr * dr + dg * dg + db * db) + w.normal * (dnx * dnx + dny * dny + dnz * dnz)
+                    + depth_weight * (dd * dd) + w.albedo * (dar * dar + dag * dag + dab * dab);
+            float weight = (atrous_taps[ty] * atrous_taps[tx]) * fast_exp_neg(e);
+            sum_r += weight * in.r[q];
+            sum_g += weight * in.g[q];
+            sum_b += weight * in.b[q];
+            sum_v += (weight * weight) * in.variance[q];
+            sum_w += weight;
+        }
+    }
+    out.r[p] = sum_r / sum_w; //the center tap has weight 9/64, never 0
+    out.g[p] = sum_g / sum_w;
+    out.b[p] = sum_b / sum_w;
+    out.variance[p] = sum_v / (sum_w * sum_w);
+}
+
+//a row kernel filters row y of one pass
+using atrous_row_kernel = void (*)(const atrous_planes&, const atrous_output&, int y, int step, const atrous_weights&);
+
+inline void atrous_row_scalar(const atrous_planes& in, const atrous_output& out, int y, int step, const atrous_weights& w) {
+    for(int x = 0; x < in.width; ++x)
+        atrous_pixel(in, out, x, y, step, w);
+}
+
+#ifdef RT_SIMD_X86
+
+//the vector kernels take 8 (AVX2) or 16 (AVX-512) pixels of the row at once where all their taps are inside the image,
+//the pixels near the left and right edge and the leftover ones go through atrous_pixel
+
+__attribute__((target("avx2")))
+inline __m256 fast_exp_neg_avx2(__m256 x) {
+    __m256 t = _mm256_mul_ps(_mm256_sub_ps(_mm256_setzero_ps(), _mm256_min_ps(x, _mm256_set1_ps(80.0f))), _mm256_set1_ps(exp_log2e));
+    __m256 whole = _mm256_floor_ps(t);
+    __m256 f = _mm256_sub_ps(t, whole);
+    __m256 p = _mm256_set1_ps(exp2_poly[5]);
+    for(int k = 4; k >= 0; --k)
+        p = _mm256_add_ps(_mm256_set1_ps(exp2_poly[k]), _mm256_mul_ps(f, p));
+    __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(whole), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(bits));
+}
+
+__attribute__((target("avx2")))
+inline __m256 sum_of_squares_avx2(__m256 x, __m256 y, __m256 z) {
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+}
+
+__attribute__((target("avx2")))
+inline void atrous_row_avx2(const atrous_planes& in, const atrous_output& out, int y, int step, const atrous_weights& w) {
+    int x_begin = std::min(2 * step, in.width);
+    int x_end = std::max(x_begin, in.width - 2 * step);
+    for(int x = 0; x < x_begin; ++x)
+        atrous_pixel(in, out, x, y, step, w);
+    auto row = static_cast<size_t>(y) * in.width;
+    int x = x_begin;
+    for(; x + 8 <= x_end; x += 8) {
+        auto p = row + x;
+        __m256 r = _mm256_loadu_ps(in.r + p), g = _mm256_loadu_ps(in.g + p), b = _mm256_loadu_ps(in.b + p);
+        __m256 ar = _mm256_loadu_ps(in.albedo_r + p), ag = _mm256_loadu_ps(in.albedo_g + p), ab = _mm256_loadu_ps(in.albedo_b + p);
+        __m256 nx = _mm256_loadu_ps(in.nx + p), ny = _mm256_loadu_ps(in.ny + p), nz = _mm256_loadu_ps(in.nz + p);
+        __m256 d = _mm256_loadu_ps(in.depth + p);
+        __m256 color_weight = _mm256_div_ps(_mm256_set1_ps(w.color), _mm256_add_ps(_mm256_loadu_ps(in.variance + p), _mm256_set1_ps(atrous_variance_floor)));
+        __m256 depth_weight = _mm256_div_ps(_mm256_set1_ps(w.depth), _mm256_max_ps(_mm256_mul_ps(d, d), _mm256_set1_ps(1e-4f)));
+        __m256 sum_r = _mm256_setzero_ps(), sum_g = _mm256_setzero_ps(), sum_b = _mm256_setzero_ps();
+        __m256 sum_v = _mm256_setzero_ps(), sum_w = _mm256_setzero_ps();
+        for(int ty = 0; ty < 5; ++ty) {
+            int qy = std::clamp(y + (ty - 2) * step, 0, in.height - 1);
+            for(int tx = 0; tx < 5; ++tx) {
+                auto q = static_cast<size_t>(qy) * in.width + x + (tx - 2) * step;
+                __m256 qr = _mm256_loadu_ps(in.r + q), qg = _mm256_loadu_ps(in.g + q), qb = _mm256_loadu_ps(in.b + q);
+                __m256 ec = _mm256_mul_ps(color_weight, sum_of_squares_avx2(_mm256_sub_ps(qr, r), _mm256_sub_ps(qg, g), _mm256_sub_ps(qb, b)));
+                __m256 en = _mm256_mul_ps(_mm256_set1_ps(w.normal), sum_of_squares_avx2(_mm256_sub_ps(_mm256_loadu_ps(in.nx + q), nx),
+                    _mm256_sub_ps(_mm256_loadu_ps(in.ny + q), ny), _mm256_sub_ps(_mm256_loadu_ps(in.nz + q), nz)));
+                __m256 dd = _mm256_sub_ps(_mm256_loadu_ps(in.depth + q), d);
+                __m256 ed = _mm256_mul_ps(depth_weight, _mm256_mul_ps(dd, dd));
+                __m256 ea = _mm256_mul_ps(_mm256_set1_ps(w.albedo), sum_of_squares_avx2(_mm256_sub_ps(_mm256_loadu_ps(in.albedo_r + q), ar),
+                    _mm256_sub_ps(_mm256_loadu_ps(in.albedo_g + q), ag), _mm256_sub_ps(_mm256_loadu_ps(in.albedo_b + q), ab)));
+                __m256 e = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(ec, en), ed), ea);
+                __m256 weight = _mm256_mul_ps(_mm256_set1_ps(atrous_taps[ty] * atrous_taps[tx]), fast_exp_neg_avx2(e));
+                sum_r = _mm256_add_ps(sum_r, _mm256_mul_ps(weight, qr));
+                sum_g = _mm256_add_ps(sum_g, _mm256_mul_ps(weight, qg));
+                sum_b = _mm256_add_ps(sum_b, _mm256_mul_ps(weight, qb));
+                sum_v = _mm256_add_ps(sum_v, _mm256_mul_ps(_mm256_mul_ps(weight, weight), _mm256_loadu_ps(in.variance + q)));
+                sum_w = _mm256_add_ps(sum_w, weight);
+            }
+        }
+        _mm256_storeu_ps(out.r + p, _mm256_div_ps(sum_r, sum_w));
+        _mm256_storeu_ps(out.g + p, _mm256_div_ps(sum_g, sum_w));
+        _mm256_storeu_ps(out.b + p, _mm256_div_ps(sum_b, sum_w));
+        _mm256_storeu_ps(out.variance + p, _mm256_div_ps(sum_v, _mm256_mul_ps(sum_w, sum_w)));
+    }
+    for(; x < in.width; ++x)
+        atrous_pixel(in, out, x, y, step, w);
+}
+
+//avx512f brings fma along, which gcc would fuse into the mul/add pairs and round differently from atrous_pixel
+//gcc 12 flags the undefined source operand inside its own avx512 intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline __m512 fast_exp_neg_avx512(__m512 x) {
+    __m512 t = _mm512_mul_ps(_mm512_sub_ps(_mm512_setzero_ps(), _mm512_min_ps(x, _mm512_set1_ps(80.0f))), _mm512_set1_ps(exp_log2e));
+    __m512 whole = _mm512_roundscale_ps(t, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    __m512 f = _mm512_sub_ps(t, whole);
+    __m512 p = _mm512_set1_ps(exp2_poly[5]);
+    for(int k = 4; k >= 0; --k)
+        p = _mm512_add_ps(_mm512_set1_ps(exp2_poly[k]), _mm512_mul_ps(f, p));
+    __m512i bits = _mm512_slli_epi32(_mm512_add_epi32(_mm512_cvtps_epi32(whole), _mm512_set1_epi32(127)), 23);
+    return _mm512_mul_ps(p, _mm512_castsi512_ps(bits));
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline __m512 sum_of_squares_avx512(__m512 x, __m512 y, __m512 z) {
+    return _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(x, x), _mm512_mul_ps(y, y)), _mm512_mul_ps(z, z));
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline void atrous_row_avx512(const atrous_planes& in, const atrous_output& out, int y, int step, const atrous_weights& w) {
+    int x_begin = std::min(2 * step, in.width);
+    int x_end = std::max(x_begin, in.width - 2 * step);
+    for(int x = 0; x < x_begin; ++x)
+        atrous_pixel(in, out, x, y, step, w);
+    auto row = static_cast<size_t>(y) * in.width;
+    int x = x_begin;
+    for(; x + 16 <= x_end; x += 16) {
+        auto p = row + x;
+        __m512 r = _mm512_loadu_ps(in.r + p), g = _mm512_loadu_ps(in.g + p), b = _mm512_loadu_ps(in.b + p);
+        __m512 ar = _mm512_loadu_ps(in.albedo_r + p), ag = _mm512_loadu_ps(in.albedo_g + p), ab = _mm512_loadu_ps(in.albedo_b + p);
+        __m512 nx = _mm512_loadu_ps(in.nx + p), ny = _mm512_loadu_ps(in.ny + p), nz = _mm512_loadu_ps(in.nz + p);
+        __m512 d = _mm512_loadu_ps(in.depth + p);
+        __m512 color_weight = _mm512_div_ps(_mm512_set1_ps(w.color), _mm512_add_ps(_mm512_loadu_ps(in.variance + p), _mm512_set1_ps(atrous_variance_floor)));
+        __m512 depth_weight = _mm512_div_ps(_mm512_set1_ps(w.depth), _mm512_max_ps(_mm512_mul_ps(d, d), _mm512_set1_ps(1e-4f)));
+        __m512 sum_r = _mm512_setzero_ps(), sum_g = _mm512_setzero_ps(), sum_b = _mm512_setzero_ps();
+        __m512 sum_v = _mm512_setzero_ps(), sum_w = _mm512_setzero_ps();
+        for(int ty = 0; ty < 5; ++ty) {
+            int qy = std::clamp(y + (ty - 2) * step, 0, in.height - 1);
+            for(int tx = 0; tx < 5; ++tx) {
+                auto q = static_cast<size_t>(qy) * in.width + x + (tx - 2) * step;
+                __m512 qr = _mm512_loadu_ps(in.r + q), qg = _mm512_loadu_ps(in.g + q), qb = _mm512_loadu_ps(in.b + q);
+                __m512 ec = _mm512_mul_ps(color_weight, sum_of_squares_avx512(_mm512_sub_ps(qr, r), _mm512_sub_ps(qg, g), _mm512_sub_ps(qb, b)));
+                __m512 en = _mm512_mul_ps(_mm512_set1_ps(w.normal), sum_of_squares_avx512(_mm512_sub_ps(_mm512_loadu_ps(in.nx + q), nx),
+                    _mm512_sub_ps(_mm512_loadu_ps(in.ny + q), ny), _mm512_sub_ps(_mm512_loadu_ps(in.nz + q), nz)));
+                __m512 dd = _mm512_sub_ps(_mm512_loadu_ps(in.depth + q), d);
+                __m512 ed = _mm512_mul_ps(depth_weight, _mm512_mul_ps(dd, dd));
+                __m512 ea = _mm512_mul_ps(_mm512_set1_ps(w.albedo), sum_of_squares_avx512(_mm512_sub_ps(_mm512_loadu_ps(in.albedo_r + q), ar),
+                    _mm512_sub_ps(_mm512_loadu_ps(in.albedo_g + q), ag), _mm512_sub_ps(_mm512_loadu_ps(in.albedo_b + q), ab)));
+                __m512 e = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(ec, en), ed), ea);
+                __m512 weight = _mm512_mul_ps(_mm512_set1_ps(atrous_taps[ty] * atrous_taps[tx]), fast_exp_neg_avx512(e));
+                sum_r = _mm512_add_ps(sum_r, _mm512_mul_ps(weight, qr));
+                sum_g = _mm512_add_ps(sum_g, _mm512_mul_ps(weight, qg));
+                sum_b = _mm512_add_ps(sum_b, _mm512_mul_ps(weight, qb));
+                sum_v = _mm512_add_ps(sum_v, _mm512_mul_ps(_mm512_mul_ps(weight, weight), _mm512_loadu_ps(in.variance + q)));
+                sum_w = _mm512_add_ps(sum_w, weight);
+            }
+        }
+        _mm512_storeu_ps(out.r + p, _mm512_div_ps(sum_r, sum_w));
+        _mm512_storeu_ps(out.g + p, _mm512_div_ps(sum_g, sum_w));
+        _mm512_storeu_ps(out.b + p, _mm512_div_ps(sum_b, sum_w));
+        _mm512_storeu_ps(out.variance + p, _mm512_div_ps(sum_v, _mm512_mul_ps(sum_w, sum_w)));
+    }
+    for(; x < in.width; ++x)
+        atrous_pixel(in, out, x, y, step, w);
+}
+#pragma GCC diagnostic pop
+
+#endif
+
+inline atrous_row_kernel atrous_row_kernel_for(simd_level level) {
+    //picks the kernel for level, falling back to the widest one the cpu actually supports, no SSE2 kernel
+    if(level > detected_simd_level())
+        level = detected_simd_level();
+    switch(level) {
+#ifdef RT_SIMD_X86
+        case simd_level::avx512: return atrous_row_avx512;
+        case simd_level::avx2: return atrous_row_avx2;
+#endif
+        default: return atrous_row_scalar;
+    }
+}
+
+inline framebuffer denoise(const framebuffer& image, const aov_buffers& aovs, const denoise_settings& settings,
+                           thread_pool* pool = nullptr, simd_level level = detected_simd_level()) {
+    //the filtered image, one sample per pixel; runs its rows on pool when given, else on the calling thread
+    int width = image.width(), height = image.height();
+    size_t size = image.size();
+    const float albedo_floor = 1e-3f; //what the illumination of black surfaces is divided by
+    enum {r, g, b, variance, albedo_r, albedo_g, albedo_b, nx, ny, nz, depth, plane_count};
+    std::vector<aligned_vector<float>> planes(plane_count, aligned_vector<float>(size));
+    for(size_t p = 0; p < size; ++p) {
+        auto c = image.average(p);
+        auto a = aovs.albedo.average(p);
+        auto n = aovs.normal.average(p);
+        for(int k = 0; k < 3; ++k) {
+            planes[albedo_r + k][p] = std::max(static_cast<float>(a[k]), albedo_floor);
+            planes[r + k][p] = static_cast<float>(c[k]) / planes[albedo_r + k][p];
+            planes[nx + k][p] = static_cast<float>(n[k]);
+        }
+        planes[depth][p] = static_cast<float>(aovs.depth.average(p).x());
+        //variance of the pixel's mean luminance from its samples, moved to illumination like the color
+        auto y = luminance(c);
+        auto sample_variance = std::max(0.0, aovs.moments.average(p).x() - y * y);
+        auto albedo_y = std::max(luminance(a), static_cast<double>(albedo_floor));
+        auto samples = std::max<uint32_t>(image.samples(p), 1);
+        planes[variance][p] = static_cast<float>(sample_variance / samples / (albedo_y * albedo_y));
+    }
+
+    {
+        //one sample says nothing about the noise, those pixels take the variance of the illumination
+        //over their 7x7 neighbourhood instead
+        std::vector<float> spatial(size);
+        for(int y = 0; y < height; ++y) {
+            for(int x = 0; x < width; ++x) {
+                auto p = static_cast<size_t>(y) * width + x;
+                if(image.samples(p) >= 2) {
+                    spatial[p] = planes[variance][p];
+                    continue;
+                }
+                double sum = 0, sum2 = 0;
+                int n = 0;
+                for(int qy = std::max(y - 3, 0); qy <= std::min(y + 3, height - 1); ++qy) {
+                    for(int qx = std::max(x - 3, 0); qx <= std::min(x + 3, width - 1); ++qx) {
+                        auto q = static_cast<size_t>(qy) * width + qx;
+                        auto l = luminance(color(planes[r][q], planes[g][q], planes[b][q]));
+                        sum += l;
+                        sum2 += l * l;
+                        ++n;
+                    }
+                }
+                spatial[p] = static_cast<float>(std::max(0.0, sum2 / n - (sum / n) * (sum / n)));
+            }
+        }
+
+        //a few samples give a noisy variance, smooth it over the 3x3 neighbourhood before it steers the weights
+        std::vector<float> smoothed(size);
+        for(int y = 0; y < height; ++y) {
+            for(int x = 0; x < width; ++x) {
+                float sum = 0, weight_sum = 0;
+                for(int dy = -1; dy <= 1; ++dy) {
+                    for(int dx = -1; dx <= 1; ++dx) {
+                        int qx = std::clamp(x + dx, 0, width - 1), qy = std::clamp(y + dy, 0, height - 1);
+                        float weight = (dx == 0 ? 2.0f : 1.0f) * (dy == 0 ? 2.0f : 1.0f);
+                        sum += weight * spatial[static_cast<size_t>(qy) * width + qx];
+                        weight_sum += weight;
+                    }
+                }
+                smoothed[static_cast<size_t>(y) * width + x] = sum / weight_sum;
+            }
+        }
+        std::copy(smoothed.begin(), smoothed.end(), planes[variance].begin());
+    }
+
+    auto kernel = atrous_row_kernel_for(level);
+    std::vector<aligned_vector<float>> filtered(4, aligned_vector<float>(size)); //r g b variance
+    atrous_weights w = {static_cast<float>(1 / (settings.sigma_color * settings.sigma_color)),
+                        static_cast<float>(1 / (settings.sigma_normal * settings.sigma_normal)), 0,
+                        static_cast<float>(1 / (settings.sigma_albedo * settings.sigma_albedo))};
+    for(int pass = 0; pass < settings.iterations; ++pass) {
+        int step = 1 << pass;
+        auto sigma_depth = settings.sigma_depth * step;
+        w.depth = static_cast<float>(1 / (sigma_depth * sigma_depth));
+        atrous_planes in = {planes[r].data(), planes[g].data(), planes[b].data(), planes[variance].data(),
+                            planes[albedo_r].data(), planes[albedo_g].data(), planes[albedo_b].data(),
+                            planes[nx].data(), planes[ny].data(), planes[nz].data(), planes[depth].data(), width, height};
+        atrous_output out = {filtered[0].data(), filtered[1].data(), filtered[2].data(), filtered[3].data()};
+        const int band = 8; //rows per task
+        for(int y0 = 0; y0 < height; y0 += band) {
+            auto rows = [&, y0] {
+                for(int y = y0; y < std::min(y0 + band, height); ++y)
+                    kernel(in, out, y, step, w);
+            };
+            if(pool)
+                pool->submit(rows);
+            else
+                rows();
+        }
+        if(pool)
+            pool->wait();
+        for(int k = 0; k < 4; ++k)
+            std::swap(planes[r + k], filtered[k]);
+    }
+
+    framebuffer result(width, height);
+    for(size_t p = 0; p < size; ++p)
+        result.set(p, color(planes[r][p] * planes[albedo_r][p], planes[g][p] * planes[albedo_g][p], planes[b][p] * planes[albedo_b][p]), 1);
+    return result;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "rtweekend.h"
+
+#include "color.h"
+
+#include <cstdint>
+#include <vector>
+
+class framebuffer { //in-memory image the renderer fills before anything gets encoded
+    //holds the linear (not gamma corrected) sum of every sample per pixel and how many samples went in,
+    //so encoders can average, and pixels don't all need the same sample count
+    //sums are double in every build: float sums stop taking small samples after a few thousand, and checkpoints keep one format
+    public:
+        framebuffer() {}
+        framebuffer(int w, int h) : image_width(w), image_height(h), sums(static_cast<size_t>(w) * h), counts(sums.size(), 0) {}
+
+        int width() const {return image_width;}
+        int height() const {return image_height;}
+        size_t size() const {return sums.size();}
+
+        size_t index(int i, int j) const {return static_cast<size_t>(j) * image_width + i;}
+
+        using sum_type = basic_vec3<double>;
+
+        template<typename T>
+        void set(size_t pixel, const basic_vec3<T>& sample_sum, uint32_t sample_count) {
+            sums[pixel] = sum_type(sample_sum);
+            counts[pixel] = sample_count;
+        }
+
+        template<typename T>
+        void add(size_t pixel, const basic_vec3<T>& sample_sum, uint32_t sample_count) {
+            //more samples for a pixel that already has some, progressive passes and resumed renders
+            sums[pixel] += sum_type(sample_sum);
+            counts[pixel] += sample_count;
+        }
+
+        const sum_type& sum(size_t pixel) const {return sums[pixel];}
+        uint32_t samples(size_t pixel) const {return counts[pixel];}
+
+        color average(size_t pixel) const {
+            //linear radiance estimate for the pixel, black if it was never sampled
+            return counts[pixel] > 0 ? color(sums[pixel] / counts[pixel]) : color(0,0,0);
+        }
+
+    private:
+        int image_width = 0;
+        int image_height = 0;
+        std::vector<sum_type> sums;
+        std::vector<uint32_t> counts;
+};
+
+#endif
@@ -3,6 +3,8 @@
 
 #include "rtweekend.h"
 
+#include "aabb.h"
+
 class material;
 
 class hit_record { //a way to stuff a bunch of arguments into a class to send them as a group
@@ -10,9 +12,9 @@ class hit_record { //a way to stuff a bunch of arguments into a class to send th
     public:
         point3 p;
         vec3 normal;
-        double t;
+        real t;
         bool front_face;
-        shared_ptr<material> mat;
+        const material* mat; //borrowed from the scene: its arena (arena.h) or a material table by index (sphere_soa, sphere_bvh)
 
         //we compare the ray with the normal to figure out which side of the surface of the hittable the ray is hitting it from
         //make it so that normals always point against the incident ray
@@ -25,9 +27,18 @@ class hit_record { //a way to stuff a bunch of arguments into a class to send th
 };
 
 class hittable { //cleaner solution than just having an array of objects
+    //hit must leave rec untouched unless it returns true, hittable_list and the BVHs rely on it
     public:
         virtual ~hittable() = default;
         virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
+        virtual aabb bounding_box() const = 0; //box enclosing the whole object, used to build the BVH
+
+        virtual bool occluded(const ray& r, interval ray_t) const {
+            //whether anything is hit in ray_t, for shadow rays: any hit will do, so containers override this
+            //to stop at the first one instead of searching on for the closest
+            hit_record rec;
+            return hit(r, ray_t, rec);
+        }
 };
 
 #endif
\ No newline at end of file
@@ -1,7 +1,10 @@
 #ifndef HITTABLE_LIST_H
 #define HITTABLE_LIST_H
 
+#include "arena.h"
 #include "hittable.h"
+#include "lights.h"
+#include "stats.h"
 
 #include <memory> //shared_ptr
 #include <vector>
@@ -21,33 +24,55 @@ using std::make_shared;
 //std::vector is a generic array-like collection of things that automatically grows
 //as more values are added. push_back adds a value to the end of the vector member variable objects
 
+//objects made with arena.make<T>() instead of make_shared live in the list's arena, contiguous per type and
+//without a control block each, and add takes them like any other shared_ptr (see arena.h)
+
 class hittable_list : public hittable { //stores a list of hittables
     public:
+        scene_arena arena; //declared first so it outlives objects, which may point into it
         std::vector<shared_ptr<hittable>>objects;
+        std::vector<sphere_light> lights; //the emissive spheres among objects, for cameras that sample lights (lights.h)
         
         hittable_list() {}
         hittable_list(shared_ptr<hittable> object) {add(object);}
         
-        void clear() {objects.clear();}
+        void clear() {
+            objects.clear();
+            bbox = aabb();
+        }
 
         void add(shared_ptr<hittable> object) {
             objects.push_back(object);
+            bbox = aabb(bbox, object->bounding_box());
         }
 
         bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-            hit_record temp_rec;
+            //hittables only write rec when they report a closer hit, so each one can fill rec directly
+            //instead of going through a temporary record that gets copied on every hit
+            RT_STAT(hit_calls, 1);
             bool hit_anything = false;
             auto closest_so_far = ray_t.max;
 
             for(const auto& object : objects) {
-                if(object->hit(r, interval(ray_t.min, closest_so_far), temp_rec)) {
+                if(object->hit(r, interval(ray_t.min, closest_so_far), rec)) {
                     hit_anything = true;
-                    closest_so_far = temp_rec.t;
-                    rec = temp_rec;
+                    closest_so_far = rec.t;
                 }
             }
             return hit_anything;
         }
+
+        bool occluded(const ray& r, interval ray_t) const override {
+            for(const auto& object : objects)
+                if(object->occluded(r, ray_t))
+                    return true;
+            return false;
+        }
+
+        aabb bounding_box() const override {return bbox;}
+
+    private:
+        aabb bbox;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,136 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "rtweekend.h"
+
+#include "color.h"
+#include "framebuffer.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+/* output formats
+
+P3  ascii ppm, "r g b" text per pixel, the original format (default)
+P6  binary ppm, same header as P3 then 3 raw bytes per pixel, ~4x smaller and no integer formatting
+PFM portable float map, linear 32 bit float rgb, no gamma or clamping, rows stored bottom to top
+
+*/
+
+enum class image_format {ppm_ascii, ppm_binary, pfm};
+
+inline bool parse_image_format(const std::string& name, image_format& format) {
+    if(name == "p3" || name == "ppm")
+        format = image_format::ppm_ascii;
+    else if(name == "p6")
+        format = image_format::ppm_binary;
+    else if(name == "pfm")
+        format = image_format::pfm;
+    else
+        return false;
+    return true;
+}
+
+inline void append_int(std::string& buffer, int value) {
+    //small non-negative ints only (0-255 channels and image sizes), avoids snprintf per channel
+    char digits[12];
+    int n = 0;
+    do {
+        digits[n++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while(value > 0);
+    while(n > 0)
+        buffer.push_back(digits[--n]);
+}
+
+inline std::string encode_image(const framebuffer& fb, image_format format) {
+    //encodes the whole image into one buffer so it can go out in a single write
+    std::string buffer;
+    auto pixels = fb.size();
+
+    if(format == image_format::pfm) {
+        buffer = "PF\n" + std::to_string(fb.width()) + ' ' + std::to_string(fb.height()) + "\n-1.0\n"; //negative scale = little endian
+        auto header_size = buffer.size();
+        buffer.resize(header_size + pixels * 3 * sizeof(float));
+        auto* out = &buffer[header_size];
+        for(int j = fb.height() - 1; j >= 0; --j) {
+            for(int i = 0; i < fb.width(); ++i) {
+                auto c = fb.average(fb.index(i, j));
+                float rgb[3] = {static_cast<float>(c.x()), static_cast<float>(c.y()), static_cast<float>(c.z())};
+                std::memcpy(out, rgb, sizeof(rgb));
+                out += sizeof(rgb);
+            }
+        }
+        return buffer;
+    }
+
+    bool ascii = format == image_format::ppm_ascii;
+    buffer = std::string(ascii ? "P3\n" : "P6\n") + std::to_string(fb.width()) + ' ' + std::to_string(fb.height()) + "\n255\n"; //ppm header
+    buffer.reserve(buffer.size() + pixels * (ascii ? 12 : 3));
+    for(size_t p = 0; p < pixels; ++p) {
+        auto c = fb.average(p);
+        int rgb[3] = {color_to_byte(c.x()), color_to_byte(c.y()), color_to_byte(c.z())};
+        if(ascii) {
+            append_int(buffer, rgb[0]);
+            buffer.push_back(' ');
+            append_int(buffer, rgb[1]);
+            buffer.push_back(' ');
+            append_int(buffer, rgb[2]);
+            buffer.push_back('\n');
+        } else {
+            buffer.push_back(static_cast<char>(rgb[0]));
+            buffer.push_back(static_cast<char>(rgb[1]));
+            buffer.push_back(static_cast<char>(rgb[2]));
+        }
+    }
+    return buffer;
+}
+
+inline bool write_all(int fd, const char* data, size_t size) {
+    //one write() call for the whole buffer, only loops if the kernel takes it in pieces (pipes)
+    while(size > 0) {
+        auto written = ::write(fd, data, size);
+        if(written < 0) {
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+inline bool read_all(int fd, char* data, size_t size) {
+    //read() counterpart of write_all, false on error or a file that ends early
+    while(size > 0) {
+        auto got = ::read(fd, data, size);
+        if(got < 0 && errno == EINTR)
+            continue;
+        if(got <= 0)
+            return false;
+        data += got;
+        size -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+inline bool write_image(int fd, const framebuffer& fb, image_format format) {
+    auto buffer = encode_image(fb, format);
+    return write_all(fd, buffer.data(), buffer.size());
+}
+
+inline bool write_image(const std::string& path, const framebuffer& fb, image_format format) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return false;
+    bool ok = write_image(fd, fb, format);
+    return ::close(fd) == 0 && ok;
+}
+
+#endif
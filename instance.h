@@ -0,0 +1,313 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/* instancing
+
+one piece of geometry placed many times. the geometry is built once, in its own object space, into a bottom
+level structure (BLAS: any hittable, in practice a flat_bvh or a sphere_bvh), and an instance places it in the
+world through a transform, optionally with its own material in place of the geometry's. instance_bvh is the
+top level (TLAS), a flat BVH whose leaves are instances, so a ray walks the top level, moves into the object
+space of each instance it reaches and walks that BLAS
+
+memory grows with the unique geometry: an instance is an inverse transform, a box and two pointers however big
+the geometry it places is. moving instances (set_transform) never touches a BLAS, the top level is stale until
+refit() (same tree, boxes recomputed bottom up, linear in the instances) or build() (a fresh SAH build over
+the instance boxes, no BLAS work either), refit is enough while instances stay near where the tree put them:
+
+    auto rock = make_shared<sphere_bvh>(rock_spheres, rock_materials); //once
+    instance_bvh world;
+    for(...)
+        world.add(rock, affine_transform::translate(p) * affine_transform::rotate(axis, degrees));
+    world.build();
+    ...
+    world.set_transform(i, affine_transform::translate(p + v)); //every frame
+    world.refit();
+
+*/
+
+class affine_transform { //x -> linear x + offset, a 3x4 matrix in double whatever real is
+    public:
+        double m[3][4]; //rows, column 3 is the offset
+
+        affine_transform() : m{{1,0,0,0}, {0,1,0,0}, {0,0,1,0}} {} //identity
+
+        static affine_transform translate(const vec3& offset) {
+            affine_transform t;
+            for(int i = 0; i < 3; i++)
+                t.m[i][3] = offset[i];
+            return t;
+        }
+
+        static affine_transform scale(double s) {return scale(vec3(s, s, s));}
+
+        static affine_transform scale(const vec3& s) {
+            affine_transform t;
+            for(int i = 0; i < 3; i++)
+                t.m[i][i] = s[i];
+            return t;
+        }
+
+        static affine_transform rotate(const vec3& axis, double degrees) {
+            //counterclockwise around axis looking against it (Rodrigues' rotation formula)
+            auto a = unit_vector(axis);
+            auto theta = degrees_to_radians(degrees);
+            auto c = std::cos(theta), s = std::sin(theta), k = 1 - c;
+            double x = a.x(), y = a.y(), z = a.z();
+            affine_transform t;
+            t.m[0][0] = c + x*x*k;   t.m[0][1] = x*y*k - z*s; t.m[0][2] = x*z*k + y*s;
+            t.m[1][0] = y*x*k + z*s; t.m[1][1] = c + y*y*k;   t.m[1][2] = y*z*k - x*s;
+            t.m[2][0] = z*x*k - y*s; t.m[2][1] = z*y*k + x*s; t.m[2][2] = c + z*z*k;
+            return t;
+        }
+
+        affine_transform operator*(const affine_transform& b) const {
+            //b first, then this
+            affine_transform r;
+            for(int i = 0; i < 3; i++) {
+                for(int j = 0; j < 4; j++) {
+                    r.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j];
+                    if(j == 3)
+                        r.m[i][j] += m[i][3];
+                }
+            }
+            return r;
+        }
+
+        double determinant() const {
+            return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+                 - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+                 + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+        }
+
+        affine_transform inverse() const {
+            //the linear part inverted through its adjugate, the offset moved back through it.
+            //a singular transform (a zero scale) has no inverse, everything becomes inf or NaN
+            affine_transform r;
+            auto inv_det = 1 / determinant();
+            r.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * inv_det;
+            r.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+            r.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+            r.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * inv_det;
+            r.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+            r.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+            r.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * inv_det;
+            r.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+            r.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+            for(int i = 0; i < 3; i++)
+                r.m[i][3] = -(r.m[i][0] * m[0][3] + r.m[i][1] * m[1][3] + r.m[i][2] * m[2][3]);
+            return r;
+        }
+
+        point3 point(const point3& p) const {
+            return point3(m[0][0] * p[0] + m[0][1] * p[1] + m[0][2] * p[2] + m[0][3],
+                          m[1][0] * p[0] + m[1][1] * p[1] + m[1][2] * p[2] + m[1][3],
+                          m[2][0] * p[0] + m[2][1] * p[1] + m[2][2] * p[2] + m[2][3]);
+        }
+
+        vec3 vector(const vec3& v) const { //directions don't move with the offset
+            return vec3(m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2],
+                        m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2],
+                        m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2]);
+        }
+
+        vec3 transposed_vector(const vec3& v) const {
+            //v through the transposed linear part. normals go through the inverse transpose, so on an inverse
+            //transform this takes a normal the other way: an instance's world_to_object maps object normals to world
+            return vec3(m[0][0] * v[0] + m[1][0] * v[1] + m[2][0] * v[2],
+                        m[0][1] * v[0] + m[1][1] * v[1] + m[2][1] * v[2],
+                        m[0][2] * v[0] + m[1][2] * v[1] + m[2][2] * v[2]);
+        }
+
+        aabb box(const aabb& b) const {
+            //the box around the transformed box: per output axis the smallest and largest sum of
+            //m[i][j] times either end of input axis j (Arvo, "transforming axis-aligned bounding boxes")
+            if(b.x.size() < 0 || b.y.size() < 0 || b.z.size() < 0)
+                return aabb();
+            interval out[3];
+            for(int i = 0; i < 3; i++) {
+                double lo = m[i][3], hi = m[i][3];
+                for(int j = 0; j < 3; j++) {
+                    auto e0 = m[i][j] * b.axis(j).min;
+                    auto e1 = m[i][j] * b.axis(j).max;
+                    lo += std::fmin(e0, e1);
+                    hi += std::fmax(e0, e1);
+                }
+                out[i] = interval(lo, hi);
+            }
+            return aabb(out[0], out[1], out[2]);
+        }
+};
+
+class instance final : public hittable { //shared geometry placed by a transform, final so instance_bvh calls hit directly
+    public:
+        instance(shared_ptr<hittable> geometry, const affine_transform& object_to_world, shared_ptr<material> material_override = nullptr)
+          : object(std::move(geometry)), mat(std::move(material_override)) {
+            set_transform(object_to_world);
+        }
+
+        void set_transform(const affine_transform& object_to_world) {
+            //object_to_world has to be invertible
+            world_to_object = object_to_world.inverse();
+            bbox = object_to_world.box(object->bounding_box());
+        }
+
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+            //the object space ray keeps its direction unnormalized, so t means the same distance along both rays
+            //and ray_t and rec.t need no conversion
+            RT_STAT(hit_calls, 1);
+            ray local(world_to_object.point(r.origin()), world_to_object.vector(r.direction()));
+            if(!object->hit(local, ray_t, rec))
+                return false;
+
+            //the object set rec.normal against the local ray, the transform keeps that side (the dot product
+            //of a direction and a normal is the same before and after), so front_face holds as it is
+            rec.p = r.at(rec.t);
+            rec.normal = unit_vector(world_to_object.transposed_vector(rec.normal));
+            if(mat)
+                rec.mat = mat.get();
+            return true;
+        }
+
+        bool occluded(const ray& r, interval ray_t) const override {
+            return object->occluded(ray(world_to_object.point(r.origin()), world_to_object.vector(r.direction())), ray_t);
+        }
+
+        aabb bounding_box() const override {return bbox;}
+
+        const shared_ptr<hittable>& geometry() const {return object;}
+
+    private:
+        shared_ptr<hittable> object; //the BLAS, shared with every other instance of it
+        shared_ptr<material> mat; //replaces the geometry's materials when set
+        affine_transform world_to_object;
+        aabb bbox; //world space
+};
+
+class instance_bvh : public hittable { //the top level: a flat BVH over instances, kept by value in one array
+    //leaves point into the instance array through an index list, so instances keep the index add gave them
+    //through rebuilds and callers can move them by it. hits go through the tree as it was last built or refit
+    public:
+        size_t add(shared_ptr<hittable> geometry, const affine_transform& object_to_world, shared_ptr<material> material_override = nullptr) {
+            //returns the index of the new instance, it isn't hit until the next build
+            instances.emplace_back(std::move(geometry), object_to_world, std::move(material_override));
+            return instances.size() - 1;
+        }
+
+        void set_transform(size_t index, const affine_transform& object_to_world) {
+            //the tree boxes are stale until the next refit or build
+            instances[index].set_transform(object_to_world);
+        }
+
+        const instance& at(size_t index) const {return instances[index];}
+        size_t size() const {return instances.size();}
+
+        void build() {
+            nodes.clear();
+            order.clear();
+            bbox = aabb();
+            if(instances.empty())
+                return;
+            std::vector<bvh_primitive> prims(instances.size());
+            for(size_t i = 0; i < instances.size(); ++i) {
+                prims[i].box = instances[i].bounding_box();
+                prims[i].centroid = prims[i].box.centroid();
+                prims[i].index = i;
+            }
+            order.reserve(prims.size());
+            nodes.reserve(2 * prims.size() - 1);
+            build_flat_bvh(nodes, prims, 0, prims.size(), flat_bvh_leaf_rule{max_leaf_size, traversal_cost},
+                [&](flat_bvh_node& node, size_t start, size_t end) {
+                    node.offset = static_cast<uint32_t>(order.size());
+                    node.count = static_cast<uint16_t>(end - start);
+                    for(size_t i = start; i < end; ++i)
+                        order.push_back(static_cast<uint32_t>(prims[i].index));
+                });
+            bbox = root_box();
+        }
+
+        void refit() {
+            if(nodes.empty())
+                return;
+            //children come after their parent (depth first), so walking the nodes backwards sees both
+            //children of a node before the node itself
+            std::vector<aabb> boxes(nodes.size());
+            for(size_t n = nodes.size(); n-- > 0;) {
+                auto& node = nodes[n];
+                aabb box;
+                if(node.count > 0) {
+                    for(uint32_t i = node.offset; i < node.offset + node.count; ++i)
+                        box = aabb(box, instances[order[i]].bounding_box());
+                } else {
+                    box = aabb(boxes[n + 1], boxes[node.offset]);
+                }
+                set_node_bounds(node, box);
+                boxes[n] = box;
+            }
+            bbox = root_box();
+        }
+
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+            RT_STAT(hit_calls, 1);
+            if(nodes.empty())
+                return false;
+            return traverse_flat_bvh<false>(nodes.data(), r, ray_t, [&](const flat_bvh_node& node, interval& t) {
+                bool hit_anything = false;
+                for(uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                    if(instances[order[i]].hit(r, t, rec)) {
+                        hit_anything = true;
+                        t.max = rec.t;
+                    }
+                }
+                return hit_anything;
+            });
+        }
+
+        bool occluded(const ray& r, interval ray_t) const override {
+            //the same walk as hit, done at the first instance that reports anything
+            RT_STAT(hit_calls, 1);
+            if(nodes.empty())
+                return false;
+            return traverse_flat_bvh<true>(nodes.data(), r, ray_t, [&](const flat_bvh_node& node, interval& t) {
+                for(uint32_t i = node.offset; i < node.offset + node.count; ++i)
+                    if(instances[order[i]].occluded(r, t))
+                        return true;
+                return false;
+            });
+        }
+
+        aabb bounding_box() const override {return bbox;}
+
+        size_t node_count() const {return nodes.size();}
+        size_t memory_bytes() const { //the top level alone, the BLASes are counted once by whoever built them
+            return nodes.size() * sizeof(flat_bvh_node) + order.size() * sizeof(uint32_t) + instances.size() * sizeof(instance);
+        }
+
+    private:
+        static const int max_leaf_size = 4;
+        static constexpr double traversal_cost = 0.125; //cost of a box test relative to an instance test
+
+        std::vector<instance> instances; //in add order
+        std::vector<flat_bvh_node> nodes;
+        std::vector<uint32_t> order; //instance indices, every leaf's adjacent
+        aabb bbox;
+
+        aabb root_box() const {
+            const auto& root = nodes[0];
+            return aabb(point3(root.bounds_min[0], root.bounds_min[1], root.bounds_min[2]),
+                        point3(root.bounds_max[0], root.bounds_max[1], root.bounds_max[2]));
+        }
+};
+
+#endif
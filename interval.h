@@ -1,23 +1,35 @@
 #ifndef INTERVAL_H
 #define INTERVAL_H
 
-class interval { 
+template<typename T>
+class basic_interval { 
     public:
-        double min, max;
+        T min, max;
 
         //constructors
-        interval() : min(+infinity), max(-infinity) {} //default interval empty
-        interval(double _min, double _max) : min(_min), max(_max) {}
+        basic_interval() : min(+infinity), max(-infinity) {} //default interval empty
+        basic_interval(T _min, T _max) : min(_min), max(_max) {}
+        basic_interval(const basic_interval& a, const basic_interval& b) : min(fmin(a.min, b.min)), max(fmax(a.max, b.max)) {} //tightly encloses both
 
-        bool contains(double x) const {
+        T size() const {
+            return max - min;
+        }
+
+        basic_interval expand(T delta) const {
+            //pad the interval by delta in total, half on each side
+            auto padding = delta/2;
+            return basic_interval(min - padding, max + padding);
+        }
+
+        bool contains(T x) const {
             return min <= x && x <= max;
         }
 
-        bool surrounds(double x) const {
+        bool surrounds(T x) const {
             return min < x && x < max;
         }
 
-        double clamp(double x) const {
+        T clamp(T x) const {
             if(x < min)
                 return min;
             if(x > max)
@@ -25,10 +37,12 @@ class interval {
             return x;
         }
 
-        static const interval empty, universe;
+        static const basic_interval empty, universe;
 };
 
+using interval = basic_interval<real>;
+
 const static interval empty (+infinity, -infinity);
 const static interval universe(-infinity, +infinity);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,208 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include "rtweekend.h"
+
+#include "color.h"
+
+#include <algorithm>
+#include <vector>
+
+/* lights
+
+what next event estimation samples (camera::light_sampling): at every diffuse hit the camera picks one light,
+samples a direction towards it, traces a shadow ray that stops at any hit (hittable::occluded) and weighs the
+light it gets against the bsdf's own sample with the power heuristic, so whichever of the two picks a direction
+more readily dominates there (multiple importance sampling, veach's thesis ch. 9)
+
+  sphere lights  spheres of an emissive material, sampled uniformly over the cone they fill as seen from the
+                 hit point, which covers exactly the visible cap and nothing else
+  the sky        the gradient background, sampled in proportion to its luminance times the cosine to the
+                 surface normal: directions from the bsdf's own cosine lobe, kept with a probability that follows
+                 the luminance (rejection). plain luminance sampling of a sky this even sends half its samples
+                 below the surface and does worse than the bsdf alone, with the cosine in it can't
+
+one light is picked per hit, with a probability proportional to the irradiance it would give at a focus point
+(the camera's lookat), so a dim sky next to bright lamps gets few of the shadow rays
+
+*/
+
+struct sphere_light { //an emissive sphere as light sampling sees it
+    point3 center;
+    double radius;
+    color emission; //radiance leaving its outside
+};
+
+class gradient_sky { //the background, times brightness: white straight down to light blue straight up
+    //blended linearly in the direction's y over the whole sphere, so the horizon is halfway between the two.
+    //pdf() relies on that: its normalisation integrates a luminance that is linear in y everywhere
+    public:
+        double brightness = 1;
+
+        color radiance(const vec3& direction) const {
+            vec3 unit_direction = unit_vector(direction);
+            auto a = 0.5 * (unit_direction.y() + 1.0);
+            //linear interpolation = (1 - a) * startValue + a * endValue   where 0.0<=a<=1.0
+                                                 //white                 //blue
+            return brightness * ((1.0 - a) * color(1.0,1.0,1.0) + a * color(0.5,0.7,1.0));
+        }
+
+        bool sample(const vec3& normal, sampler& s, vec3& direction) const {
+            //a unit direction above the surface with density pdf(): cosine weighted candidates (normal plus a
+            //random unit vector, like lambertian scatter), each kept with probability luminance / the brightest
+            //luminance, three in four or more are. false once max_tries candidates were all turned down, which
+            //for a real normal never happens in practice but stops a NaN one (a degenerate transform) for good
+            static const int max_tries = 64;
+            for(int tries = 0; tries < max_tries; ++tries) {
+                auto candidate = normal + random_unit_vector(s);
+                if(candidate.near_zero())
+                    continue;
+                candidate = unit_vector(candidate);
+                if(s.sample_1d() * fmax(bottom(), top()) <= unit_luminance(candidate.y())) {
+                    direction = candidate;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        double pdf(const vec3& direction, const vec3& normal) const {
+            //density over solid angle of sample() picking direction: luminance times cosine over its integral on
+            //the hemisphere, which for a luminance linear in y is pi mean + 2 pi / 3 slope normal.y
+            auto unit_direction = unit_vector(direction);
+            auto cosine = dot(unit_direction, normal);
+            if(cosine <= 0)
+                return 0;
+            return unit_luminance(unit_direction.y()) * cosine / (pi * mean() + 2 * pi / 3 * slope() * normal.y());
+        }
+
+        double mean_luminance() const {return brightness * mean();} //over the whole sphere of directions
+
+    private:
+        //luminance of the unit sky is mean + slope * y, white at y = -1 to blue at y = 1
+        static double bottom() {return luminance(color(1.0,1.0,1.0));}
+        static double top() {return luminance(color(0.5,0.7,1.0));}
+        static double mean() {return 0.5 * (bottom() + top());}
+        static double slope() {return 0.5 * (top() - bottom());}
+        static double unit_luminance(double y) {return mean() + slope() * y;}
+};
+
+struct light_sample {
+    vec3 direction; //unit
+    double distance; //to the light's surface, infinity for the sky
+    color radiance; //arriving along direction when nothing is in the way
+    double pdf; //over solid angle, the choice of light included
+};
+
+inline double power_heuristic(double pdf, double other_pdf) {
+    //the weight of a sample from the strategy with density pdf against one with other_pdf (beta = 2)
+    auto a = pdf * pdf, b = other_pdf * other_pdf;
+    return a > 0 ? a / (a + b) : 0;
+}
+
+class light_set { //the lights of a scene, ready to sample
+    public:
+        light_set() {}
+
+        light_set(std::vector<sphere_light> lights, const gradient_sky& background, const point3& focus)
+          : spheres(std::move(lights)), sky(background) {
+            double total = 0;
+            for(const auto& light : spheres) {
+                //irradiance at focus from a sphere of radiance L is L pi sin^2 of its half angle (all of it inside)
+                auto d2 = (light.center - focus).length_squared();
+                auto r2 = light.radius * light.radius;
+                total += luminance(light.emission) * pi * (d2 > r2 ? r2 / d2 : 1);
+                cdf.push_back(total);
+            }
+            if(sky.brightness > 0) {
+                total += sky.mean_luminance() * pi;
+                cdf.push_back(total);
+            }
+            if(total <= 0) {
+                spheres.clear();
+                cdf.clear();
+                return;
+            }
+            for(auto& c : cdf)
+                c /= total;
+            cdf.back() = 1;
+        }
+
+        bool empty() const {return cdf.empty();}
+        bool samples_sky() const {return cdf.size() > spheres.size();}
+
+        bool sample(const point3& p, const vec3& normal, sampler& s, light_sample& out) const {
+            //one light picked by its share of the irradiance, then a direction towards it from p on a surface
+            //facing normal. false when p is inside the chosen light or the sky found no direction
+            auto pick = s.sample_1d();
+            auto k = static_cast<size_t>(std::upper_bound(cdf.begin(), cdf.end() - 1, pick) - cdf.begin());
+            if(k == spheres.size()) {
+                if(!sky.sample(normal, s, out.direction))
+                    return false;
+                out.distance = infinity;
+                out.radiance = sky.radiance(out.direction);
+                out.pdf = probability(k) * sky.pdf(out.direction, normal);
+                return out.pdf > 0;
+            }
+
+            double u, v;
+            s.sample_2d(u, v);
+            const auto& light = spheres[k];
+            auto to_center = light.center - p;
+            auto d2 = to_center.length_squared();
+            auto r2 = light.radius * light.radius;
+            if(d2 <= r2)
+                return false;
+            auto sin2_max = r2 / d2;
+            auto one_minus_cos_max = sin2_max / (1 + sqrt(1 - sin2_max)); //1 - cos without the cancellation for small lights
+
+            //cos theta uniform in [cos_max, 1], sin^2 computed from 1 - cos so it keeps its digits near the axis
+            auto one_minus_cos = u * one_minus_cos_max;
+            auto cos_theta = 1 - one_minus_cos;
+            auto sin_theta = sqrt(fmax(0.0, one_minus_cos * (2 - one_minus_cos)));
+            auto phi = 2 * pi * v;
+            auto w = to_center / sqrt(d2);
+            auto helper = fabs(w.x()) > 0.9 ? vec3(0,1,0) : vec3(1,0,0);
+            auto t = unit_vector(cross(w, helper));
+            auto b = cross(w, t);
+            out.direction = unit_vector(cos(phi) * sin_theta * t + sin(phi) * sin_theta * b + cos_theta * w);
+
+            //the near intersection: half chord from the closest approach of the line to the center
+            auto along = dot(to_center, out.direction);
+            out.distance = along - sqrt(fmax(0.0, r2 - (d2 - along * along)));
+            out.radiance = light.emission;
+            out.pdf = probability(k) / (2 * pi * one_minus_cos_max);
+            return true;
+        }
+
+        double pdf_sphere(const point3& origin, const point3& hit) const {
+            //density sample() would have picked the direction from origin to hit with, hit a point on one of the
+            //sphere lights; 0 when it is on none of them (an emitter that isn't in the set was never sampled)
+            for(size_t k = 0; k < spheres.size(); ++k) {
+                const auto& light = spheres[k];
+                if(fabs((hit - light.center).length() - light.radius) > 1e-3 * light.radius)
+                    continue;
+                auto d2 = (light.center - origin).length_squared();
+                auto r2 = light.radius * light.radius;
+                if(d2 <= r2)
+                    return 0;
+                auto sin2_max = r2 / d2;
+                return probability(k) / (2 * pi * (sin2_max / (1 + sqrt(1 - sin2_max))));
+            }
+            return 0;
+        }
+
+        double pdf_sky(const vec3& direction, const vec3& normal) const {
+            //same for a direction leaving the scene from a surface facing normal
+            return samples_sky() ? probability(spheres.size()) * sky.pdf(direction, normal) : 0;
+        }
+
+    private:
+        std::vector<sphere_light> spheres;
+        std::vector<double> cdf; //picking probabilities summed up, the spheres then the sky when it has any light
+        gradient_sky sky;
+
+        double probability(size_t k) const {return k == 0 ? cdf[0] : cdf[k] - cdf[k - 1];}
+};
+
+#endif
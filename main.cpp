@@ -1,10 +1,17 @@
 #include "rtweekend.h"
 
+#include "animation.h"
 #include "camera.h"
 #include "color.h"
+#include "image_writer.h"
 #include "material.h"
 #include "hittable_list.h"
-#include "sphere.h"
+#include "scene_file.h"
+#include "scenes.h"
+
+#include <exception>
+#include <iostream>
+#include <string>
 
 /* PPM file format
 
@@ -20,53 +27,155 @@ r g b
 
 */
 
-int main() {
+static bool parse_range(const std::string& spec, int total, int& first, int& last) {
+    //"a-b" is indices a to b inclusive, "i/n" is part i (from 0) of [0, total) cut into n near equal parts
+    auto dash = spec.find('-');
+    auto slash = spec.find('/');
+    try {
+        if(dash != std::string::npos) {
+            first = std::stoi(spec.substr(0, dash));
+            last = std::stoi(spec.substr(dash + 1));
+        } else if(slash != std::string::npos) {
+            long long part = std::stoi(spec.substr(0, slash));
+            long long parts = std::stoi(spec.substr(slash + 1));
+            if(parts < 1 || part < 0 || part >= parts)
+                return false;
+            first = static_cast<int>(part * total / parts);
+            last = static_cast<int>((part + 1) * total / parts) - 1;
+        } else {
+            return false;
+        }
+    } catch(const std::exception&) {
+        return false;
+    }
+    return first >= 0 && first <= last;
+}
+
+int main(int argc, char* argv[]) {
 
-    // world
-    hittable_list world;
+    // options
+    image_format format = image_format::ppm_ascii;
+    std::string output_path; //stdout unless given
+    std::string heatmap_path; //RT_STATS builds: next to the output image unless given
+    double noise_threshold = 0; //adaptive sampling off unless given
+    int samples_per_pixel = 0; //100 unless given here or by the scene file
+    std::string scene_path; //built in sphere grid unless given
+    std::string save_scene_path;
+    double rr_threshold = 0.1;
+    bool wavefront = false;
+    int pass_samples = 0; //progressive passes off unless given
+    std::string checkpoint_path;
+    double checkpoint_interval = 60;
+    bool resume = false;
+    std::string tiles_spec; //distributed job assignment, whole frame unless given
+    std::string samples_spec;
+    std::string partial_path;
+    uint64_t seed = 0;
+    sample_pattern sampling = sample_pattern::independent;
+    int threads = 0; //one per core
+    std::string animation_path; //a still image unless given
+    std::string frames_spec; //every frame of the animation unless given
+    bool denoising = false;
+    std::string aov_path; //no AOV images unless given
+    bool light_sampling = false;
+    double sky_brightness = -1; //the scene file's, or 1, unless given
 
-    auto material_ground = make_shared<metal>(color(0.05,0.05,0.2), 0.15);
-    /*auto material_center = make_shared<dielectric>(1.5);
-    auto material_left = make_shared<dielectric>(1.5);
-    auto material_right = make_shared<metal>(color(0.8,0.6,0.2), 0.3);
-    auto material_5 = make_shared<lambertian>(color(0.8,0.1,0.7));
-    auto material_6 = make_shared<metal>(color(0.0,0.0,0.2),0.01);
-
-                                    //center x y z         radius   material
-    world.add(make_shared<sphere>(point3(0.0,-100.5,-1.0), 100.0, material_ground));
-    world.add(make_shared<sphere>(point3(0.0, 0.0, -1.0), 0.5, material_center));
-    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), -0.4, material_left));
-    world.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, material_right));
-    world.add(make_shared<sphere>(point3(1.2, 0.0, -.8), 0.1, material_5));
-    world.add(make_shared<sphere>(point3(0.6, 0.0, -3.0), 0.2, material_6));*/
-    world.add(make_shared<sphere>(point3(0.0,-100.35,-1.0), 100.0, material_ground));
-
-    for(int a = -3; a < 19; a++) {
-        for(int b = -3; b < 19; b++) {
-            auto choose_mat = random_double();
-            point3 center(a + 0.9 * random_double(), -0.25, b + 0.9*random_double());
-            if((center - point3(4, 0.2, 0)).length() > 0.9) {
-                shared_ptr<material> sphere_material;
-                if(choose_mat < 0.4) { //diffuse material
-                    auto albedo = color::random() * color::random();
-                    sphere_material = make_shared<lambertian>(albedo);
-                    world.add(make_shared<sphere>(center, 0.1, sphere_material));
-                } else if(choose_mat < 0.75) { //metal material
-                    auto albedo = color::random(0.5, 1);
-                    auto fuzz = random_double(0, 0.5);
-                    sphere_material = make_shared<metal>(albedo, fuzz);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));                  
-                } else if(choose_mat < 0.88) { //glass material
-                    sphere_material = make_shared<dielectric>(2.2);
-                    world.add(make_shared<sphere>(center, 0.1, sphere_material));
-                } else { //bubble
-                    sphere_material = make_shared<dielectric>(1.5);
-                    world.add(make_shared<sphere>(center, -0.3, sphere_material));
-                }
-            }
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--format" && i + 1 < argc && parse_image_format(argv[i+1], format)) {
+            ++i;
+        } else if(arg == "--output" && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if(arg == "--scene" && i + 1 < argc) {
+            scene_path = argv[++i];
+        } else if(arg == "--save-scene" && i + 1 < argc) {
+            save_scene_path = argv[++i];
+        } else if(arg == "--heatmap" && i + 1 < argc) {
+            heatmap_path = argv[++i];
+        } else if(arg == "--spp" && i + 1 < argc) {
+            samples_per_pixel = std::stoi(argv[++i]);
+        } else if(arg == "--rr" && i + 1 < argc) {
+            rr_threshold = std::stod(argv[++i]);
+        } else if(arg == "--wavefront") {
+            wavefront = true;
+        } else if(arg == "--progressive" && i + 1 < argc) {
+            pass_samples = std::stoi(argv[++i]);
+        } else if(arg == "--checkpoint" && i + 1 < argc) {
+            checkpoint_path = argv[++i];
+        } else if(arg == "--checkpoint-interval" && i + 1 < argc) {
+            checkpoint_interval = std::stod(argv[++i]);
+        } else if(arg == "--resume") {
+            resume = true;
+        } else if(arg == "--adaptive" && i + 1 < argc) {
+            noise_threshold = std::stod(argv[++i]);
+        } else if(arg == "--tiles" && i + 1 < argc) {
+            tiles_spec = argv[++i];
+        } else if(arg == "--samples" && i + 1 < argc) {
+            samples_spec = argv[++i];
+        } else if(arg == "--partial" && i + 1 < argc) {
+            partial_path = argv[++i];
+        } else if(arg == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        } else if(arg == "--sampler" && i + 1 < argc && parse_sample_pattern(argv[i+1], sampling)) {
+            ++i;
+        } else if(arg == "--threads" && i + 1 < argc) {
+            threads = std::stoi(argv[++i]);
+        } else if(arg == "--animation" && i + 1 < argc) {
+            animation_path = argv[++i];
+        } else if(arg == "--frames" && i + 1 < argc) {
+            frames_spec = argv[++i];
+        } else if(arg == "--denoise") {
+            denoising = true;
+        } else if(arg == "--aovs" && i + 1 < argc) {
+            aov_path = argv[++i];
+        } else if(arg == "--nee") {
+            light_sampling = true;
+        } else if(arg == "--sky" && i + 1 < argc) {
+            sky_brightness = std::stod(argv[++i]);
+        } else {
+            std::cerr << "usage: imageoutput [--scene path] [--save-scene path] [--format p3|p6|pfm] [--output path] [--heatmap path] [--spp samples] [--rr threshold] [--adaptive noise_threshold] [--wavefront]\n"
+                         "                   [--progressive samples_per_pass] [--checkpoint path] [--checkpoint-interval seconds] [--resume]\n"
+                         "                   [--tiles first-last|part/parts] [--samples first-last|part/parts] [--partial path] [--seed n]\n"
+                         "                   [--sampler independent|stratified|sobol|bluenoise] [--threads n]\n"
+                         "                   [--animation path] [--frames first-last|part/parts] [--denoise] [--aovs path_prefix]\n"
+                         "                   [--nee] [--sky brightness]\n";
+            return 1;
+        }
+    }
+
+    if(!save_scene_path.empty() && scene_path.empty()) {
+        std::cerr << "--save-scene needs a --scene to convert\n";
+        return 1;
+    }
+
+    animation anim;
+    if(!animation_path.empty()) {
+        std::string error;
+        if(!load_animation(animation_path, anim, error)) {
+            std::cerr << error << '\n';
+            return 1;
+        }
+        if(output_path.empty()) {
+            std::cerr << "--animation writes one file per frame and needs an --output path, # in it is the frame number\n";
+            return 1;
         }
+        if(pass_samples > 0 || !checkpoint_path.empty() || resume || !tiles_spec.empty() || !samples_spec.empty() || !partial_path.empty()) {
+            std::cerr << "--animation renders whole frames, no progressive passes, checkpoints or jobs\n";
+            return 1;
+        }
+        if(!anim.motions.empty() && scene_path.empty()) {
+            std::cerr << "only the spheres of a --scene can move\n";
+            return 1;
+        }
+    } else if(!frames_spec.empty()) {
+        std::cerr << "--frames needs an --animation\n";
+        return 1;
+    }
+    int first_frame = 0, last_frame = anim.frame_count - 1;
+    if(!frames_spec.empty() && (!parse_range(frames_spec, anim.frame_count, first_frame, last_frame) || last_frame >= anim.frame_count)) {
+        std::cerr << "--frames " << frames_spec << ": not a range of the animation's " << anim.frame_count << " frames\n";
+        return 1;
     }
-    
 
     // camera
     camera cam;
@@ -75,7 +184,77 @@ int main() {
     cam.samples_per_pixel = 100;
     cam.max_depth = 50;
 
-    cam.render(world);
+    // world
+    hittable_list world;
+    shared_ptr<sphere_bvh> movable; //the loaded scene, the spheres an animation can move
+    if(scene_path.empty()) {
+        world = sphere_grid_scene();
+    } else {
+        loaded_scene scene;
+        std::string error;
+        auto load_start = high_resolution_clock::now();
+        if(!load_scene(scene_path, scene, error)) {
+            std::cerr << error << '\n';
+            return 1;
+        }
+        std::clog << "loaded " << scene_path << " in "
+                  << duration_cast<microseconds>(high_resolution_clock::now() - load_start).count() / 1000.0 << " ms\n";
+        if(!save_scene_path.empty() && !save_scene_binary(save_scene_path, scene)) {
+            std::cerr << "failed to write " << save_scene_path << '\n';
+            return 1;
+        }
+        scene.camera.apply(cam);
+        world.add(scene.world);
+        world.lights = scene.lights;
+        movable = scene.world;
+    }
+
+    if(samples_per_pixel > 0)
+        cam.samples_per_pixel = samples_per_pixel;
+    cam.rr_threshold = rr_threshold;
+    cam.thread_count = threads; //0 = one render thread per core, output is identical to a single threaded run
+    cam.seed = seed;
+    cam.sampling = sampling;
+    cam.adaptive_sampling = noise_threshold > 0;
+    cam.noise_threshold = noise_threshold;
+    cam.wavefront = wavefront;
+    cam.pass_samples = pass_samples;
+    cam.checkpoint_path = checkpoint_path;
+    cam.checkpoint_interval = checkpoint_interval;
+    cam.resume = resume;
+    //checkpoints and partial buffers record which scene their samples are of, the built in one is 0
+    if(!scene_path.empty() && (!checkpoint_path.empty() || !partial_path.empty()) && !hash_file(scene_path, cam.scene_hash)) {
+        std::cerr << "can't read " << scene_path << '\n';
+        return 1;
+    }
+    cam.denoising = denoising;
+    cam.light_sampling = light_sampling; //next event estimation with multiple importance sampling, see lights.h
+    cam.lights = world.lights;
+    if(sky_brightness >= 0)
+        cam.sky_brightness = sky_brightness;
+    cam.aov_path = aov_path;
+    cam.output_format = format;
+    cam.output_path = output_path;
+    if(stats_enabled && heatmap_path.empty() && !output_path.empty())
+        heatmap_path = output_path.substr(0, output_path.find_last_of('.')) + "_heatmap.ppm"; //image.ppm -> image_heatmap.ppm
+    cam.heatmap_path = heatmap_path;
 
+    //a job of a distributed render, see render_jobs.sh: some of the tiles and/or samples, kept as a partial buffer
+    if(!tiles_spec.empty() && (!parse_range(tiles_spec, cam.tile_total(), cam.first_tile, cam.last_tile) || cam.last_tile >= cam.tile_total())) {
+        std::cerr << "--tiles " << tiles_spec << ": not a range of the image's " << cam.tile_total() << " tiles\n";
+        return 1;
+    }
+    int first_sample = 0, last_sample = cam.samples_per_pixel - 1;
+    if(!samples_spec.empty() && (!parse_range(samples_spec, cam.samples_per_pixel, first_sample, last_sample) || last_sample >= cam.samples_per_pixel)) {
+        std::cerr << "--samples " << samples_spec << ": not a range of the " << cam.samples_per_pixel << " samples per pixel\n";
+        return 1;
+    }
+    cam.sample_count = cam.samples_per_pixel; //the stratified sets stay the frame's whatever range this job takes
+    cam.sample_offset = first_sample;
+    cam.samples_per_pixel = last_sample - first_sample + 1;
+    cam.partial_path = partial_path;
 
+    if(!animation_path.empty())
+        return render_frames(cam, world, anim, movable.get(), first_frame, last_frame) ? 0 : 1;
+    return cam.render(world) ? 0 : 1;
 }
\ No newline at end of file
@@ -3,64 +3,97 @@
 
 #include "rtweekend.h"
 
-class hit_record;
+#include "color.h"
+#include "hittable.h"
+#include "stats.h"
+
+//the material set is closed, so a material is one small value type tagged with its kind instead of a class hierarchy:
+//scatter is a switch the compiler can inline, and hittables keep their materials in flat arrays (see sphere_soa, sphere_bvh)
+//diffuse_light only emits (see lights.h for sampling it), it reflects nothing
+enum class material_kind {lambertian, metal, dielectric, diffuse_light};
+constexpr int material_kind_count = 4;
 
 class material {
     public:
-        virtual ~material() = default;
-        virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const = 0;
-};
+        material(material_kind k, const color& a, double p) : type(k), albedo(a), param(p) {}
 
-class lambertian : public material {
-    //this lambertian diffuse material will always scatter rays and attenuate based on reflectance
-    //(CURRENTLY OMITTED) diffuse material using random ray direction, less like real life, less shadow variance
-    //using lambertian diffuse, more rays scattering towards the normal
-    //so less light bounces toward camera and more light bounces in shadow areas
-    public:
-        lambertian(const color& a) : albedo(a) {}
+        material_kind kind() const {return type;}
+        const color& surface_albedo() const {return albedo;} //what the denoiser's albedo buffer records, white for dielectrics
+
+        bool emits() const {return type == material_kind::diffuse_light;}
+        color emission() const {return emits() ? albedo : color(0,0,0);} //radiance leaving the surface
+        color emitted(const hit_record& rec) const {return rec.front_face ? emission() : color(0,0,0);} //lights are one sided
+
+        //light sampling (camera::light_sampling) happens at diffuse hits only, metal and glass scatter into a lobe
+        //too narrow for a light sample to land in, so the light their scattered rays hit counts in full
+        bool samples_lights() const {return type == material_kind::lambertian;}
+
+        color reflected(const hit_record& rec, const vec3& direction, double& pdf) const {
+            //for a material that samples lights and a unit direction towards a light: the bsdf times the cosine,
+            //what scatter's attenuation stands for when it picks direction, and the density it picks it with
+            auto cosine = dot(rec.normal, direction);
+            if(cosine <= 0) {
+                pdf = 0;
+                return color(0,0,0);
+            }
+            pdf = cosine / pi;
+            return albedo * (cosine / pi);
+        }
+
+        double scatter_pdf(const hit_record& rec, const vec3& direction) const {
+            //density scatter picked direction with, for a material that samples lights (cosine weighted)
+            return fmax(0.0, dot(rec.normal, unit_vector(direction))) / pi;
+        }
+
+        bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& s) const {
+            switch(type) {
+                case material_kind::metal: return scatter_as<material_kind::metal>(r_in, rec, attenuation, scattered, s);
+                case material_kind::dielectric: return scatter_as<material_kind::dielectric>(r_in, rec, attenuation, scattered, s);
+                case material_kind::diffuse_light: return scatter_as<material_kind::diffuse_light>(r_in, rec, attenuation, scattered, s);
+                default: return scatter_as<material_kind::lambertian>(r_in, rec, attenuation, scattered, s);
+            }
+        }
+
+        template<material_kind Kind>
+        bool scatter_as(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& s) const {
+            //scatter for a kind known at compile time, for callers that already sorted hits by kind (wavefront.h)
+            RT_STAT(scatter_calls[static_cast<int>(Kind)], 1);
+            if constexpr(Kind == material_kind::lambertian)
+                return scatter_lambertian(rec, attenuation, scattered, s);
+            else if constexpr(Kind == material_kind::metal)
+                return scatter_metal(r_in, rec, attenuation, scattered, s);
+            else if constexpr(Kind == material_kind::dielectric)
+                return scatter_dielectric(r_in, rec, attenuation, scattered, s);
+            else
+                return false; //lights absorb whatever reaches them
+        }
+
+    private:
+        material_kind type;
+        color albedo; //lambertian and metal, the emitted radiance of diffuse_light
+        double param; //metal: fuzz, dielectric: index of refraction
+
+        bool scatter_lambertian(const hit_record& rec, color& attenuation, ray& scattered, sampler& s) const {
+            auto scatter_direction = rec.normal + random_unit_vector(s);
 
-        bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
-            auto scatter_direction = rec.normal + random_unit_vector();
-            
             if(scatter_direction.near_zero()) //if the random ray was extremely close to equal to the normal vector
                 scatter_direction = rec.normal;
-            
+
             scattered = ray(rec.p, scatter_direction);
             attenuation = albedo;
             return true;
         }
-    
-    private:
-        color albedo;
-};
-
-class metal : public material {
-    public:
-        metal(const color& a, double f) : albedo(a), fuzz(f < 1 ? f : 1) {}
 
-        bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
+        bool scatter_metal(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& s) const {
             vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-            scattered = ray(rec.p, reflected + fuzz*random_unit_vector());
+            scattered = ray(rec.p, reflected + param*random_unit_vector(s));
             attenuation = albedo;
             return (dot(scattered.direction(), rec.normal) > 0); //absorb scatters that go below the surface due to fuzz
         }
-    
-    private:
-        color albedo;
-        double fuzz;
-};
 
-class dielectric : public material {
-    //clear materials are dielectrics. a ray hitting a clear material splits into a reflected ray and refracted (transmitted) ray
-    //a negative sphere radius can be used to make a hollow sphere that looks like a bubble
-    //here we EVENTUALLY randomly choose one of those rays rather than generating both
-    //the current material ALWAYS REFRACTS.
-    public:
-        dielectric(double index_of_refraction) : ir(index_of_refraction) {}
-
-        bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override{
-            attenuation = color(1.0,1.0,1.0);
-            double refraction_ratio = rec.front_face ? (1.0/ir) : ir;
+        bool scatter_dielectric(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& s) const {
+            attenuation = albedo; //always white
+            double refraction_ratio = rec.front_face ? (1.0/param) : param;
 
             vec3 unit_direction = unit_vector(r_in.direction());
             double cos_theta = fmin(dot(-unit_direction ,rec.normal),1.0);
@@ -69,16 +102,14 @@ class dielectric : public material {
             bool cannot_refract = refraction_ratio * sin_theta > 1.0;
             vec3 direction;
 
-            if(cannot_refract || reflectance(cos_theta, refraction_ratio) > random_double())
+            if(cannot_refract || reflectance(cos_theta, refraction_ratio) > s.sample_1d())
                 direction = reflect(unit_direction, rec.normal);
             else
                 direction = refract(unit_direction, rec.normal, refraction_ratio);
-            
+
             scattered = ray(rec.p, direction);
             return true;
         }
-    private:
-        double ir; //index of refraction
 
         static double reflectance(double cosine, double ref_idx) {
             //use schlick's approximation for reflectance that varies based on angle of view
@@ -88,4 +119,35 @@ class dielectric : public material {
         }
 };
 
+//the named materials only pick the kind and parameters, they add no state so copying one into a material table loses nothing
+
+class lambertian : public material {
+    //this lambertian diffuse material will always scatter rays and attenuate based on reflectance
+    //(CURRENTLY OMITTED) diffuse material using random ray direction, less like real life, less shadow variance
+    //using lambertian diffuse, more rays scattering towards the normal
+    //so less light bounces toward camera and more light bounces in shadow areas
+    public:
+        lambertian(const color& a) : material(material_kind::lambertian, a, 0) {}
+};
+
+class metal : public material {
+    public:
+        metal(const color& a, double f) : material(material_kind::metal, a, f < 1 ? f : 1) {}
+};
+
+class dielectric : public material {
+    //clear materials are dielectrics. a ray hitting a clear material splits into a reflected ray and refracted (transmitted) ray
+    //a negative sphere radius can be used to make a hollow sphere that looks like a bubble
+    //here we EVENTUALLY randomly choose one of those rays rather than generating both
+    //the current material ALWAYS REFRACTS.
+    public:
+        dielectric(double index_of_refraction) : material(material_kind::dielectric, color(1.0,1.0,1.0), index_of_refraction) {}
+};
+
+class diffuse_light : public material {
+    //a surface that glows with the given radiance and reflects nothing, values above 1 for lamps
+    public:
+        diffuse_light(const color& emit) : material(material_kind::diffuse_light, emit, 0) {}
+};
+
 #endif
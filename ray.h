@@ -3,20 +3,25 @@
 
 #include "vec3.h"
 
-class ray { //P(t) = A + tb     P=position A=rayorigin b=raydirection t=param
+template<typename T>
+class basic_ray { //P(t) = A + tb     P=position A=rayorigin b=raydirection t=param
     public:
-        ray() {} //constructors
-        ray(const point3& origin, const vec3& direction) : orig(origin), dir(direction) {}
+        basic_ray() {} //constructors
+        basic_ray(const basic_vec3<T>& origin, const basic_vec3<T>& direction) : orig(origin), dir(direction) {}
+        template<typename U>
+        explicit basic_ray(const basic_ray<U>& r) : orig(r.origin()), dir(r.direction()) {} //precision change
 
-        point3 origin() const {return orig;}
-        vec3 direction() const {return dir;}
+        basic_vec3<T> origin() const {return orig;}
+        basic_vec3<T> direction() const {return dir;}
 
-        point3 at(double t) const {
+        basic_vec3<T> at(T t) const {
             return orig + t*dir; //position along ray
         }
     private:
-        point3 orig;
-        vec3 dir;
+        basic_vec3<T> orig;
+        basic_vec3<T> dir;
 };
 
-#endif
\ No newline at end of file
+using ray = basic_ray<real>;
+
+#endif
@@ -0,0 +1,88 @@
+#!/bin/sh
+# render_jobs.sh: renders one frame as several local imageoutput processes and merges them with rtmerge
+#
+#   ./render_jobs.sh [-j jobs] [-s tiles|samples] [-o output] [-f p3|p6|pfm] [-k dir] [-c] [-- imageoutput options...]
+#
+# -j  number of jobs, one single threaded process each (default: number of cores)
+# -s  split the frame by tiles (default) or by sample ranges
+# -o  final image (default: image.ppm), -f its format (default: p3)
+# -k  keep the partial buffers in dir instead of a temporary directory, e.g. to rerun rtmerge
+# -c  check: also render the frame in one progressive process and compare it with the merge byte for byte,
+#     they are the same samples so any difference is a bug (exits with 3 when they differ)
+# everything after -- goes to every job (--scene, --spp, --wavefront, ...); a job that fails stops the merge
+#
+# the same assignments work across machines: run imageoutput --tiles i/n --partial part_i on each box,
+# copy the partial buffers together and run rtmerge on them
+
+set -u
+
+jobs=$(nproc 2>/dev/null || echo 1)
+split=tiles
+output=image.ppm
+format=p3
+keep=
+check=
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        -j) jobs=$2; shift 2 ;;
+        -s) split=$2; shift 2 ;;
+        -o) output=$2; shift 2 ;;
+        -f) format=$2; shift 2 ;;
+        -k) keep=$2; shift 2 ;;
+        -c) check=1; shift ;;
+        --) shift; break ;;
+        *) echo "usage: $0 [-j jobs] [-s tiles|samples] [-o output] [-f p3|p6|pfm] [-k dir] [-c] [-- imageoutput options...]" >&2; exit 1 ;;
+    esac
+done
+
+case "$split" in
+    tiles|samples) ;;
+    *) echo "$0: -s takes tiles or samples" >&2; exit 1 ;;
+esac
+
+here=$(dirname "$0")
+if [ -n "$keep" ]; then
+    dir=$keep
+    mkdir -p "$dir" || exit 1
+else
+    dir=$(mktemp -d) || exit 1
+    trap 'rm -rf "$dir"' EXIT
+fi
+
+pids=
+i=0
+while [ "$i" -lt "$jobs" ]; do
+    "$here/imageoutput" --threads 1 --$split "$i/$jobs" --partial "$dir/part_$i.accum" "$@" 2> "$dir/part_$i.log" &
+    pids="$pids $!"
+    i=$((i + 1))
+done
+
+failed=0
+i=0
+for pid in $pids; do
+    if ! wait "$pid"; then
+        echo "job $i/$jobs failed:" >&2
+        cat "$dir/part_$i.log" >&2
+        failed=1
+    fi
+    i=$((i + 1))
+done
+[ "$failed" -eq 0 ] || exit 1
+
+"$here/rtmerge" --format "$format" --output "$output" "$dir"/part_*.accum || exit $?
+
+if [ -n "$check" ]; then
+    # one pass as large as any spp, the per sample streams make it the jobs' samples exactly
+    "$here/imageoutput" --progressive 1000000000 --format "$format" --output "$dir/single" "$@" 2> "$dir/single.log" || {
+        echo "the single render failed:" >&2
+        cat "$dir/single.log" >&2
+        exit 1
+    }
+    if cmp -s "$output" "$dir/single"; then
+        echo "check: the merge matches a single render" >&2
+    else
+        echo "check: the merge differs from a single render" >&2
+        exit 3
+    fi
+fi
@@ -0,0 +1,498 @@
+#ifndef RENDER_SERVICE_H
+#define RENDER_SERVICE_H
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "hittable_list.h"
+#include "image_writer.h"
+#include "scene_file.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/* render service
+
+what the render daemon (rtserve.cpp) runs: scenes built once and kept resident, and a queue of render jobs
+that share one thread_pool. a job is split into its camera's tiles and every pool task renders the next tile
+of the highest priority job that has tiles left (the oldest first among equal priorities), so a new urgent job
+overtakes the running ones at the next tile boundary and several jobs of one priority progress side by side.
+cancelling a job drops the tiles it hasn't started, the ones in flight finish and are thrown away
+
+requests are text lines, one per connection, answered by response lines (see unix_socket.h):
+
+render <scene> [output path] [format p3|p6|pfm] [priority n] [spp n] [width w] [aspect a] [depth d]
+       [lookfrom x y z] [lookat x y z] [vup x y z] [vfov f] [seed n] [sampler name] [wavefront] [denoise]
+       [nee] [sky brightness]
+                        queues a job, answers "job <id>". settings not given are the scene file's, then
+                        imageoutput's defaults. without an output the image is rendered and dropped
+status [id]             one status line for the job, or for every job
+watch <id>              a status line whenever tiles finish (at most one per tile), until the job ends
+wait <id>               the job's final status line once it has ended
+cancel <id>             "cancelled <id>", or an error if the job already ended
+scenes                  "scene <name>" per resident scene
+shutdown                cancels every job and stops the server, answers "stopping"
+
+status lines are "job <id> scene <name> state queued|running|done|failed|cancelled priority <n>
+tiles <done>/<total> samples <n> rays <n> mrays_per_s <x> queued_s <x> running_s <x>", failed jobs
+add "error <message>"; anything that goes wrong with a request answers one "error <message>" line
+
+*/
+
+enum class job_state {queued, running, done, failed, cancelled};
+
+inline const char* job_state_name(job_state state) {
+    switch(state) {
+        case job_state::queued: return "queued";
+        case job_state::running: return "running";
+        case job_state::done: return "done";
+        case job_state::failed: return "failed";
+        case job_state::cancelled: return "cancelled";
+    }
+    return "unknown";
+}
+
+struct render_request { //a parsed render request line
+    std::string scene;
+    std::string output_path; //empty renders and drops the image
+    image_format format = image_format::ppm_ascii;
+    int priority = 0; //higher goes first
+    scene_camera view; //0 / not given keeps the scene's setting
+    uint64_t seed = 0;
+    sample_pattern sampling = sample_pattern::independent;
+    bool wavefront = false;
+    bool denoising = false;
+    bool light_sampling = false;
+};
+
+class render_request_parser : text_reader { //the words after "render"
+    public:
+        using text_reader::text_reader;
+
+        bool parse(render_request& request, std::string& error) {
+            request.scene = word();
+            if(request.scene.empty()) {
+                error = "render needs a scene";
+                return false;
+            }
+            for(std::string name = word(); !name.empty(); name = word()) {
+                double value;
+                if(name == "wavefront") {
+                    request.wavefront = true;
+                } else if(name == "denoise") {
+                    request.denoising = true;
+                } else if(name == "nee") {
+                    request.light_sampling = true;
+                } else if(name == "output") {
+                    request.output_path = word();
+                    if(request.output_path.empty())
+                        return bad(error, "output needs a path");
+                } else if(name == "format") {
+                    if(!parse_image_format(word(), request.format))
+                        return bad(error, "format needs p3, p6 or pfm");
+                } else if(name == "sampler") {
+                    if(!parse_sample_pattern(word(), request.sampling))
+                        return bad(error, "sampler needs independent, stratified, sobol or bluenoise");
+                } else if(name == "lookfrom" || name == "lookat" || name == "vup") {
+                    double x, y, z;
+                    if(!number(x) || !number(y) || !number(z))
+                        return bad(error, name + " needs x y z");
+                    auto& view = request.view;
+                    if(name == "lookfrom") {view.lookfrom = point3(x, y, z); view.view_given |= scene_view_lookfrom;}
+                    else if(name == "lookat") {view.lookat = point3(x, y, z); view.view_given |= scene_view_lookat;}
+                    else {view.vup = vec3(x, y, z); view.view_given |= scene_view_vup;}
+                } else if(name == "priority" || name == "seed" || name == "spp" || name == "width" || name == "depth"
+                          || name == "aspect" || name == "vfov" || name == "sky") {
+                    if(!number(value))
+                        return bad(error, name + " needs a number");
+                    if(name == "priority") request.priority = static_cast<int>(value);
+                    else if(name == "seed" && value >= 0) request.seed = static_cast<uint64_t>(value);
+                    else if(name == "spp" && value >= 1) request.view.samples_per_pixel = static_cast<int>(value);
+                    else if(name == "width" && value >= 1) request.view.image_width = static_cast<int>(value);
+                    else if(name == "depth" && value >= 1) request.view.max_depth = static_cast<int>(value);
+                    else if(name == "aspect" && value > 0) request.view.aspect_ratio = value;
+                    else if(name == "vfov" && value > 0) request.view.vfov = value;
+                    else if(name == "sky" && value >= 0) request.view.sky_brightness = value;
+                    else return bad(error, "bad value for " + name);
+                } else {
+                    return bad(error, "unknown render setting " + name);
+                }
+            }
+            return true;
+        }
+
+    private:
+        static bool bad(std::string& error, const std::string& what) {
+            error = what;
+            return false;
+        }
+};
+
+struct job_status { //a job as status lines report it
+    uint64_t id = 0;
+    std::string scene;
+    job_state state = job_state::queued;
+    int priority = 0;
+    int tiles_done = 0;
+    int tiles_total = 0;
+    long long samples = 0;
+    long long rays = 0;
+    double queued_seconds = 0; //submitted to first tile, or to now
+    double running_seconds = 0; //first tile to the end, or to now
+    std::string error;
+
+    bool ended() const {return state == job_state::done || state == job_state::failed || state == job_state::cancelled;}
+
+    std::string line() const {
+        std::ostringstream out;
+        out << "job " << id << " scene " << scene << " state " << job_state_name(state) << " priority " << priority
+            << " tiles " << tiles_done << '/' << tiles_total << " samples " << samples << " rays " << rays
+            << " mrays_per_s " << (running_seconds > 0 ? rays / running_seconds / 1e6 : 0)
+            << " queued_s " << queued_seconds << " running_s " << running_seconds;
+        if(!error.empty())
+            out << " error " << error;
+        return out.str();
+    }
+};
+
+class render_service {
+    public:
+        std::function<void()> on_shutdown; //called after a shutdown request has cancelled everything
+
+        explicit render_service(int threads) : pool(threads) {}
+
+        ~render_service() {
+            //the pool is the last member, so it drains (every task it still holds finds no tile) before the jobs go
+            cancel_all();
+        }
+
+        void add_scene(const std::string& name, hittable_list world, const scene_camera& view = {}) {
+            std::lock_guard<std::mutex> guard(lock);
+            scenes[name] = std::make_shared<const resident_scene>(resident_scene{std::move(world), view});
+        }
+
+        std::vector<std::string> scene_names() const {
+            std::lock_guard<std::mutex> guard(lock);
+            std::vector<std::string> names;
+            for(const auto& entry : scenes)
+                names.push_back(entry.first);
+            return names;
+        }
+
+        bool submit(const render_request& request, uint64_t& id, std::string& error) {
+            std::unique_lock<std::mutex> guard(lock);
+            auto scene = scenes.find(request.scene);
+            if(scene == scenes.end()) {
+                error = "no scene " + request.scene;
+                return false;
+            }
+            auto job = std::make_shared<render_job>();
+            job->id = id = next_id++;
+            job->request = request;
+            job->scene = scene->second;
+            job->submitted = steady_clock::now();
+            guard.unlock();
+
+            //imageoutput's defaults, then the scene file's settings, then the request's
+            auto& cam = job->cam;
+            cam = std::make_unique<camera>();
+            cam->aspect_ratio = 16.0 / 9.0;
+            cam->image_width = 400;
+            cam->samples_per_pixel = 100;
+            cam->max_depth = 50;
+            job->scene->view.apply(*cam);
+            request.view.apply(*cam);
+            cam->thread_count = 1; //the service's pool runs the tiles
+            cam->seed = request.seed;
+            cam->sampling = request.sampling;
+            cam->wavefront = request.wavefront;
+            cam->denoising = request.denoising;
+            cam->light_sampling = request.light_sampling;
+            cam->lights = job->scene->world.lights;
+            cam->output_format = request.format;
+            cam->output_path = request.output_path;
+            cam->defer_output = request.output_path.empty();
+            if(!cam->start_tiles()) {
+                error = "can't set up the camera";
+                return false;
+            }
+            job->tiles_total = cam->tile_total();
+
+            guard.lock();
+            jobs[job->id] = job;
+            runnable.push_back(job);
+            guard.unlock();
+            std::clog << "job " << job->id << ": " << request.scene << ' ' << cam->image_width << " wide, "
+                      << cam->samples_per_pixel << " spp, priority " << request.priority << ", " << job->tiles_total << " tiles\n";
+            for(int t = 0; t < job->tiles_total; ++t)
+                pool.submit([this] {run_next_tile();});
+            return true;
+        }
+
+        bool cancel(uint64_t id, std::string& error) {
+            std::lock_guard<std::mutex> guard(lock);
+            auto found = jobs.find(id);
+            if(found == jobs.end()) {
+                error = "no job " + std::to_string(id);
+                return false;
+            }
+            auto& job = *found->second;
+            if(job.ended() || job.cancelling) {
+                error = "job " + std::to_string(id) + " already " + (job.cancelling ? "cancelled" : job_state_name(job.state));
+                return false;
+            }
+            if(job.tiles_done == job.tiles_total) {
+                error = "job " + std::to_string(id) + " is rendered and being written";
+                return false;
+            }
+            job.cancelling = true;
+            drop_runnable(found->second);
+            if(job.in_flight == 0)
+                end_job(job, job_state::cancelled);
+            return true;
+        }
+
+        void cancel_all() {
+            std::vector<uint64_t> ids;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                for(const auto& job : runnable)
+                    ids.push_back(job->id);
+            }
+            std::string ignored;
+            for(auto id : ids)
+                cancel(id, ignored);
+        }
+
+        bool status(uint64_t id, job_status& out) const {
+            std::lock_guard<std::mutex> guard(lock);
+            auto found = jobs.find(id);
+            if(found == jobs.end())
+                return false;
+            out = found->second->status();
+            return true;
+        }
+
+        std::vector<job_status> statuses() const {
+            std::lock_guard<std::mutex> guard(lock);
+            std::vector<job_status> all;
+            for(const auto& entry : jobs)
+                all.push_back(entry.second->status());
+            return all;
+        }
+
+        bool wait_for_update(uint64_t id, int& tiles_seen, job_status& out) {
+            //blocks until more than tiles_seen tiles of the job are done or it ended, false for an unknown job
+            std::unique_lock<std::mutex> guard(lock);
+            auto found = jobs.find(id);
+            if(found == jobs.end())
+                return false;
+            auto job = found->second;
+            changed.wait(guard, [&] {return job->ended() || job->tiles_done > tiles_seen;});
+            tiles_seen = job->tiles_done;
+            out = job->status();
+            return true;
+        }
+
+        void handle(const std::string& request, const std::function<bool(const std::string&)>& respond) {
+            //answers one request line, see the top of this file. respond returns false once the client is gone
+            std::istringstream words(request);
+            std::string verb;
+            words >> verb;
+            auto job_id = [&](uint64_t& id) {
+                std::string text;
+                if(!(words >> text) || text.find_first_not_of("0123456789") != std::string::npos)
+                    return false;
+                id = std::stoull(text);
+                return true;
+            };
+            std::string error;
+            uint64_t id = 0;
+            job_status state;
+
+            if(verb == "render") {
+                render_request parsed;
+                auto rest = request.substr(std::min(request.size(), request.find("render") + 6));
+                render_request_parser parser(rest.c_str(), rest.c_str() + rest.size());
+                if(!parser.parse(parsed, error) || !submit(parsed, id, error))
+                    respond("error " + error);
+                else
+                    respond("job " + std::to_string(id));
+            } else if(verb == "status") {
+                if(job_id(id)) {
+                    if(status(id, state))
+                        respond(state.line());
+                    else
+                        respond("error no job " + std::to_string(id));
+                } else {
+                    for(const auto& s : statuses())
+                        if(!respond(s.line()))
+                            break;
+                }
+            } else if(verb == "watch" || verb == "wait") {
+                if(!job_id(id)) {
+                    respond("error " + verb + " needs a job id");
+                    return;
+                }
+                int seen = verb == "wait" ? INT_MAX : -1; //wait only wakes up when the job ends
+                bool known = false;
+                while(wait_for_update(id, seen, state)) {
+                    known = true;
+                    if(state.ended() || verb == "watch")
+                        if(!respond(state.line()))
+                            return;
+                    if(state.ended())
+                        break;
+                }
+                if(!known)
+                    respond("error no job " + std::to_string(id));
+            } else if(verb == "cancel") {
+                if(!job_id(id))
+                    respond("error cancel needs a job id");
+                else if(cancel(id, error))
+                    respond("cancelled " + std::to_string(id));
+                else
+                    respond("error " + error);
+            } else if(verb == "scenes") {
+                for(const auto& name : scene_names())
+                    respond("scene " + name);
+            } else if(verb == "shutdown") {
+                cancel_all();
+                respond("stopping");
+                if(on_shutdown)
+                    on_shutdown();
+            } else {
+                respond("error unknown request " + verb + ", expected render, status, watch, wait, cancel, scenes or shutdown");
+            }
+        }
+
+    private:
+        struct resident_scene {
+            hittable_list world;
+            scene_camera view; //a scene file's camera settings, what a request doesn't set
+        };
+
+        struct render_job {
+            uint64_t id;
+            render_request request;
+            std::shared_ptr<const resident_scene> scene;
+            std::unique_ptr<camera> cam; //released once the job ends
+            job_state state = job_state::queued;
+            bool cancelling = false; //no more tiles start, the job ends as cancelled once in_flight is 0
+            int next_tile = 0;
+            int tiles_done = 0;
+            int tiles_total = 0;
+            int in_flight = 0;
+            long long samples = 0;
+            long long rays = 0;
+            steady_clock::time_point submitted, started, finished;
+            std::string error;
+
+            bool ended() const {return state == job_state::done || state == job_state::failed || state == job_state::cancelled;}
+
+            job_status status() const {
+                job_status s;
+                s.id = id;
+                s.scene = request.scene;
+                s.state = state;
+                s.priority = request.priority;
+                s.tiles_done = tiles_done;
+                s.tiles_total = tiles_total;
+                s.samples = samples;
+                s.rays = rays;
+                auto seconds = [](steady_clock::duration d) {return duration_cast<microseconds>(d).count() / 1000000.0;};
+                auto until = ended() ? finished : steady_clock::now();
+                bool ran = started != steady_clock::time_point(); //a job cancelled while queued never did
+                s.queued_seconds = seconds((ran ? started : until) - submitted);
+                s.running_seconds = ran ? seconds(until - started) : 0;
+                s.error = error;
+                return s;
+            }
+        };
+
+        mutable std::mutex lock; //guards everything below
+        std::condition_variable changed; //a tile finished or a job ended
+        std::map<std::string, std::shared_ptr<const resident_scene>> scenes;
+        std::map<uint64_t, std::shared_ptr<render_job>> jobs; //every job so far, by id
+        std::vector<std::shared_ptr<render_job>> runnable; //jobs with tiles left to start, in submission order
+        uint64_t next_id = 1;
+        thread_pool pool; //last, see the destructor
+
+        void drop_runnable(const std::shared_ptr<render_job>& job) {
+            runnable.erase(std::remove(runnable.begin(), runnable.end(), job), runnable.end());
+        }
+
+        void end_job(render_job& job, job_state state) {
+            //with the lock held
+            job.state = state;
+            job.finished = steady_clock::now();
+            job.cam.reset();
+            auto status = job.status();
+            std::clog << "job " << job.id << ' ' << job_state_name(state) << ": " << status.tiles_done << '/' << status.tiles_total
+                      << " tiles, " << status.rays / std::max(status.running_seconds, 1e-9) / 1e6 << " Mrays/s, "
+                      << status.queued_seconds << " s queued, " << status.running_seconds << " s running\n";
+            changed.notify_all();
+        }
+
+        void run_next_tile() {
+            //one pool task: the next tile of the most urgent job, nothing if every job is started or cancelled
+            std::unique_lock<std::mutex> guard(lock);
+            std::shared_ptr<render_job> job;
+            for(const auto& candidate : runnable) //oldest first, so ties go to the earliest job
+                if(!job || candidate->request.priority > job->request.priority)
+                    job = candidate;
+            if(!job)
+                return;
+            int tile = job->next_tile++;
+            if(job->next_tile == job->tiles_total)
+                drop_runnable(job);
+            if(job->state == job_state::queued) {
+                job->state = job_state::running;
+                job->started = steady_clock::now();
+            }
+            ++job->in_flight;
+            guard.unlock();
+
+            long long samples = 0, rays = 0;
+            job->cam->render_tile_at(job->scene->world, tile, samples, rays);
+
+            guard.lock();
+            --job->in_flight;
+            job->samples += samples;
+            job->rays += rays;
+            ++job->tiles_done;
+            if(job->cancelling) {
+                if(job->in_flight == 0)
+                    end_job(*job, job_state::cancelled);
+                return;
+            }
+            if(job->tiles_done < job->tiles_total) {
+                changed.notify_all();
+                return;
+            }
+
+            //the last tile: write the image on this worker, outside the lock
+            auto seconds = duration_cast<microseconds>(steady_clock::now() - job->started).count() / 1000000.0;
+            auto total_samples = job->samples, total_rays = job->rays;
+            guard.unlock();
+            bool written = job->cam->finish_tiles(total_samples, total_rays, seconds);
+            guard.lock();
+            if(!written)
+                job->error = "failed to write " + job->request.output_path;
+            end_job(*job, written ? job_state::done : job_state::failed);
+        }
+};
+
+#endif
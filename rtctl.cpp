@@ -0,0 +1,54 @@
+#include "unix_socket.h"
+
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+/* rtctl
+
+the command line client of the render daemon (rtserve.cpp): sends its words as one request line and prints
+every response line until the server closes the connection
+
+    rtctl [--socket path] request...
+
+e.g. rtctl render grid output image.ppm spp 50 priority 2, rtctl watch 3, rtctl status. exits with 1 when the
+server can't be reached or any response line is an error
+
+*/
+
+int main(int argc, char* argv[]) {
+    std::string socket_path = "rtserve.sock";
+    std::string request;
+
+    int i = 1;
+    if(i + 1 < argc && std::string(argv[i]) == "--socket") {
+        socket_path = argv[i+1];
+        i += 2;
+    }
+    for(; i < argc; ++i)
+        request += (request.empty() ? "" : " ") + std::string(argv[i]);
+    if(request.empty()) {
+        std::cerr << "usage: rtctl [--socket path] render|status|watch|wait|cancel|scenes|shutdown [arguments]\n";
+        return 1;
+    }
+
+    std::string error;
+    int fd = connect_unix(socket_path, error);
+    if(fd < 0) {
+        std::cerr << error << '\n';
+        return 1;
+    }
+    if(!send_line(fd, request)) {
+        std::cerr << "failed to send the request\n";
+        ::close(fd);
+        return 1;
+    }
+    line_reader reader(fd);
+    bool failed = false;
+    for(std::string line; reader.next(line);) {
+        std::cout << line << std::endl; //watch lines show up as they come
+        failed |= line.compare(0, 6, "error ") == 0;
+    }
+    ::close(fd);
+    return failed ? 1 : 0;
+}
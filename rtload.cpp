@@ -0,0 +1,193 @@
+#include "rtweekend.h"
+
+#include "sampler.h"
+#include "unix_socket.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+/* rtload
+
+a load generator for the render daemon (rtserve.cpp): submits jobs with poisson arrivals, small renders of the
+server's scenes at random priorities and sample counts, cancels some of them a moment after submitting, waits
+for every job to end and reports the latency (submit to the final status) per priority, jobs per second and the
+server's Mrays/s over the run
+
+    rtload [--socket path] [--jobs n] [--rate jobs_per_s] [--cancel fraction] [--priorities n] [--width w] [--seed n]
+
+priorities are 0 to n-1, the spread between their p50s is what the scheduler buys the urgent jobs under load
+
+*/
+
+struct load_job {
+    int priority = 0;
+    bool cancel = false;
+    double cancel_after = 0; //seconds after submitting
+    std::string request;
+
+    std::string state = "lost"; //from the final status line, "lost" if the server never gave one
+    double latency = 0;
+    double queued = 0;
+    long long rays = 0;
+};
+
+static std::vector<std::string> exchange(const std::string& socket_path, const std::string& request) {
+    //every response line of one request, nothing if the server can't be reached
+    std::vector<std::string> lines;
+    std::string error;
+    int fd = connect_unix(socket_path, error);
+    if(fd < 0)
+        return lines;
+    if(send_line(fd, request)) {
+        line_reader reader(fd);
+        for(std::string line; reader.next(line);)
+            lines.push_back(line);
+    }
+    ::close(fd);
+    return lines;
+}
+
+static std::string field(const std::string& status, const std::string& name) {
+    //the word after name in a status line
+    std::istringstream words(status);
+    for(std::string word; words >> word;)
+        if(word == name && words >> word)
+            return word;
+    return "";
+}
+
+static void run_job(const std::string& socket_path, load_job& job) {
+    auto start = steady_clock::now();
+    auto submitted = exchange(socket_path, job.request);
+    if(submitted.empty() || submitted[0].compare(0, 4, "job ") != 0) {
+        job.state = submitted.empty() ? "lost" : "rejected";
+        return;
+    }
+    auto id = submitted[0].substr(4);
+    if(job.cancel) {
+        std::this_thread::sleep_for(duration<double>(job.cancel_after));
+        exchange(socket_path, "cancel " + id); //may lose the race against the job ending, the final state tells
+    }
+    auto final_status = exchange(socket_path, "wait " + id);
+    job.latency = duration_cast<microseconds>(steady_clock::now() - start).count() / 1000000.0;
+    if(final_status.empty() || field(final_status[0], "state").empty())
+        return;
+    job.state = field(final_status[0], "state");
+    job.queued = std::stod(field(final_status[0], "queued_s"));
+    job.rays = std::stoll(field(final_status[0], "rays"));
+}
+
+static double percentile(std::vector<double> values, double p) {
+    if(values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    auto index = static_cast<size_t>(std::ceil(p * values.size())) - 1;
+    return values[std::min(index, values.size() - 1)];
+}
+
+int main(int argc, char* argv[]) {
+    std::string socket_path = "rtserve.sock";
+    int job_count = 100;
+    double rate = 10;
+    double cancel_fraction = 0.1;
+    int priorities = 3;
+    int width = 160;
+    uint64_t seed = 1;
+
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--socket" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if(arg == "--jobs" && i + 1 < argc) {
+            job_count = std::max(1, std::stoi(argv[++i]));
+        } else if(arg == "--rate" && i + 1 < argc) {
+            rate = std::max(1e-3, std::stod(argv[++i]));
+        } else if(arg == "--cancel" && i + 1 < argc) {
+            cancel_fraction = std::stod(argv[++i]);
+        } else if(arg == "--priorities" && i + 1 < argc) {
+            priorities = std::max(1, std::stoi(argv[++i]));
+        } else if(arg == "--width" && i + 1 < argc) {
+            width = std::max(1, std::stoi(argv[++i]));
+        } else if(arg == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        } else {
+            std::cerr << "usage: rtload [--socket path] [--jobs n] [--rate jobs_per_s] [--cancel fraction] [--priorities n] [--width w] [--seed n]\n";
+            return 1;
+        }
+    }
+
+    std::vector<std::string> scenes;
+    for(const auto& line : exchange(socket_path, "scenes"))
+        if(line.compare(0, 6, "scene ") == 0)
+            scenes.push_back(line.substr(6));
+    if(scenes.empty()) {
+        std::cerr << "no scenes from a server at " << socket_path << '\n';
+        return 1;
+    }
+
+    sampler s(seed);
+    std::vector<load_job> jobs(job_count);
+    std::vector<double> arrivals(job_count); //seconds from the start
+    double clock = 0;
+    const int spp_choices[] = {8, 16, 32};
+    for(int i = 0; i < job_count; ++i) {
+        auto& job = jobs[i];
+        job.priority = static_cast<int>(s.random_double() * priorities);
+        job.cancel = s.random_double() < cancel_fraction;
+        job.cancel_after = s.random_double(0, 0.5);
+        auto& scene = scenes[static_cast<size_t>(s.random_double() * scenes.size())];
+        auto spp = spp_choices[static_cast<int>(s.random_double() * 3)];
+        job.request = "render " + scene + " width " + std::to_string(width) + " spp " + std::to_string(spp)
+                    + " depth 10 priority " + std::to_string(job.priority) + " seed " + std::to_string(i);
+        clock += -std::log(1 - s.random_double()) / rate; //exponential gaps make the arrivals a poisson process
+        arrivals[i] = clock;
+    }
+
+    std::clog << "submitting " << job_count << " jobs at " << rate << "/s over " << scenes.size() << " scenes\n";
+    auto start = steady_clock::now();
+    std::vector<std::thread> threads;
+    for(int i = 0; i < job_count; ++i) {
+        std::this_thread::sleep_until(start + duration_cast<steady_clock::duration>(duration<double>(arrivals[i])));
+        threads.emplace_back(run_job, std::cref(socket_path), std::ref(jobs[i]));
+    }
+    for(auto& t : threads)
+        t.join();
+    auto wall = duration_cast<microseconds>(steady_clock::now() - start).count() / 1000000.0;
+
+    std::printf("%8s %6s %6s %10s %6s %9s %9s %11s\n", "priority", "jobs", "done", "cancelled", "other", "p50 s", "p95 s", "queued p50");
+    long long rays = 0;
+    int done = 0;
+    for(int p = priorities - 1; p >= 0; --p) {
+        std::vector<double> latencies, queued;
+        int count = 0, finished = 0, cancelled = 0;
+        for(const auto& job : jobs) {
+            if(job.priority != p)
+                continue;
+            ++count;
+            rays += job.rays;
+            if(job.state == "done") {
+                ++finished;
+                latencies.push_back(job.latency);
+                queued.push_back(job.queued);
+            } else if(job.state == "cancelled") {
+                ++cancelled;
+            }
+        }
+        done += finished;
+        std::printf("%8d %6d %6d %10d %6d %9.3f %9.3f %11.3f\n", p, count, finished, cancelled, count - finished - cancelled,
+            percentile(latencies, 0.5), percentile(latencies, 0.95), percentile(queued, 0.5));
+    }
+    std::printf("%.2f s, %.2f jobs/s done, %.2f Mrays/s\n", wall, done / wall, rays / wall / 1e6);
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include "rtweekend.h"
+
+#include "checkpoint.h"
+#include "framebuffer.h"
+#include "image_writer.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* rtmerge
+
+combines the partial accumulation buffers of a distributed render (imageoutput --partial, see render_jobs.sh)
+into the final image: the sample sums and counts of every job are added pixel by pixel, so jobs may split the
+frame by tiles, by sample ranges or both
+
+    rtmerge [--format p3|p6|pfm] [--output path] [--save path] partial...
+
+--save also writes the merged buffer, which can be merged again with more partials later. two partials with
+the same seed and overlapping sample ranges that both cover a pixel would count the same samples twice, that
+is an error; different seeds are independent estimates and always add up. partials rendered with different
+settings (checkpoint_settings: sampler, depth, roulette, light sampling, sky, scene and view) are an error too
+
+exits with 2 (after writing the image) when some pixels got no samples at all, i.e. a job is missing
+
+*/
+
+struct partial_buffer {
+    std::string path;
+    framebuffer image;
+    checkpoint_state state;
+};
+
+static bool overlapping(const partial_buffer& a, const partial_buffer& b) {
+    if(a.state.seed != b.state.seed || a.state.first_sample >= b.state.samples_done || b.state.first_sample >= a.state.samples_done)
+        return false;
+    for(size_t p = 0; p < a.image.size(); ++p)
+        if(a.image.samples(p) > 0 && b.image.samples(p) > 0)
+            return true;
+    return false;
+}
+
+int main(int argc, char* argv[]) {
+    image_format format = image_format::ppm_ascii;
+    std::string output_path; //stdout unless given
+    std::string save_path;
+    std::vector<std::string> inputs;
+
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--format" && i + 1 < argc && parse_image_format(argv[i+1], format)) {
+            ++i;
+        } else if(arg == "--output" && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if(arg == "--save" && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if(!arg.empty() && arg[0] != '-') {
+            inputs.push_back(arg);
+        } else {
+            inputs.clear();
+            break;
+        }
+    }
+    if(inputs.empty()) {
+        std::cerr << "usage: rtmerge [--format p3|p6|pfm] [--output path] [--save path] partial...\n";
+        return 1;
+    }
+
+    std::vector<partial_buffer> partials(inputs.size());
+    for(size_t k = 0; k < inputs.size(); ++k) {
+        partials[k].path = inputs[k];
+        if(!load_checkpoint(inputs[k], partials[k].image, partials[k].state)) {
+            std::cerr << inputs[k] << ": missing, truncated or not an accumulation buffer\n";
+            return 1;
+        }
+        const auto& first = partials[0].image;
+        if(partials[k].image.width() != first.width() || partials[k].image.height() != first.height()) {
+            std::cerr << inputs[k] << " is " << partials[k].image.width() << 'x' << partials[k].image.height()
+                      << ", " << inputs[0] << " is " << first.width() << 'x' << first.height() << '\n';
+            return 1;
+        }
+        auto mismatch = partials[k].state.settings.mismatch(partials[0].state.settings);
+        if(!mismatch.empty()) {
+            std::cerr << inputs[k] << " and " << inputs[0] << " were rendered with a different " << mismatch << '\n';
+            return 1;
+        }
+        for(size_t other = 0; other < k; ++other) {
+            if(overlapping(partials[other], partials[k])) {
+                std::cerr << inputs[other] << " and " << inputs[k] << " both hold some of the same samples\n";
+                return 1;
+            }
+        }
+    }
+
+    framebuffer merged(partials[0].image.width(), partials[0].image.height());
+    checkpoint_state range = partials[0].state; //what --save records: the seed of the first input and the union of the ranges
+    for(const auto& partial : partials) {
+        for(size_t p = 0; p < merged.size(); ++p)
+            merged.add(p, partial.image.sum(p), partial.image.samples(p));
+        range.first_sample = std::min(range.first_sample, partial.state.first_sample);
+        range.samples_done = std::max(range.samples_done, partial.state.samples_done);
+    }
+
+    size_t empty = 0;
+    for(size_t p = 0; p < merged.size(); ++p)
+        empty += merged.samples(p) == 0;
+    std::clog << "merged " << partials.size() << " partial buffers, " << merged.width() << 'x' << merged.height() << '\n';
+    if(empty > 0)
+        std::clog << empty << " pixels have no samples, a job is missing\n";
+
+    if(!save_path.empty() && !save_checkpoint(save_path, merged, range)) {
+        std::cerr << "failed to write " << save_path << '\n';
+        return 1;
+    }
+    bool ok = output_path.empty() ? write_image(STDOUT_FILENO, merged, format) : write_image(output_path, merged, format);
+    if(!ok) {
+        std::cerr << "failed to write the image to " << (output_path.empty() ? "stdout" : output_path) << '\n';
+        return 1;
+    }
+    return empty > 0 ? 2 : 0;
+}
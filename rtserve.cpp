@@ -0,0 +1,141 @@
+#include "rtweekend.h"
+
+#include "render_service.h"
+#include "scene_file.h"
+#include "scenes.h"
+#include "unix_socket.h"
+
+#include <atomic>
+#include <csignal>
+#include <iostream>
+#include <list>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+
+/* rtserve
+
+the render daemon: builds its scenes once, then takes render jobs over a local unix socket until told to shut
+down, so a pipeline of small renders stops paying process start and scene construction for every image. the
+request format is at the top of render_service.h, rtctl.cpp is the command line client and rtload.cpp a load
+generator
+
+    rtserve [--socket path] [--threads n] [--scene name=path]...
+
+the built in scenes are resident as grid (imageoutput's default), glass, instances (instanced_scene(2500)) and
+lit (lit_scene() under a sky of 0.02, meant for the nee setting), --scene adds a scene file (text or binary, see
+scene_file.h) under a name of its own. every connection is served on its own thread, the renders themselves
+share one pool of --threads workers (one per core by default). a client gets 30 seconds to send its
+request line, and a shutdown hangs up on any that are still sending one
+
+*/
+
+static const int request_timeout = 30; //seconds
+
+int main(int argc, char* argv[]) {
+    std::string socket_path = "rtserve.sock";
+    int threads = 0;
+    std::vector<std::pair<std::string, std::string>> scene_files;
+
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value = i + 1 < argc ? argv[i+1] : "";
+        if(arg == "--socket" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if(arg == "--threads" && i + 1 < argc) {
+            threads = std::stoi(argv[++i]);
+        } else if(arg == "--scene" && value.find('=') != std::string::npos && value.find('=') > 0) {
+            scene_files.emplace_back(value.substr(0, value.find('=')), value.substr(value.find('=') + 1));
+            ++i;
+        } else {
+            std::cerr << "usage: rtserve [--socket path] [--threads n] [--scene name=path]...\n";
+            return 1;
+        }
+    }
+    if(threads <= 0)
+        threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    render_service service(threads);
+    auto build_start = high_resolution_clock::now();
+    service.add_scene("grid", sphere_grid_scene());
+    service.add_scene("glass", glass_scene());
+    service.add_scene("instances", instanced_scene(2500));
+    scene_camera night;
+    night.sky_brightness = 0.02;
+    service.add_scene("lit", lit_scene(), night);
+    for(const auto& [name, path] : scene_files) {
+        loaded_scene scene;
+        std::string error;
+        if(!load_scene(path, scene, error)) {
+            std::cerr << error << '\n';
+            return 1;
+        }
+        hittable_list world(scene.world);
+        world.lights = scene.lights;
+        service.add_scene(name, world, scene.camera);
+    }
+    std::clog << "scenes ready in " << duration_cast<microseconds>(high_resolution_clock::now() - build_start).count() / 1000.0 << " ms\n";
+
+    std::string error;
+    int listener = listen_unix(socket_path, error);
+    if(listener < 0) {
+        std::cerr << error << '\n';
+        return 1;
+    }
+    std::signal(SIGPIPE, SIG_IGN); //a client that hangs up is a failed write, not the end of the server
+    std::atomic<bool> stopping(false);
+    service.on_shutdown = [&] {
+        stopping = true;
+        ::shutdown(listener, SHUT_RDWR); //wakes accept() up
+    };
+    std::clog << "listening on " << socket_path << " with " << threads << " render threads\n";
+
+    struct connection {
+        int fd;
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+    std::list<connection> connections;
+    while(!stopping) {
+        int client = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if(client < 0) {
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break; //shut down, or the listener broke
+        }
+        for(auto c = connections.begin(); c != connections.end();) { //join the ones that have finished
+            if(c->done) {
+                c->thread.join();
+                ::close(c->fd); //closed here, not on the thread, so the fd can't be reused while it's in the list
+                c = connections.erase(c);
+            } else {
+                ++c;
+            }
+        }
+        timeval timeout = {request_timeout, 0};
+        ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)); //an idle client doesn't hold its thread forever
+        auto& c = connections.emplace_back();
+        c.fd = client;
+        c.thread = std::thread([&service, client, &done = c.done] {
+            line_reader reader(client);
+            std::string request;
+            if(reader.next(request))
+                service.handle(request, [client](const std::string& line) {return send_line(client, line);});
+            ::shutdown(client, SHUT_RDWR); //the client reads to the end of the stream
+            done = true;
+        });
+    }
+    service.cancel_all();
+    for(auto& c : connections)
+        ::shutdown(c.fd, SHUT_RD); //wakes up the ones still reading a request, responses in flight still go out
+    for(auto& c : connections) {
+        c.thread.join();
+        ::close(c.fd);
+    }
+    ::close(listener);
+    ::unlink(socket_path.c_str());
+    std::clog << "stopped\n";
+    return 0;
+}
@@ -4,12 +4,23 @@
 #include <cmath>
 #include <limits>
 #include <memory>
-#include <cstdlib>
+#include <cstdint>
+
+#include "sampler.h"
 
 using std::shared_ptr;
 using std::make_shared;
 using std::sqrt;
 
+//scalar type of the geometry and shading math (vec3, ray, interval, hit records, primitive storage)
+//-DRT_USE_FLOAT builds everything in float: twice the SIMD lanes and half the memory traffic per primitive,
+//spheres that need the range (huge ground spheres) can still intersect in double, see precise_sphere
+#ifdef RT_USE_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
+
 const double infinity = std::numeric_limits<double>::infinity();
 const double pi = 3.1415926535897932385;
 
@@ -17,9 +28,15 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+inline sampler& thread_sampler() {
+    //per thread stream for code outside the render loop (scene construction), the render loop uses its own samplers
+    static thread_local sampler s;
+    return s;
+}
+
 inline double random_double() {
     //returns a random real in [0,1)
-    return rand() / (RAND_MAX + 1.0);
+    return thread_sampler().random_double();
 }
 
 inline double random_double(double min, double max) {
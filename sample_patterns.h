@@ -0,0 +1,262 @@
+#ifndef SAMPLE_PATTERNS_H
+#define SAMPLE_PATTERNS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/* sample patterns
+
+the point sets behind sampler::sample_1d/sample_2d (see sampler.h), all stateless: a point is a function of
+the sample index and a seed, so any sample of any pixel can be drawn on its own, in any order, on any thread
+
+stratified   correlated multi-jittered sampling (Kensler 2013, "correlated multi-jittered sampling"): N samples
+             fall one per cell of a m x n grid and one per row and column of the fine N x N grid
+sobol        the first two dimensions of the Sobol sequence with hash based Owen scrambling, the index
+             shuffled by another scramble per pixel and per dimension pair (Burley 2020, "practical hash-based
+             owen scrambling"), so more than 2 dimensions are padded from independent 2D sets
+blue noise   one scrambled Sobol set shared by every pixel, each pixel shifting it (Cranley-Patterson rotation)
+             by a blue noise mask value (Georgiev and Fajardo 2016, "blue-noise dithered sampling"): the error
+             left after N samples is still there, but spread as high frequency noise the eye and the denoiser
+             average away. the 64x64 mask is made on first use with Ulichney's void and cluster method
+
+*/
+
+inline uint32_t hash_u32(uint32_t x) {
+    //lowbias32 (Chris Wellons' hash prospector), a full avalanche 32 bit mix
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+inline uint32_t hash_combine(uint32_t seed, uint32_t v) {
+    return seed ^ (v + 0x9e3779b9U + (seed << 6) + (seed >> 2));
+}
+
+inline double u32_to_unit(uint32_t x) {
+    return x * (1.0 / 4294967296.0); //[0,1), exact in a double
+}
+
+inline uint32_t reverse_bits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffU) << 8) | ((x & 0xff00ff00U) >> 8);
+    x = ((x & 0x0f0f0f0fU) << 4) | ((x & 0xf0f0f0f0U) >> 4);
+    x = ((x & 0x33333333U) << 2) | ((x & 0xccccccccU) >> 2);
+    x = ((x & 0x55555555U) << 1) | ((x & 0xaaaaaaaaU) >> 1);
+    return x;
+}
+
+//correlated multi-jittered
+
+inline uint32_t cmj_permute(uint32_t i, uint32_t l, uint32_t p) {
+    //the p-th pseudo random permutation of [0,l) applied to i, Kensler's hash with cycle walking for l that aren't powers of 2
+    uint32_t w = l - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= p;
+        i *= 0xe170893dU;
+        i ^= p >> 16;
+        i ^= (i & w) >> 4;
+        i ^= p >> 8;
+        i *= 0x0929eb3fU;
+        i ^= p >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | p >> 27;
+        i *= 0x6935fa69U;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303U;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3U;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3dfU;
+        i &= w;
+        i ^= i >> 5;
+    } while(i >= l);
+    return (i + p) % l;
+}
+
+inline void cmj_grid(uint32_t n_samples, uint32_t& m, uint32_t& n) {
+    //the m x n cells n_samples points fall into, as square as it gets
+    m = std::max<uint32_t>(1, static_cast<uint32_t>(std::sqrt(static_cast<double>(n_samples))));
+    n = (n_samples + m - 1) / m;
+}
+
+inline void cmj_point(uint32_t s, uint32_t n_samples, uint32_t m, uint32_t n, uint32_t p, double& u, double& v) {
+    //sample s of the p-th correlated multi-jittered set of n_samples points in [0,1)^2, m and n from cmj_grid
+    s = cmj_permute(s, n_samples, p * 0x51633e2dU);
+    auto sx = cmj_permute(s % m, m, p * 0x68bc21ebU);
+    auto sy = cmj_permute(s / m, n, p * 0x02e5be93U);
+    auto jx = u32_to_unit(hash_u32(s ^ (p * 0x967a889bU)));
+    auto jy = u32_to_unit(hash_u32(s ^ (p * 0x368cc8b7U)));
+    u = std::min(((s % m) + (sy + jx) / n) / m, 0x1.fffffffffffffp-1);
+    v = std::min(((s / m) + (sx + jy) / m) / n, 0x1.fffffffffffffp-1);
+}
+
+//owen scrambled sobol
+
+struct sobol_byte_tables {
+    uint32_t bytes[4][256];
+};
+
+constexpr sobol_byte_tables make_sobol_dimension1_tables() {
+    //the second Sobol dimension (primitive polynomial x + 1) is linear over GF(2) in the index bits,
+    //so it's the xor of one table entry per index byte
+    sobol_byte_tables tables{};
+    uint32_t direction[32] = {};
+    direction[0] = 1U << 31;
+    for(int k = 1; k < 32; ++k)
+        direction[k] = direction[k-1] ^ (direction[k-1] >> 1);
+    for(int b = 0; b < 4; ++b) {
+        for(uint32_t x = 0; x < 256; ++x) {
+            uint32_t result = 0;
+            for(int k = 0; k < 8; ++k)
+                if((x >> k) & 1)
+                    result ^= direction[8 * b + k];
+            tables.bytes[b][x] = result;
+        }
+    }
+    return tables;
+}
+
+inline constexpr sobol_byte_tables sobol_dimension1_tables = make_sobol_dimension1_tables();
+
+inline uint32_t sobol_dimension1(uint32_t index) {
+    //the first dimension is reverse_bits(index)
+    const auto& t = sobol_dimension1_tables.bytes;
+    return t[0][index & 0xff] ^ t[1][(index >> 8) & 0xff] ^ t[2][(index >> 16) & 0xff] ^ t[3][index >> 24];
+}
+
+inline uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+    //flips every bit depending on the bits below it, on bit reversed values that's an Owen scramble
+    x += seed;
+    x ^= x * 0x6c50b47cU;
+    x ^= x * 0xb82f1e52U;
+    x ^= x * 0xc7afe638U;
+    x ^= x * 0x8d22f6e6U;
+    return x;
+}
+
+inline uint32_t owen_scramble(uint32_t x, uint32_t seed) {
+    //nested uniform scramble in base 2: every bit flips depending on the bits above it
+    return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+}
+
+inline void sobol_point(uint32_t index, uint32_t seed, double& u, double& v) {
+    //point index of the seed-th shuffled and scrambled 2D Sobol set, seed should be well mixed
+    index = owen_scramble(index, seed);
+    auto x = reverse_bits(laine_karras_permutation(index, seed * 0x9e3779b9U + 1)); //the first dimension is index reversed, scrambled
+    auto y = owen_scramble(sobol_dimension1(index), seed * 0x85ebca6bU + 2);
+    u = u32_to_unit(x);
+    v = u32_to_unit(y);
+}
+
+//blue noise
+
+static const int blue_noise_size = 64; //mask side, it tiles the image
+
+inline std::vector<float> make_blue_noise_mask() {
+    //void and cluster: ranks every cell of the torus so that the first k cells of the ranking are evenly spread
+    //for every k, the mask value is rank / cells. energy is the gaussian weighted count of set cells around a cell
+    const int size = blue_noise_size, cells = size * size;
+    const double sigma = 1.9;
+    std::vector<double> kernel(cells); //by toroidal offset
+    for(int dy = 0; dy < size; ++dy) {
+        for(int dx = 0; dx < size; ++dx) {
+            auto x = std::min(dx, size - dx), y = std::min(dy, size - dy);
+            kernel[dy * size + dx] = std::exp(-(x * x + y * y) / (2 * sigma * sigma));
+        }
+    }
+
+    std::vector<char> set(cells, 0);
+    std::vector<double> energy(cells, 0);
+    auto toggle = [&](int cell, bool on) {
+        set[cell] = on;
+        auto sign = on ? 1.0 : -1.0;
+        int cx = cell % size, cy = cell / size;
+        for(int y = 0; y < size; ++y) {
+            int row = ((y - cy + size) % size) * size;
+            for(int x = 0; x < size; ++x)
+                energy[y * size + x] += sign * kernel[row + (x - cx + size) % size];
+        }
+    };
+    auto tightest_cluster = [&] { //the set cell with the most set neighbours
+        int best = -1;
+        for(int c = 0; c < cells; ++c)
+            if(set[c] && (best < 0 || energy[c] > energy[best]))
+                best = c;
+        return best;
+    };
+    auto largest_void = [&] { //the empty cell with the fewest set neighbours
+        int best = -1;
+        for(int c = 0; c < cells; ++c)
+            if(!set[c] && (best < 0 || energy[c] < energy[best]))
+                best = c;
+        return best;
+    };
+
+    //initial pattern: a tenth of the cells at random, then move the tightest cluster into the largest void until that's a no-op
+    uint32_t state = 0x2545f491U;
+    int ones = 0;
+    while(ones < cells / 10) {
+        state = hash_u32(state);
+        int c = static_cast<int>(state % cells);
+        if(!set[c]) {
+            toggle(c, true);
+            ++ones;
+        }
+    }
+    for(int moves = 0; moves < cells; ++moves) {
+        auto cluster = tightest_cluster();
+        toggle(cluster, false);
+        auto hole = largest_void();
+        toggle(hole, true);
+        if(hole == cluster)
+            break;
+    }
+
+    std::vector<int> rank(cells, 0);
+    auto prototype = set;
+    auto prototype_energy = energy;
+    //ranks below the initial pattern: take out its tightest clusters one at a time
+    for(int r = ones - 1; r >= 0; --r) {
+        auto cluster = tightest_cluster();
+        toggle(cluster, false);
+        rank[cluster] = r;
+    }
+    //ranks from there on: fill the largest void each time. past half full this is also the tightest
+    //cluster of empty cells, since a cell's set and empty energies add up to the same total everywhere
+    set = prototype;
+    energy = prototype_energy;
+    for(int r = ones; r < cells; ++r) {
+        auto hole = largest_void();
+        toggle(hole, true);
+        rank[hole] = r;
+    }
+
+    std::vector<float> mask(cells);
+    for(int c = 0; c < cells; ++c)
+        mask[c] = (rank[c] + 0.5f) / cells;
+    return mask;
+}
+
+inline const std::vector<float>& blue_noise_mask() {
+    static const std::vector<float> mask = make_blue_noise_mask(); //made once, on first use by any thread
+    return mask;
+}
+
+inline double blue_noise_at(const std::vector<float>& mask, uint32_t x, uint32_t y, uint32_t offset) {
+    //the mask tiled over the image, shifted by 12 bits of a well mixed offset so different dimensions see it uncorrelated
+    x = (x + offset) % blue_noise_size;
+    y = (y + (offset >> 6)) % blue_noise_size;
+    return mask[y * blue_noise_size + x];
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "sample_patterns.h"
+
+#include <cstdint>
+#include <string>
+
+enum class sample_pattern {independent, stratified, sobol, blue_noise}; //see sample_patterns.h
+
+inline bool parse_sample_pattern(const std::string& name, sample_pattern& pattern) {
+    if(name == "independent")
+        pattern = sample_pattern::independent;
+    else if(name == "stratified")
+        pattern = sample_pattern::stratified;
+    else if(name == "sobol")
+        pattern = sample_pattern::sobol;
+    else if(name == "bluenoise")
+        pattern = sample_pattern::blue_noise;
+    else
+        return false;
+    return true;
+}
+
+inline uint64_t mix_seed(uint64_t x) {
+    //splitmix64 finalizer, scrambles nearby seeds (neighbouring pixels) into unrelated states
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+class sampler { //a private xoshiro256++ random stream
+    //the camera makes one per pixel from (seed, pixel index, first sample index) and passes it down
+    //through get_ray and material::scatter, so no two pixels or threads ever share generator state
+    //and a pixel's samples are the same no matter which thread renders it
+    //
+    //the decisions a path makes (pixel jitter, each bounce's direction, roulette) draw from sample_1d and
+    //sample_2d instead, which follow the pattern set by begin_sample: every call takes the next dimension
+    //(a 1D draw uses up a whole 2D one) of sample index out of count of the pixel. independent is the stream
+    //itself, every draw a random_double
+    public:
+        sampler() : sampler(0) {}
+
+        explicit sampler(uint64_t seed) {
+            //expand the 64 bit seed into the 256 bit state with splitmix64 (never all zero)
+            for(auto& word : s) {
+                seed += 0x9e3779b97f4a7c15ULL;
+                word = mix_seed(seed);
+            }
+        }
+
+        sampler(uint64_t seed, uint64_t pixel_index, uint64_t stream)
+            : sampler(mix_seed(seed ^ mix_seed(pixel_index ^ mix_seed(stream)))) {}
+
+        uint64_t next_u64() {
+            const uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+            const uint64_t t = s[1] << 17;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = rotl(s[3], 45);
+            return result;
+        }
+
+        double random_double() {
+            //returns a random real in [0,1), the top 53 bits fill a double mantissa exactly
+            return (next_u64() >> 11) * (1.0 / 9007199254740992.0);
+        }
+
+        double random_double(double min, double max) {
+            //returns a random real in [min,max)
+            return min + (max-min) * random_double();
+        }
+
+        void begin_sample(sample_pattern p, uint64_t seed, uint32_t x, uint32_t y, uint32_t index, uint32_t count) {
+            //the next draws are for sample index of pixel x,y, count is how many samples the pixel takes
+            //(the stratified set size, later samples start another set)
+            pattern = p;
+            dimension = 0;
+            pixel_x = x;
+            pixel_y = y;
+            auto image_seed = hash_u32(static_cast<uint32_t>(seed) ^ hash_u32(static_cast<uint32_t>(seed >> 32)));
+            pattern_seed = p == sample_pattern::blue_noise ? image_seed : hash_combine(image_seed, hash_u32(x ^ hash_u32(y)));
+            if(p == sample_pattern::stratified && count > 0) {
+                sample_index = index % count;
+                set_size = count;
+                pattern_seed = hash_combine(pattern_seed, index / count);
+                cmj_grid(count, grid_m, grid_n);
+            } else {
+                sample_index = index;
+                set_size = count > 0 ? count : 1;
+            }
+        }
+
+        bool independent() const {return pattern == sample_pattern::independent;}
+
+        double sample_1d() {
+            if(independent())
+                return random_double();
+            double u, v;
+            sample_2d(u, v);
+            return u;
+        }
+
+        void sample_2d(double& u, double& v) {
+            if(independent()) {
+                u = random_double();
+                v = random_double();
+                return;
+            }
+            auto seed = hash_u32(pattern_seed + 0x9e3779b9U * ++dimension);
+            switch(pattern) {
+                case sample_pattern::stratified:
+                    cmj_point(sample_index, set_size, grid_m, grid_n, seed, u, v);
+                    break;
+                case sample_pattern::blue_noise: {
+                    //shared points, shifted per pixel by the mask at two unrelated offsets
+                    const auto& mask = blue_noise_mask();
+                    sobol_point(sample_index, seed, u, v);
+                    u += blue_noise_at(mask, pixel_x, pixel_y, seed);
+                    v += blue_noise_at(mask, pixel_x, pixel_y, seed >> 12);
+                    u -= u >= 1 ? 1 : 0;
+                    v -= v >= 1 ? 1 : 0;
+                    break;
+                }
+                default:
+                    sobol_point(sample_index, seed, u, v);
+                    break;
+            }
+        }
+
+    private:
+        uint64_t s[4];
+        sample_pattern pattern = sample_pattern::independent;
+        uint32_t dimension = 0; //2D draws taken by the current sample
+        uint32_t sample_index = 0;
+        uint32_t set_size = 1;
+        uint32_t grid_m = 1, grid_n = 1; //stratified cells, see cmj_grid
+        uint32_t pattern_seed = 0; //per pixel, except blue noise where every pixel shares the points
+        uint32_t pixel_x = 0, pixel_y = 0;
+
+        static uint64_t rotl(uint64_t x, int k) {
+            return (x << k) | (x >> (64 - k));
+        }
+};
+
+#endif
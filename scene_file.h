@@ -0,0 +1,506 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "image_writer.h"
+#include "material.h"
+#include "sphere_bvh.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+/* scene files
+
+text form, one statement per line, # starts a comment, materials must come before the spheres using them:
+
+camera aspect_ratio 1.7778 width 400 spp 100 max_depth 50   any subset of the keys, the rest keep their defaults
+camera lookfrom 0 2 3 lookat 0 0 -1 vup 0 1 0 vfov 60         the view, also any subset
+material ground lambertian 0.5 0.5 0.5                      name kind params: lambertian r g b
+material steel metal 0.8 0.8 0.9 0.1                                          metal r g b fuzz
+material glass dielectric 1.5                                                 dielectric index_of_refraction
+material lamp light 8 7 6                                                     light r g b (emitted radiance)
+sphere 0 -1000.5 -1 1000 ground                             center x y z, radius (negative = hollow), material name
+sky 0.05                                                    brightness of the background, 1 unless given
+
+binary form, host byte order, everything a sphere_bvh reads laid out ready to use:
+    scene_file_header
+    material_records at material_offset
+    flat_bvh_nodes at node_offset
+    the cx, cy, cz, radius2, radii (real, so float in float builds) and mat_index (uint32) arrays at their offsets, 64 byte aligned
+
+loading a binary scene maps the file and points a sphere_bvh at it: no parsing, no BVH build and no
+allocation per sphere, only one material object per material. the text form is parsed and built once,
+imageoutput --save-scene writes the binary form to use from then on
+
+*/
+
+enum : uint32_t {scene_view_lookfrom = 1, scene_view_lookat = 2, scene_view_vup = 4};
+
+struct scene_camera { //camera settings from a scene file, 0 = not given so the program's default stays
+    double aspect_ratio = 0;
+    int image_width = 0;
+    int samples_per_pixel = 0;
+    int max_depth = 0;
+    double vfov = 0;
+    double sky_brightness = -1; //negative = not given
+    uint32_t view_given = 0; //which of lookfrom, lookat and vup the file sets, scene_view_* bits
+    point3 lookfrom;
+    point3 lookat;
+    vec3 vup;
+
+    void apply(camera& cam) const {
+        if(aspect_ratio > 0) cam.aspect_ratio = aspect_ratio;
+        if(image_width > 0) cam.image_width = image_width;
+        if(samples_per_pixel > 0) cam.samples_per_pixel = samples_per_pixel;
+        if(max_depth > 0) cam.max_depth = max_depth;
+        if(vfov > 0) cam.vfov = vfov;
+        if(sky_brightness >= 0) cam.sky_brightness = sky_brightness;
+        if(view_given & scene_view_lookfrom) cam.lookfrom = lookfrom;
+        if(view_given & scene_view_lookat) cam.lookat = lookat;
+        if(view_given & scene_view_vup) cam.vup = vup;
+    }
+};
+
+struct material_record { //a material as scene files store it
+    uint32_t kind; //material_kind
+    uint32_t pad;
+    double albedo[3]; //lambertian and metal, emitted radiance of a light
+    double param; //metal: fuzz, dielectric: index of refraction
+};
+
+struct scene_desc { //a parsed text scene, before the BVH is built
+    scene_camera camera;
+    std::vector<material_record> materials;
+    std::vector<sphere_record> spheres;
+};
+
+struct loaded_scene {
+    scene_camera camera;
+    std::vector<material_record> materials; //kept so the scene can be written back out
+    shared_ptr<sphere_bvh> world;
+    std::vector<sphere_light> lights; //world's emissive spheres, for camera::lights
+};
+
+struct scene_file_header {
+    char magic[8]; //"RTSCENE1"
+    uint32_t version;
+    uint32_t material_count;
+    uint64_t node_count;
+    uint64_t slots;
+    double aspect_ratio;
+    int32_t image_width;
+    int32_t samples_per_pixel;
+    int32_t max_depth;
+    int32_t real_size; //bytes per array element, a float build can't map a double scene or back; 0 in older files = 8
+    uint64_t material_offset;
+    uint64_t node_offset;
+    uint64_t array_offsets[6]; //cx, cy, cz, radius2, radii, mat_index
+    //version 2 on, version 1 files have their materials here
+    uint32_t view_given;
+    uint32_t pad;
+    double vfov;
+    double lookfrom[3];
+    double lookat[3];
+    double vup[3];
+    //version 3 on
+    double sky_brightness; //negative = not given
+};
+
+inline constexpr char scene_file_magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '1'};
+inline constexpr uint32_t scene_file_version = 3; //2 added the camera view, 3 the sky
+inline constexpr size_t scene_file_header_v1_size = offsetof(scene_file_header, view_given);
+inline constexpr size_t scene_file_header_v2_size = offsetof(scene_file_header, sky_brightness);
+
+inline material make_material(const material_record& m) {
+    auto albedo = color(m.albedo[0], m.albedo[1], m.albedo[2]);
+    switch(static_cast<material_kind>(m.kind)) {
+        case material_kind::metal: return metal(albedo, m.param);
+        case material_kind::dielectric: return dielectric(m.param);
+        case material_kind::diffuse_light: return diffuse_light(albedo);
+        default: return lambertian(albedo);
+    }
+}
+
+inline std::vector<material> make_materials(const std::vector<material_record>& records) {
+    std::vector<material> mats;
+    mats.reserve(records.size());
+    for(const auto& m : records)
+        mats.push_back(make_material(m));
+    return mats;
+}
+
+class text_reader { //the tokenizer of the line based text formats (scenes here, animations in animation.h)
+    public:
+        text_reader(const char* begin, const char* end) : cursor(begin), stop(end) {}
+
+    protected:
+        const char* cursor;
+        const char* stop;
+        int line = 0;
+
+        void skip_blanks() {
+            while(cursor < stop && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r'))
+                ++cursor;
+        }
+
+        void skip_line() {
+            while(cursor < stop && *cursor != '\n')
+                ++cursor;
+            if(cursor < stop)
+                ++cursor;
+        }
+
+        std::string word() {
+            //next blank separated token on this line, empty at the end of the line
+            skip_blanks();
+            auto first = cursor;
+            while(cursor < stop && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n')
+                ++cursor;
+            return std::string(first, cursor);
+        }
+
+        bool number(double& value) {
+            skip_blanks();
+            if(cursor >= stop || *cursor == '\n')
+                return false;
+            char* end;
+            value = std::strtod(cursor, &end); //the file buffer is null terminated so strtod can't run off it
+            if(end == cursor)
+                return false;
+            cursor = end;
+            return true;
+        }
+
+        bool fail(std::string& error, const std::string& what) const {
+            error = "line " + std::to_string(line) + ": " + what;
+            return false;
+        }
+};
+
+class scene_text_parser : text_reader { //line by line over the whole file in memory, numbers go straight through strtod
+    public:
+        using text_reader::text_reader;
+
+        bool parse(scene_desc& scene, std::string& error) {
+            std::unordered_map<std::string, uint32_t> material_names;
+            while(cursor < stop) {
+                ++line;
+                std::string keyword = word();
+                if(keyword.empty() || keyword[0] == '#') {
+                    skip_line();
+                    continue;
+                }
+
+                if(keyword == "sphere") {
+                    sphere_record s;
+                    double x, y, z;
+                    std::string name;
+                    if(!number(x) || !number(y) || !number(z) || !number(s.radius) || (name = word()).empty())
+                        return fail(error, "sphere needs x y z radius material");
+                    auto found = material_names.find(name);
+                    if(found == material_names.end())
+                        return fail(error, "unknown material " + name);
+                    s.center = point3(x, y, z);
+                    s.material = found->second;
+                    scene.spheres.push_back(s);
+                } else if(keyword == "material") {
+                    material_record m = {};
+                    std::string name = word();
+                    std::string kind = word();
+                    bool ok;
+                    if(kind == "lambertian") {
+                        m.kind = static_cast<uint32_t>(material_kind::lambertian);
+                        ok = number(m.albedo[0]) && number(m.albedo[1]) && number(m.albedo[2]);
+                    } else if(kind == "metal") {
+                        m.kind = static_cast<uint32_t>(material_kind::metal);
+                        ok = number(m.albedo[0]) && number(m.albedo[1]) && number(m.albedo[2]) && number(m.param);
+                    } else if(kind == "dielectric") {
+                        m.kind = static_cast<uint32_t>(material_kind::dielectric);
+                        ok = number(m.param);
+                    } else if(kind == "light") {
+                        m.kind = static_cast<uint32_t>(material_kind::diffuse_light);
+                        ok = number(m.albedo[0]) && number(m.albedo[1]) && number(m.albedo[2]);
+                    } else {
+                        return fail(error, "unknown material kind " + kind);
+                    }
+                    if(!ok || name.empty())
+                        return fail(error, "bad parameters for material " + name);
+                    material_names[name] = static_cast<uint32_t>(scene.materials.size());
+                    scene.materials.push_back(m);
+                } else if(keyword == "sky") {
+                    if(!number(scene.camera.sky_brightness) || scene.camera.sky_brightness < 0)
+                        return fail(error, "sky needs a brightness of 0 or more");
+                } else if(keyword == "camera") {
+                    for(std::string key = word(); !key.empty() && key[0] != '#'; key = word()) {
+                        if(key == "lookfrom" || key == "lookat" || key == "vup") {
+                            double x, y, z;
+                            if(!number(x) || !number(y) || !number(z))
+                                return fail(error, "camera " + key + " needs x y z");
+                            auto& target = key == "lookfrom" ? scene.camera.lookfrom : key == "lookat" ? scene.camera.lookat : scene.camera.vup;
+                            target = vec3(x, y, z);
+                            scene.camera.view_given |= key == "lookfrom" ? scene_view_lookfrom : key == "lookat" ? scene_view_lookat : scene_view_vup;
+                            continue;
+                        }
+                        double value;
+                        if(!number(value))
+                            return fail(error, "camera " + key + " needs a value");
+                        if(key == "aspect_ratio") scene.camera.aspect_ratio = value;
+                        else if(key == "width") scene.camera.image_width = static_cast<int>(value);
+                        else if(key == "spp") scene.camera.samples_per_pixel = static_cast<int>(value);
+                        else if(key == "max_depth") scene.camera.max_depth = static_cast<int>(value);
+                        else if(key == "vfov") scene.camera.vfov = value;
+                        else return fail(error, "unknown camera setting " + key);
+                    }
+                } else {
+                    return fail(error, "unknown statement " + keyword);
+                }
+                auto rest = word();
+                if(!rest.empty() && rest[0] != '#')
+                    return fail(error, "trailing text after " + keyword);
+                skip_line();
+            }
+            return true;
+        }
+};
+
+inline bool parse_scene_text(const std::string& text, scene_desc& scene, std::string& error) {
+    scene_text_parser parser(text.c_str(), text.c_str() + text.size());
+    return parser.parse(scene, error);
+}
+
+inline bool read_file(const std::string& path, std::string& contents) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat info;
+    bool ok = ::fstat(fd, &info) == 0;
+    if(ok) {
+        contents.resize(static_cast<size_t>(info.st_size));
+        ok = contents.empty() || read_all(fd, &contents[0], contents.size());
+    }
+    ::close(fd);
+    return ok;
+}
+
+inline bool map_scene_binary(const std::string& path, loaded_scene& scene, std::string& error) {
+    //maps the file read only and builds a sphere_bvh over the mapping, the mapping lives as long as the scene does
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+    struct stat info;
+    if(::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < scene_file_header_v1_size) {
+        ::close(fd);
+        error = "too short for a scene file";
+        return false;
+    }
+    auto size = static_cast<size_t>(info.st_size);
+    void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapped == MAP_FAILED) {
+        error = std::strerror(errno);
+        return false;
+    }
+    std::shared_ptr<const void> mapping(mapped, [size](const void* p) {::munmap(const_cast<void*>(p), size);});
+    auto* base = static_cast<const char*>(mapped);
+
+    scene_file_header header = {};
+    std::memcpy(&header, base, scene_file_header_v1_size);
+    if(std::memcmp(header.magic, scene_file_magic, sizeof(header.magic)) != 0 || header.version < 1 || header.version > scene_file_version) {
+        error = "not a version 1 to " + std::to_string(scene_file_version) + " binary scene";
+        return false;
+    }
+    header.sky_brightness = -1;
+    if(header.version >= 2) {
+        auto header_size = header.version >= 3 ? sizeof(header) : scene_file_header_v2_size;
+        if(size < header_size) {
+            error = "truncated or corrupt binary scene";
+            return false;
+        }
+        std::memcpy(&header, base, header_size);
+    }
+
+    //every section has to fit in the file and keep the alignment the kernels load with
+    auto fits = [&](uint64_t offset, uint64_t count, size_t element) {
+        return offset % 64 == 0 && offset <= size && count <= (size - offset) / element;
+    };
+    bool ok = fits(header.material_offset, header.material_count, sizeof(material_record))
+           && fits(header.node_offset, header.node_count, sizeof(flat_bvh_node))
+           && header.slots % sphere_bvh::leaf_size == 0;
+    auto real_size = header.real_size == 0 ? 8 : header.real_size;
+    if(real_size != static_cast<int32_t>(sizeof(real))) {
+        error = "saved with " + std::to_string(real_size * 8) + " bit geometry, this build uses " + std::to_string(sizeof(real) * 8) + " bit; save it again from the text form";
+        return false;
+    }
+    for(int a = 0; a < 5; ++a)
+        ok = ok && fits(header.array_offsets[a], header.slots, sizeof(real));
+    ok = ok && fits(header.array_offsets[5], header.slots, sizeof(uint32_t));
+    if(!ok) {
+        error = "truncated or corrupt binary scene";
+        return false;
+    }
+
+    sphere_bvh_arrays arrays;
+    arrays.nodes = reinterpret_cast<const flat_bvh_node*>(base + header.node_offset);
+    arrays.node_count = header.node_count;
+    arrays.cx = reinterpret_cast<const real*>(base + header.array_offsets[0]);
+    arrays.cy = reinterpret_cast<const real*>(base + header.array_offsets[1]);
+    arrays.cz = reinterpret_cast<const real*>(base + header.array_offsets[2]);
+    arrays.radius2 = reinterpret_cast<const real*>(base + header.array_offsets[3]);
+    arrays.radii = reinterpret_cast<const real*>(base + header.array_offsets[4]);
+    arrays.mat_index = reinterpret_cast<const uint32_t*>(base + header.array_offsets[5]);
+    arrays.slots = header.slots;
+
+    //indices the traversal follows without checking (child and leaf offsets, split axes, material indices), one
+    //pass over the nodes and material indices. nodes are depth first, so children come after their parents and
+    //the depth bound can be checked on the way
+    std::vector<uint8_t> depth(arrays.node_count, 0);
+    for(size_t n = 0; n < arrays.node_count && ok; ++n) {
+        const auto& node = arrays.nodes[n];
+        if(node.count > 0) {
+            ok = node.offset % sphere_bvh::leaf_size == 0 && node.count <= sphere_bvh::leaf_size && node.offset + node.count <= arrays.slots;
+        } else {
+            ok = node.offset > n + 1 && node.offset < arrays.node_count && node.axis < 3 && depth[n] + 1 < flat_bvh_max_depth;
+            if(ok) { //a child two parents point at is as deep as the deeper one, its parents all come before it
+                auto child_depth = static_cast<uint8_t>(depth[n] + 1);
+                depth[n + 1] = std::max(depth[n + 1], child_depth);
+                depth[node.offset] = std::max(depth[node.offset], child_depth);
+            }
+        }
+    }
+    for(size_t i = 0; i < arrays.slots && ok; ++i)
+        ok = arrays.mat_index[i] < header.material_count;
+    if(!ok) {
+        error = "corrupt BVH or material index in binary scene";
+        return false;
+    }
+
+    auto* records = reinterpret_cast<const material_record*>(base + header.material_offset);
+    scene.materials.assign(records, records + header.material_count);
+    scene.camera.aspect_ratio = header.aspect_ratio;
+    scene.camera.image_width = header.image_width;
+    scene.camera.samples_per_pixel = header.samples_per_pixel;
+    scene.camera.max_depth = header.max_depth;
+    scene.camera.vfov = header.vfov;
+    scene.camera.view_given = header.view_given;
+    scene.camera.lookfrom = point3(header.lookfrom[0], header.lookfrom[1], header.lookfrom[2]);
+    scene.camera.lookat = point3(header.lookat[0], header.lookat[1], header.lookat[2]);
+    scene.camera.vup = vec3(header.vup[0], header.vup[1], header.vup[2]);
+    scene.camera.sky_brightness = header.sky_brightness;
+    scene.world = make_shared<sphere_bvh>(arrays, std::move(mapping), make_materials(scene.materials));
+    scene.lights = scene.world->lights();
+    return true;
+}
+
+inline bool load_scene(const std::string& path, loaded_scene& scene, std::string& error) {
+    //binary scenes are recognised by their magic, anything else is parsed as text and built
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        error = path + ": " + std::strerror(errno);
+        return false;
+    }
+    char magic[sizeof(scene_file_magic)] = {};
+    bool binary = read_all(fd, magic, sizeof(magic)) && std::memcmp(magic, scene_file_magic, sizeof(magic)) == 0;
+    ::close(fd);
+
+    if(binary) {
+        if(!map_scene_binary(path, scene, error)) {
+            error = path + ": " + error;
+            return false;
+        }
+        return true;
+    }
+
+    std::string text;
+    scene_desc desc;
+    if(!read_file(path, text)) {
+        error = path + ": " + std::strerror(errno);
+        return false;
+    }
+    if(!parse_scene_text(text, desc, error)) {
+        error = path + ": " + error;
+        return false;
+    }
+    scene.camera = desc.camera;
+    scene.materials = desc.materials;
+    scene.world = make_shared<sphere_bvh>(desc.spheres, make_materials(desc.materials));
+    scene.lights = scene.world->lights();
+    return true;
+}
+
+inline bool save_scene_binary(const std::string& path, const loaded_scene& scene) {
+    //writes the built arrays as they are so loading is a map and a pointer per array
+    const auto& arrays = scene.world->arrays();
+    auto align = [](size_t offset) {return (offset + 63) / 64 * 64;};
+
+    scene_file_header header = {};
+    std::memcpy(header.magic, scene_file_magic, sizeof(header.magic));
+    header.version = scene_file_version;
+    header.material_count = static_cast<uint32_t>(scene.materials.size());
+    header.node_count = arrays.node_count;
+    header.slots = arrays.slots;
+    header.aspect_ratio = scene.camera.aspect_ratio;
+    header.image_width = scene.camera.image_width;
+    header.samples_per_pixel = scene.camera.samples_per_pixel;
+    header.max_depth = scene.camera.max_depth;
+    header.real_size = sizeof(real);
+    header.view_given = scene.camera.view_given;
+    header.vfov = scene.camera.vfov;
+    header.sky_brightness = scene.camera.sky_brightness;
+    for(int a = 0; a < 3; ++a) {
+        header.lookfrom[a] = scene.camera.lookfrom[a];
+        header.lookat[a] = scene.camera.lookat[a];
+        header.vup[a] = scene.camera.vup[a];
+    }
+
+    struct section {const void* data; size_t bytes;};
+    section sections[8] = {
+        {scene.materials.data(), scene.materials.size() * sizeof(material_record)},
+        {arrays.nodes, arrays.node_count * sizeof(flat_bvh_node)},
+        {arrays.cx, arrays.slots * sizeof(real)},
+        {arrays.cy, arrays.slots * sizeof(real)},
+        {arrays.cz, arrays.slots * sizeof(real)},
+        {arrays.radius2, arrays.slots * sizeof(real)},
+        {arrays.radii, arrays.slots * sizeof(real)},
+        {arrays.mat_index, arrays.slots * sizeof(uint32_t)},
+    };
+    uint64_t offsets[8];
+    size_t size = align(sizeof(header));
+    for(int k = 0; k < 8; ++k) {
+        offsets[k] = size;
+        size = align(size + sections[k].bytes);
+    }
+    header.material_offset = offsets[0];
+    header.node_offset = offsets[1];
+    for(int a = 0; a < 6; ++a)
+        header.array_offsets[a] = offsets[a + 2];
+
+    std::string buffer(size, '\0');
+    std::memcpy(&buffer[0], &header, sizeof(header));
+    for(int k = 0; k < 8; ++k)
+        if(sections[k].bytes > 0)
+            std::memcpy(&buffer[offsets[k]], sections[k].data, sections[k].bytes);
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return false;
+    bool ok = write_all(fd, buffer.data(), buffer.size());
+    return ::close(fd) == 0 && ok;
+}
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "rtweekend.h"
+
+#include "bvh.h"
+#include "color.h"
+#include "hittable_list.h"
+#include "instance.h"
+#include "material.h"
+#include "sphere.h"
+#include "sphere_bvh.h"
+#include "sphere_soa.h"
+
+#include <vector>
+
+/* scenes
+
+worlds shared by imageoutput and the benchmarks, each returned ready to render (already inside a BVH)
+
+spheres, materials and sphere_soa groups are made in the world's arena (arena.h) rather than with make_shared,
+the returned list takes the arena along since its BVH points into it. instanced_scene places a few sphere_bvh
+objects many times through an instance_bvh (instance.h)
+
+*/
+
+inline hittable_list sphere_grid_scene() {
+    //the default imageoutput scene: a dark metal floor under a 22x22 grid of small random spheres
+    thread_sampler() = sampler(); //restart the construction stream so every call builds the same grid
+    hittable_list world;
+
+    auto material_ground = world.arena.make<metal>(color(0.05,0.05,0.2), 0.15);
+    /*auto material_center = make_shared<dielectric>(1.5);
+    auto material_left = make_shared<dielectric>(1.5);
+    auto material_right = make_shared<metal>(color(0.8,0.6,0.2), 0.3);
+    auto material_5 = make_shared<lambertian>(color(0.8,0.1,0.7));
+    auto material_6 = make_shared<metal>(color(0.0,0.0,0.2),0.01);
+
+                                    //center x y z         radius   material
+    world.add(make_shared<sphere>(point3(0.0,-100.5,-1.0), 100.0, material_ground));
+    world.add(make_shared<sphere>(point3(0.0, 0.0, -1.0), 0.5, material_center));
+    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), -0.4, material_left));
+    world.add(make_shared<sphere>(point3(1.0, 0.0, -1.0), 0.5, material_right));
+    world.add(make_shared<sphere>(point3(1.2, 0.0, -.8), 0.1, material_5));
+    world.add(make_shared<sphere>(point3(0.6, 0.0, -3.0), 0.2, material_6));*/
+    world.add(world.arena.make<precise_sphere>(point3(0.0,-100.35,-1.0), 100.0, material_ground)); //float can't resolve the grazing hits on it
+
+    std::vector<sphere_desc> grid; //the small spheres go into SIMD sphere_soa groups below
+
+    for(int a = -3; a < 19; a++) {
+        for(int b = -3; b < 19; b++) {
+            auto choose_mat = random_double();
+            point3 center(a + 0.9 * random_double(), -0.25, b + 0.9*random_double());
+            if((center - point3(4, 0.2, 0)).length() > 0.9) {
+                shared_ptr<material> sphere_material;
+                if(choose_mat < 0.4) { //diffuse material
+                    auto albedo = color::random() * color::random();
+                    sphere_material = world.arena.make<lambertian>(albedo);
+                    grid.push_back(sphere_desc{center, 0.1, sphere_material});
+                } else if(choose_mat < 0.75) { //metal material
+                    auto albedo = color::random(0.5, 1);
+                    auto fuzz = random_double(0, 0.5);
+                    sphere_material = world.arena.make<metal>(albedo, fuzz);
+                    grid.push_back(sphere_desc{center, 0.2, sphere_material});
+                } else if(choose_mat < 0.88) { //glass material
+                    sphere_material = world.arena.make<dielectric>(2.2);
+                    grid.push_back(sphere_desc{center, 0.1, sphere_material});
+                } else { //bubble
+                    sphere_material = world.arena.make<dielectric>(1.5);
+                    grid.push_back(sphere_desc{center, -0.3, sphere_material});
+                }
+            }
+        }
+    }
+
+    for(const auto& group : make_sphere_groups(grid, 16, &world.arena).objects)
+        world.add(group);
+
+    hittable_list scene(make_shared<flat_bvh>(world)); //replace the flat list with a single BVH over it
+    scene.arena = world.arena;
+    return scene;
+}
+
+inline hittable_list glass_scene() {
+    //glass heavy: rows of solid glass balls and hollow bubbles over a grey floor, most paths refract many times
+    hittable_list world;
+
+    auto ground = world.arena.make<lambertian>(color(0.5,0.5,0.5));
+    auto glass = world.arena.make<dielectric>(1.5);
+    auto dense_glass = world.arena.make<dielectric>(2.2);
+    world.add(world.arena.make<precise_sphere>(point3(0.0,-1000.5,-1.0), 1000.0, ground));
+
+    for(int row = 0; row < 6; row++) {
+        for(int col = -4; col <= 4; col++) {
+            point3 center(0.55 * col, -0.25, -1.2 - 0.6 * row);
+            if((row + col) % 3 == 0) { //bubble: glass shell around an air pocket (negative radius)
+                world.add(world.arena.make<sphere>(center, 0.25, glass));
+                world.add(world.arena.make<sphere>(center, -0.22, glass));
+            } else {
+                world.add(world.arena.make<sphere>(center, 0.25, (row + col) % 3 == 1 ? glass : dense_glass));
+            }
+        }
+    }
+
+    hittable_list scene(make_shared<flat_bvh>(world));
+    scene.arena = world.arena;
+    return scene;
+}
+
+inline hittable_list lit_scene() {
+    //a few balls lit by two small lamps, meant for a dim sky (camera::sky_brightness around 0.02) where most of
+    //the light comes from the lamps; the scene light_sampling was made for, world.lights lists the lamps
+    hittable_list world;
+
+    auto ground = world.arena.make<lambertian>(color(0.6,0.6,0.6));
+    auto red = world.arena.make<lambertian>(color(0.7,0.2,0.2));
+    auto steel = world.arena.make<metal>(color(0.8,0.8,0.9), 0.2);
+    auto glass = world.arena.make<dielectric>(1.5);
+    auto lamp = color(40,36,30), blue_lamp = color(5,10,30);
+    world.add(world.arena.make<precise_sphere>(point3(0.0,-1000.5,-1.5), 1000.0, ground));
+    world.add(world.arena.make<sphere>(point3(0.0,0.0,-1.5), 0.5, red));
+    world.add(world.arena.make<sphere>(point3(-1.1,0.0,-1.7), 0.5, steel));
+    world.add(world.arena.make<sphere>(point3(1.1,0.0,-1.5), 0.5, glass));
+    world.add(world.arena.make<sphere>(point3(0.6,1.2,-0.9), 0.08, world.arena.make<diffuse_light>(lamp)));
+    world.add(world.arena.make<sphere>(point3(-1.5,0.6,-0.2), 0.12, world.arena.make<diffuse_light>(blue_lamp)));
+
+    hittable_list scene(make_shared<flat_bvh>(world));
+    scene.arena = world.arena;
+    scene.lights = {{point3(0.6,1.2,-0.9), 0.08, lamp}, {point3(-1.5,0.6,-0.2), 0.12, blue_lamp}};
+    return scene;
+}
+
+inline hittable_list sphere_field_scene(int n) {
+    //n random spheres (about one per unit cube) in a cube fully in view of the default camera,
+    //sharing a small palette of materials; for scaling tests from thousands to millions of spheres
+    sampler s(static_cast<uint64_t>(n));
+    scene_arena arena;
+    std::vector<shared_ptr<material>> palette;
+    for(int m = 0; m < 16; m++) {
+        auto albedo = color(s.random_double(0.2, 1), s.random_double(0.2, 1), s.random_double(0.2, 1));
+        if(m < 10)
+            palette.push_back(arena.make<lambertian>(albedo));
+        else if(m < 14)
+            palette.push_back(arena.make<metal>(albedo, s.random_double(0, 0.4)));
+        else
+            palette.push_back(arena.make<dielectric>(1.5));
+    }
+
+    auto half = 0.5 * std::cbrt(static_cast<double>(n));
+    auto center_z = -(2 * half + 1);
+    std::vector<sphere_desc> spheres;
+    spheres.reserve(n);
+    for(int i = 0; i < n; i++) {
+        point3 center(s.random_double(-half, half), s.random_double(-half, half), center_z + s.random_double(-half, half));
+        spheres.push_back(sphere_desc{center, s.random_double(0.05, 0.3), palette[s.next_u64() % palette.size()]});
+    }
+
+    arena.reserve<sphere_soa>((spheres.size() + 15) / 16 * 2); //the median splits leave groups of 8 to 16
+    hittable_list scene(make_shared<flat_bvh>(make_sphere_groups(std::move(spheres), 16, &arena)));
+    scene.arena = arena;
+    return scene;
+}
+
+inline hittable_list instanced_scene(int copies) {
+    //copies instances of three small sphere objects (a shrub, a snowman, a ring) strewn over a floor in front of
+    //the camera, each turned, tilted and scaled its own way and a third of them in a material of their own.
+    //the objects are built once, so memory is the three objects plus the instances however many there are
+    sampler s(static_cast<uint64_t>(copies));
+    hittable_list world;
+    auto floor = world.arena.make<lambertian>(color(0.45,0.45,0.4));
+    world.add(world.arena.make<precise_sphere>(point3(0.0,-1000.5,-1.0), 1000.0, floor));
+
+    std::vector<shared_ptr<hittable>> objects; //object space, standing on y = 0
+    {
+        std::vector<sphere_record> shrub; //a loose ball of leaves
+        while(shrub.size() < 48) {
+            point3 p(s.random_double(-1,1), s.random_double(-1,1), s.random_double(-1,1));
+            if(p.length_squared() <= 1)
+                shrub.push_back({0.3 * p + vec3(0, 0.35, 0), s.random_double(0.05, 0.12), static_cast<uint32_t>(s.next_u64() % 3)});
+        }
+        objects.push_back(make_shared<sphere_bvh>(shrub, std::vector<material>{
+            lambertian(color(0.1,0.35,0.08)), lambertian(color(0.2,0.5,0.1)), lambertian(color(0.35,0.45,0.05))}));
+    }
+    {
+        std::vector<sphere_record> snowman = {{point3(0, 0.25, 0), 0.25, 0}, {point3(0, 0.6, 0), 0.17, 0}, {point3(0, 0.84, 0), 0.1, 0},
+                                              {point3(-0.035, 0.87, 0.09), 0.015, 1}, {point3(0.035, 0.87, 0.09), 0.015, 1}};
+        objects.push_back(make_shared<sphere_bvh>(snowman, std::vector<material>{lambertian(color(0.9,0.9,0.9)), metal(color(0.1,0.1,0.1), 0.1)}));
+    }
+    {
+        std::vector<sphere_record> ring; //beads on a circle, tilted by the instances
+        for(int i = 0; i < 24; i++) {
+            auto angle = 2 * pi * i / 24;
+            ring.push_back({point3(0.3 * std::cos(angle), 0.4, 0.3 * std::sin(angle)), 0.06, static_cast<uint32_t>(i % 2)});
+        }
+        objects.push_back(make_shared<sphere_bvh>(ring, std::vector<material>{metal(color(0.9,0.75,0.4), 0.05), dielectric(1.5)}));
+    }
+
+    std::vector<shared_ptr<material>> palette;
+    for(int m = 0; m < 8; m++) {
+        auto albedo = color(s.random_double(0.2, 1), s.random_double(0.2, 1), s.random_double(0.2, 1));
+        if(m < 5)
+            palette.push_back(world.arena.make<lambertian>(albedo));
+        else
+            palette.push_back(world.arena.make<metal>(albedo, s.random_double(0, 0.3)));
+    }
+
+    auto instances = make_shared<instance_bvh>();
+    auto side = std::max(1, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(copies)))));
+    auto spacing = 1.2;
+    for(int i = 0; i < copies; i++) {
+        auto x = spacing * (i % side - 0.5 * (side - 1)) + s.random_double(-0.3, 0.3);
+        auto z = -1.5 - spacing * (i / side) + s.random_double(-0.3, 0.3);
+        auto place = affine_transform::translate(vec3(x, -0.5, z))
+                   * affine_transform::rotate(vec3(0,1,0), s.random_double(0, 360))
+                   * affine_transform::rotate(vec3(1,0,0), s.random_double(-20, 20))
+                   * affine_transform::scale(s.random_double(0.6, 1.4));
+        const auto& object = objects[s.next_u64() % objects.size()];
+        instances->add(object, place, s.random_double() < 1.0 / 3 ? palette[s.next_u64() % palette.size()] : nullptr);
+    }
+    instances->build();
+    world.add(instances);
+
+    hittable_list scene(make_shared<flat_bvh>(world));
+    scene.arena = world.arena;
+    return scene;
+}
+
+#endif
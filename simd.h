@@ -0,0 +1,25 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RT_SIMD_X86 1
+#endif
+
+//instruction sets the hand written kernels come in (sphere_soa.h, denoise.h), picked at runtime so one binary runs everywhere
+enum class simd_level {scalar, sse2, avx2, avx512};
+
+inline simd_level detected_simd_level() {
+    //widest instruction set this cpu runs, checked once
+#ifdef RT_SIMD_X86
+    static const simd_level level = __builtin_cpu_supports("avx512f") ? simd_level::avx512
+                                  : __builtin_cpu_supports("avx2") ? simd_level::avx2
+                                  : __builtin_cpu_supports("sse2") ? simd_level::sse2
+                                  : simd_level::scalar;
+    return level;
+#else
+    return simd_level::scalar;
+#endif
+}
+
+#endif
@@ -2,43 +2,76 @@
 #define SPHERE_H
 
 #include "hittable.h"
+#include "stats.h"
 #include "vec3.h"
 
-class sphere : public hittable {
+template<typename T>
+inline bool sphere_roots(const basic_vec3<T>& oc, const basic_vec3<T>& dir, T radius2, T& root1, T& root2) {
+    //both roots of |oc + t dir|^2 = radius2, root1 <= root2, false if the ray misses
+    //the textbook discriminant b^2 - ac subtracts two huge numbers once the sphere is far away compared to its
+    //radius, which in float loses every digit. this is the form from ray tracing gems ch. 7: compare radius2 with
+    //the squared distance from the center to the line, and get the near root from c/q instead of a difference
+    //the sphere_soa kernels do the same operations in the same order, so both pick the same hits
+    T a = dir.length_squared();
+    T inv_a = 1 / a;
+    T half_b = dot(oc, dir);
+    auto to_line = oc - (half_b * inv_a) * dir; //center to the closest point of the line
+    T discriminant = radius2 - to_line.length_squared();
+    if(!(discriminant >= 0))
+        return false;
+    T c = oc.length_squared() - radius2;
+    T q = -(half_b + std::copysign(sqrt(a * discriminant), half_b));
+    T t0 = c / q;
+    T t1 = q * inv_a;
+    root1 = fmin(t0, t1);
+    root2 = fmax(t0, t1);
+    return true;
+}
+
+template<typename P>
+class basic_sphere : public hittable { //intersects in P whatever real is, see precise_sphere
     public:
-        sphere(point3 _center, double _radius, shared_ptr<material> _material) : center(_center), radius(_radius), mat(_material) {}
+        basic_sphere(point3 _center, double _radius, shared_ptr<material> _material) : center(_center), radius(_radius), mat(_material) {
+            auto rvec = vec3(fabs(radius), fabs(radius), fabs(radius)); //negative radius (bubbles) still spans the same box
+            bbox = aabb(_center - rvec, _center + rvec);
+        }
 
         bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-            vec3 oc = r.origin() - center;
-            auto a = r.direction().length_squared();
-            auto half_b = dot(oc, r.direction());
-            auto c = oc.length_squared() - radius*radius;
-            
-            auto discriminant = half_b*half_b - a*c;
-            if(discriminant < 0)
+            RT_STAT(hit_calls, 1);
+            RT_STAT(primitive_tests, 1);
+            basic_ray<P> pr(r);
+            P root1, root2;
+            if(!sphere_roots(pr.origin() - center, pr.direction(), radius*radius, root1, root2))
                 return false;
-            auto sqrtd = sqrt(discriminant);
 
             //find nearest root that lies in the acceptable range (tmin to tmax
-            auto root = (-half_b - sqrtd) / a;
-            if(!ray_t.surrounds(root)) {
-                root = (-half_b + sqrtd) / a;
-                if(!ray_t.surrounds(root))
+            basic_interval<P> t_range(ray_t.min, ray_t.max);
+            auto root = root1;
+            if(!t_range.surrounds(root)) {
+                root = root2;
+                if(!t_range.surrounds(root))
                     return false;
             }
 
-            rec.t = root;
-            rec.p = r.at(rec.t);
-            vec3 outward_normal = (rec.p - center) / radius;
+            rec.t = static_cast<real>(root);
+            rec.p = point3(pr.at(root));
+            vec3 outward_normal((pr.at(root) - center) / radius);
             rec.set_face_normal(r, outward_normal);
-            rec.mat = mat;
+            rec.mat = mat.get();
 
             return true;
         }
+
+        aabb bounding_box() const override {return bbox;}
+
     private:
-        point3 center;
-        double radius;
+        basic_vec3<P> center;
+        P radius;
         shared_ptr<material> mat;
+        aabb bbox;
 };
 
-#endif
\ No newline at end of file
+using sphere = basic_sphere<real>;
+using precise_sphere = basic_sphere<double>; //for spheres that are huge next to the scene (ground planes), same as sphere in double builds
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef SPHERE_BVH_H
+#define SPHERE_BVH_H
+
+#include "rtweekend.h"
+
+#include "aligned_allocator.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "lights.h"
+#include "material.h"
+#include "sphere_soa.h"
+#include "stats.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/* sphere_bvh
+
+a whole sphere field as one hittable: a flat BVH whose leaves are runs of up to 8 (16 in float builds) spheres in shared
+structure of arrays storage, tested with the sphere_soa batch kernels. unlike flat_bvh over sphere_soa
+groups there is no object per group or per sphere, the scene is a handful of flat arrays
+
+the arrays are either built here (owned) or point into memory someone else keeps alive, which is how
+scene_file.h maps a binary scene straight into the renderer without copying or allocating per sphere
+
+spheres can be moved between frames (animation.h): move_sphere updates a center and refit recomputes every
+node box bottom up in one pass over the nodes, keeping the tree. much cheaper than a rebuild, but the tree
+degrades if spheres travel far from where it was built. moving spheres of a mapped scene copies the arrays first
+
+*/
+
+struct sphere_record { //one sphere as scene files and the builder see it
+    point3 center;
+    double radius;
+    uint32_t material; //index into the scene's material list
+};
+
+struct sphere_bvh_arrays { //everything traversal reads, leaf runs start on leaf_size boundaries, padding lanes are NaN
+    const flat_bvh_node* nodes = nullptr;
+    size_t node_count = 0;
+    const real* cx = nullptr;
+    const real* cy = nullptr;
+    const real* cz = nullptr;
+    const real* radius2 = nullptr;
+    const real* radii = nullptr; //signed, for the normal of hollow (negative radius) spheres
+    const uint32_t* mat_index = nullptr;
+    size_t slots = 0; //array length including padding
+};
+
+class sphere_bvh : public hittable {
+    public:
+        static const int leaf_size = sphere_soa::lane_padding; //one AVX-512 batch per leaf
+
+        sphere_bvh(const std::vector<sphere_record>& spheres, std::vector<material> mats)
+          : materials(std::move(mats)), kernel(sphere_batch_kernel_for(detected_simd_level())) {
+            auto built = std::make_shared<owned_arrays>();
+            if(!spheres.empty()) {
+                std::vector<bvh_primitive> prims(spheres.size());
+                for(size_t i = 0; i < spheres.size(); ++i) {
+                    auto r = fabs(spheres[i].radius);
+                    prims[i].box = aabb(spheres[i].center - vec3(r, r, r), spheres[i].center + vec3(r, r, r));
+                    prims[i].centroid = spheres[i].center;
+                    prims[i].index = i;
+                }
+                built->nodes.reserve(2 * (spheres.size() / leaf_size + 1));
+                build(*built, spheres, prims);
+            }
+            use_owned(built);
+            set_bbox();
+        }
+
+        sphere_bvh(const sphere_bvh_arrays& arrays, std::shared_ptr<const void> owner, std::vector<material> mats)
+          : data(arrays), storage(std::move(owner)), materials(std::move(mats)), kernel(sphere_batch_kernel_for(detected_simd_level())) {
+            //borrows arrays, owner keeps them alive (a mapped file, a buffer) for as long as this sphere_bvh lives
+            set_bbox();
+        }
+
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+            RT_STAT(hit_calls, 1);
+            if(data.node_count == 0)
+                return false;
+
+            long best = -1;
+            traverse_flat_bvh<false>(data.nodes, r, ray_t, [&](const flat_bvh_node& node, interval& t) {
+                RT_STAT(primitive_tests, node.count);
+                auto t_max = t.max;
+                auto i = kernel(leaf_view(node), r, t.min, t_max);
+                if(i < 0)
+                    return false;
+                best = node.offset + i;
+                t.max = t_max;
+                return true;
+            });
+            if(best < 0)
+                return false;
+
+            //only the closest sphere fills in the record
+            auto center = point3(data.cx[best], data.cy[best], data.cz[best]);
+            rec.t = ray_t.max;
+            rec.p = r.at(rec.t);
+            vec3 outward_normal = (rec.p - center) / data.radii[best];
+            rec.set_face_normal(r, outward_normal);
+            rec.mat = &materials[data.mat_index[best]];
+            return true;
+        }
+
+        bool occluded(const ray& r, interval ray_t) const override {
+            //the walk of hit, done at the first leaf with any sphere in ray_t
+            RT_STAT(hit_calls, 1);
+            if(data.node_count == 0)
+                return false;
+            return traverse_flat_bvh<true>(data.nodes, r, ray_t, [&](const flat_bvh_node& node, interval& t) {
+                RT_STAT(primitive_tests, node.count);
+                auto t_max = t.max;
+                return kernel(leaf_view(node), r, t.min, t_max) >= 0;
+            });
+        }
+
+        aabb bounding_box() const override {return bbox;}
+
+        std::vector<sphere_light> lights() const {
+            //every sphere of an emissive material, what light sampling needs to know about them (see lights.h).
+            //hollow (negative radius) emitters face inwards and aren't sampled
+            std::vector<sphere_light> found;
+            for(size_t i = 0; i < data.slots; ++i) {
+                if(std::isnan(data.cx[i]) || data.radii[i] <= 0)
+                    continue; //padding or hollow
+                const auto& mat = materials[data.mat_index[i]];
+                if(mat.emits())
+                    found.push_back({point3(data.cx[i], data.cy[i], data.cz[i]), data.radii[i], mat.emission()});
+            }
+            return found;
+        }
+
+        std::vector<uint32_t> slots_within(const point3& center, double radius) const {
+            //array slots of the spheres whose center is within radius of center, for picking the spheres to move
+            std::vector<uint32_t> found;
+            for(size_t i = 0; i < data.slots; ++i) {
+                auto offset = point3(data.cx[i], data.cy[i], data.cz[i]) - center;
+                if(offset.length_squared() <= radius * radius) //false for the NaN padding
+                    found.push_back(static_cast<uint32_t>(i));
+            }
+            return found;
+        }
+
+        point3 sphere_center(uint32_t slot) const {return point3(data.cx[slot], data.cy[slot], data.cz[slot]);}
+
+        void move_sphere(uint32_t slot, const point3& center) {
+            //node boxes are stale until the next refit
+            auto& arrays = writable();
+            arrays.cx[slot] = center.x();
+            arrays.cy[slot] = center.y();
+            arrays.cz[slot] = center.z();
+        }
+
+        void refit() {
+            //children always come after their parent (depth first layout), so walking the nodes backwards
+            //sees both children of a node before the node itself
+            if(data.node_count == 0)
+                return;
+            auto& arrays = writable();
+            std::vector<aabb> boxes(arrays.nodes.size());
+            for(size_t n = arrays.nodes.size(); n-- > 0;) {
+                auto& node = arrays.nodes[n];
+                aabb box;
+                if(node.count > 0) {
+                    for(size_t i = node.offset; i < node.offset + node.count; ++i) {
+                        if(std::isnan(arrays.cx[i]))
+                            continue; //padding
+                        auto r = fabs(arrays.radii[i]);
+                        auto center = point3(arrays.cx[i], arrays.cy[i], arrays.cz[i]);
+                        box = aabb(box, aabb(center - vec3(r, r, r), center + vec3(r, r, r)));
+                    }
+                } else {
+                    box = aabb(boxes[n + 1], boxes[node.offset]);
+                }
+                set_node_bounds(node, box);
+                boxes[n] = box;
+            }
+            set_bbox();
+        }
+
+        const sphere_bvh_arrays& arrays() const {return data;} //for writing the built scene out, see scene_file.h
+        const std::vector<material>& material_list() const {return materials;}
+        void set_simd_level(simd_level level) {kernel = sphere_batch_kernel_for(level);} //for benchmarks and debugging
+
+    private:
+
+        struct owned_arrays {
+            std::vector<flat_bvh_node> nodes;
+            aligned_vector<real> cx, cy, cz, radius2, radii;
+            aligned_vector<uint32_t> mat_index;
+        };
+
+        sphere_bvh_arrays data;
+        std::shared_ptr<const void> storage;
+        std::shared_ptr<owned_arrays> owned; //same as storage when the arrays were built here
+        std::vector<material> materials; //the material table mat_index points into
+        sphere_batch_kernel kernel;
+        aabb bbox;
+
+        void use_owned(std::shared_ptr<owned_arrays> arrays) {
+            owned = arrays;
+            storage = arrays;
+            data.nodes = arrays->nodes.data();
+            data.node_count = arrays->nodes.size();
+            data.cx = arrays->cx.data();
+            data.cy = arrays->cy.data();
+            data.cz = arrays->cz.data();
+            data.radius2 = arrays->radius2.data();
+            data.radii = arrays->radii.data();
+            data.mat_index = arrays->mat_index.data();
+            data.slots = arrays->cx.size();
+        }
+
+        owned_arrays& writable() {
+            //arrays this object may change, borrowed (mapped) arrays are copied the first time
+            if(!owned) {
+                auto copy = std::make_shared<owned_arrays>();
+                copy->nodes.assign(data.nodes, data.nodes + data.node_count);
+                copy->cx.assign(data.cx, data.cx + data.slots);
+                copy->cy.assign(data.cy, data.cy + data.slots);
+                copy->cz.assign(data.cz, data.cz + data.slots);
+                copy->radius2.assign(data.radius2, data.radius2 + data.slots);
+                copy->radii.assign(data.radii, data.radii + data.slots);
+                copy->mat_index.assign(data.mat_index, data.mat_index + data.slots);
+                use_owned(copy);
+            }
+            return *owned;
+        }
+
+        void set_bbox() {
+            if(data.node_count == 0)
+                return;
+            const auto& root = data.nodes[0];
+            bbox = aabb(point3(root.bounds_min[0], root.bounds_min[1], root.bounds_min[2]),
+                        point3(root.bounds_max[0], root.bounds_max[1], root.bounds_max[2]));
+        }
+
+        sphere_soa_view leaf_view(const flat_bvh_node& node) const {
+            return sphere_soa_view{data.cx + node.offset, data.cy + node.offset, data.cz + node.offset,
+                                   data.radius2 + node.offset, node.count};
+        }
+
+        static void build(owned_arrays& out, const std::vector<sphere_record>& spheres, std::vector<bvh_primitive>& prims) {
+            //the shared flat BVH build (bvh.h), every run of leaf_size or fewer spheres a leaf
+            build_flat_bvh(out.nodes, prims, 0, prims.size(), flat_bvh_leaf_rule{leaf_size, infinity},
+                [&](flat_bvh_node& node, size_t start, size_t end) {
+                    //copy the run into the arrays, padded out to a whole batch with never-hit lanes
+                    auto count = end - start;
+                    auto offset = out.cx.size();
+                    auto padded = (count + leaf_size - 1) / leaf_size * leaf_size;
+                    auto nan = std::numeric_limits<real>::quiet_NaN();
+                    for(auto* array : {&out.cx, &out.cy, &out.cz, &out.radius2, &out.radii})
+                        array->resize(offset + padded, nan);
+                    out.mat_index.resize(offset + padded, 0);
+                    for(size_t i = 0; i < count; ++i) {
+                        const auto& s = spheres[prims[start + i].index];
+                        out.cx[offset + i] = s.center.x();
+                        out.cy[offset + i] = s.center.y();
+                        out.cz[offset + i] = s.center.z();
+                        out.radii[offset + i] = s.radius;
+                        out.radius2[offset + i] = out.radii[offset + i] * out.radii[offset + i];
+                        out.mat_index[offset + i] = s.material;
+                    }
+                    node.offset = static_cast<uint32_t>(offset);
+                    node.count = static_cast<uint16_t>(padded);
+                });
+        }
+};
+
+#endif
@@ -0,0 +1,548 @@
+#ifndef SPHERE_SOA_H
+#define SPHERE_SOA_H
+
+#include "rtweekend.h"
+
+#include "aligned_allocator.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "material.h"
+#include "simd.h"
+#include "sphere.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct sphere_soa_view { //what a batch kernel reads, every array padded to a whole number of 64 byte batches
+    const real* cx;
+    const real* cy;
+    const real* cz;
+    const real* radius2;
+    size_t count;
+};
+
+//a batch kernel tests one ray against every sphere in the view and returns the index of the closest
+//hit inside (t_min, t_max), or -1, with t_max lowered to that hit; same roots as sphere_roots in sphere.h
+//there is one set of kernels per precision, lanes per instruction double in float builds
+using sphere_batch_kernel = long (*)(const sphere_soa_view&, const ray&, real t_min, real& t_max);
+
+inline long sphere_batch_hit_scalar(const sphere_soa_view& v, const ray& r, real t_min, real& t_max) {
+    auto o = r.origin();
+    auto d = r.direction();
+    long best = -1;
+    for(size_t i = 0; i < v.count; ++i) {
+        real root1, root2;
+        if(!sphere_roots(o - vec3(v.cx[i], v.cy[i], v.cz[i]), d, v.radius2[i], root1, root2)) //also rejects the NaN padding lanes
+            continue;
+        auto root = root1;
+        if(!(t_min < root && root < t_max)) {
+            root = root2;
+            if(!(t_min < root && root < t_max))
+                continue;
+        }
+        t_max = root;
+        best = static_cast<long>(i);
+    }
+    return best;
+}
+
+#ifdef RT_SIMD_X86
+
+//the vector kernels keep a running closest t and index per lane and reduce across lanes at the end
+//lanes only accept roots strictly closer than what they already hold, so ties resolve to the lower index like the scalar loop
+
+template<typename T>
+inline long reduce_lanes(const T* lane_t, const T* lane_index, int lanes, T& t_max) {
+    long best = -1;
+    for(int l = 0; l < lanes; ++l) {
+        if(lane_index[l] < 0)
+            continue;
+        auto index = static_cast<long>(lane_index[l]);
+        if(lane_t[l] < t_max || (lane_t[l] == t_max && index < best)) {
+            t_max = lane_t[l];
+            best = index;
+        }
+    }
+    return best;
+}
+
+#ifndef RT_USE_FLOAT
+
+__attribute__((target("sse2")))
+inline long sphere_batch_hit_sse2(const sphere_soa_view& v, const ray& r, double t_min, double& t_max) {
+    auto o = r.origin();
+    auto d = r.direction();
+    const __m128d ox = _mm_set1_pd(o.x()), oy = _mm_set1_pd(o.y()), oz = _mm_set1_pd(o.z());
+    const __m128d dx = _mm_set1_pd(d.x()), dy = _mm_set1_pd(d.y()), dz = _mm_set1_pd(d.z());
+    const __m128d a = _mm_set1_pd(d.length_squared());
+    const __m128d inv_a = _mm_set1_pd(1 / d.length_squared());
+    const __m128d tmin = _mm_set1_pd(t_min);
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d sign = _mm_set1_pd(-0.0);
+    __m128d best_t = _mm_set1_pd(t_max);
+    __m128d best_index = _mm_set1_pd(-1);
+    __m128d index = _mm_set_pd(1, 0);
+    const __m128d step = _mm_set1_pd(2);
+
+    for(size_t i = 0; i < v.count; i += 2) {
+        __m128d ocx = _mm_sub_pd(ox, _mm_load_pd(v.cx + i));
+        __m128d ocy = _mm_sub_pd(oy, _mm_load_pd(v.cy + i));
+        __m128d ocz = _mm_sub_pd(oz, _mm_load_pd(v.cz + i));
+        __m128d r2 = _mm_load_pd(v.radius2 + i);
+        __m128d half_b = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, dx), _mm_mul_pd(ocy, dy)), _mm_mul_pd(ocz, dz));
+        __m128d k = _mm_mul_pd(half_b, inv_a);
+        __m128d lx = _mm_sub_pd(ocx, _mm_mul_pd(k, dx));
+        __m128d ly = _mm_sub_pd(ocy, _mm_mul_pd(k, dy));
+        __m128d lz = _mm_sub_pd(ocz, _mm_mul_pd(k, dz));
+        __m128d disc = _mm_sub_pd(r2, _mm_add_pd(_mm_add_pd(_mm_mul_pd(lx, lx), _mm_mul_pd(ly, ly)), _mm_mul_pd(lz, lz)));
+        __m128d real_roots = _mm_cmpge_pd(disc, zero);
+        if(!_mm_movemask_pd(real_roots)) { //most batches miss entirely, skip the sqrt and divides
+            index = _mm_add_pd(index, step);
+            continue;
+        }
+        __m128d c = _mm_sub_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, ocx), _mm_mul_pd(ocy, ocy)), _mm_mul_pd(ocz, ocz)), r2);
+        __m128d sqrtd = _mm_sqrt_pd(_mm_mul_pd(a, _mm_max_pd(disc, zero)));
+        __m128d q = _mm_xor_pd(_mm_add_pd(half_b, _mm_or_pd(sqrtd, _mm_and_pd(half_b, sign))), sign); //-(half_b + copysign(sqrtd, half_b))
+        __m128d t0 = _mm_div_pd(c, q);
+        __m128d t1 = _mm_mul_pd(q, inv_a);
+        __m128d root1 = _mm_min_pd(t0, t1);
+        __m128d root2 = _mm_max_pd(t0, t1);
+        __m128d in1 = _mm_and_pd(real_roots, _mm_and_pd(_mm_cmpgt_pd(root1, tmin), _mm_cmplt_pd(root1, best_t)));
+        __m128d in2 = _mm_and_pd(real_roots, _mm_and_pd(_mm_cmpgt_pd(root2, tmin), _mm_cmplt_pd(root2, best_t)));
+        __m128d root = _mm_or_pd(_mm_and_pd(in1, root1), _mm_andnot_pd(in1, root2));
+        __m128d hit = _mm_or_pd(in1, in2);
+        best_t = _mm_or_pd(_mm_and_pd(hit, root), _mm_andnot_pd(hit, best_t));
+        best_index = _mm_or_pd(_mm_and_pd(hit, index), _mm_andnot_pd(hit, best_index));
+        index = _mm_add_pd(index, step);
+    }
+
+    alignas(16) double lane_t[2], lane_index[2];
+    _mm_store_pd(lane_t, best_t);
+    _mm_store_pd(lane_index, best_index);
+    return reduce_lanes(lane_t, lane_index, 2, t_max);
+}
+
+__attribute__((target("avx2")))
+inline long sphere_batch_hit_avx2(const sphere_soa_view& v, const ray& r, double t_min, double& t_max) {
+    auto o = r.origin();
+    auto d = r.direction();
+    const __m256d ox = _mm256_set1_pd(o.x()), oy = _mm256_set1_pd(o.y()), oz = _mm256_set1_pd(o.z());
+    const __m256d dx = _mm256_set1_pd(d.x()), dy = _mm256_set1_pd(d.y()), dz = _mm256_set1_pd(d.z());
+    const __m256d a = _mm256_set1_pd(d.length_squared());
+    const __m256d inv_a = _mm256_set1_pd(1 / d.length_squared());
+    const __m256d tmin = _mm256_set1_pd(t_min);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d best_t = _mm256_set1_pd(t_max);
+    __m256d best_index = _mm256_set1_pd(-1);
+    __m256d index = _mm256_set_pd(3, 2, 1, 0);
+    const __m256d step = _mm256_set1_pd(4);
+
+    for(size_t i = 0; i < v.count; i += 4) {
+        __m256d ocx = _mm256_sub_pd(ox, _mm256_load_pd(v.cx + i));
+        __m256d ocy = _mm256_sub_pd(oy, _mm256_load_pd(v.cy + i));
+        __m256d ocz = _mm256_sub_pd(oz, _mm256_load_pd(v.cz + i));
+        __m256d r2 = _mm256_load_pd(v.radius2 + i);
+        __m256d half_b = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, dx), _mm256_mul_pd(ocy, dy)), _mm256_mul_pd(ocz, dz));
+        __m256d k = _mm256_mul_pd(half_b, inv_a);
+        __m256d lx = _mm256_sub_pd(ocx, _mm256_mul_pd(k, dx));
+        __m256d ly = _mm256_sub_pd(ocy, _mm256_mul_pd(k, dy));
+        __m256d lz = _mm256_sub_pd(ocz, _mm256_mul_pd(k, dz));
+        __m256d disc = _mm256_sub_pd(r2, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(lx, lx), _mm256_mul_pd(ly, ly)), _mm256_mul_pd(lz, lz)));
+        __m256d real_roots = _mm256_cmp_pd(disc, zero, _CMP_GE_OQ);
+        if(!_mm256_movemask_pd(real_roots)) { //most batches miss entirely, skip the sqrt and divides
+            index = _mm256_add_pd(index, step);
+            continue;
+        }
+        __m256d c = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)), _mm256_mul_pd(ocz, ocz)), r2);
+        __m256d sqrtd = _mm256_sqrt_pd(_mm256_mul_pd(a, _mm256_max_pd(disc, zero)));
+        __m256d q = _mm256_xor_pd(_mm256_add_pd(half_b, _mm256_or_pd(sqrtd, _mm256_and_pd(half_b, sign))), sign);
+        __m256d t0 = _mm256_div_pd(c, q);
+        __m256d t1 = _mm256_mul_pd(q, inv_a);
+        __m256d root1 = _mm256_min_pd(t0, t1);
+        __m256d root2 = _mm256_max_pd(t0, t1);
+        __m256d in1 = _mm256_and_pd(real_roots, _mm256_and_pd(_mm256_cmp_pd(root1, tmin, _CMP_GT_OQ), _mm256_cmp_pd(root1, best_t, _CMP_LT_OQ)));
+        __m256d in2 = _mm256_and_pd(real_roots, _mm256_and_pd(_mm256_cmp_pd(root2, tmin, _CMP_GT_OQ), _mm256_cmp_pd(root2, best_t, _CMP_LT_OQ)));
+        __m256d root = _mm256_blendv_pd(root2, root1, in1);
+        __m256d hit = _mm256_or_pd(in1, in2);
+        best_t = _mm256_blendv_pd(best_t, root, hit);
+        best_index = _mm256_blendv_pd(best_index, index, hit);
+        index = _mm256_add_pd(index, step);
+    }
+
+    alignas(32) double lane_t[4], lane_index[4];
+    _mm256_store_pd(lane_t, best_t);
+    _mm256_store_pd(lane_index, best_index);
+    return reduce_lanes(lane_t, lane_index, 4, t_max);
+}
+
+//gcc 12 flags the undefined source operand inside its own avx512 intrinsics
+//avx512f brings fma along, and gcc would fuse the mul/add pairs and round differently from sphere_roots
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline long sphere_batch_hit_avx512(const sphere_soa_view& v, const ray& r, double t_min, double& t_max) {
+    auto o = r.origin();
+    auto d = r.direction();
+    const __m512d ox = _mm512_set1_pd(o.x()), oy = _mm512_set1_pd(o.y()), oz = _mm512_set1_pd(o.z());
+    const __m512d dx = _mm512_set1_pd(d.x()), dy = _mm512_set1_pd(d.y()), dz = _mm512_set1_pd(d.z());
+    const __m512d a = _mm512_set1_pd(d.length_squared());
+    const __m512d inv_a = _mm512_set1_pd(1 / d.length_squared());
+    const __m512d tmin = _mm512_set1_pd(t_min);
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512i sign = _mm512_set1_epi64(static_cast<long long>(0x8000000000000000ull));
+    __m512d best_t = _mm512_set1_pd(t_max);
+    __m512d best_index = _mm512_set1_pd(-1);
+    __m512d index = _mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m512d step = _mm512_set1_pd(8);
+
+    for(size_t i = 0; i < v.count; i += 8) {
+        __m512d ocx = _mm512_sub_pd(ox, _mm512_load_pd(v.cx + i));
+        __m512d ocy = _mm512_sub_pd(oy, _mm512_load_pd(v.cy + i));
+        __m512d ocz = _mm512_sub_pd(oz, _mm512_load_pd(v.cz + i));
+        __m512d r2 = _mm512_load_pd(v.radius2 + i);
+        __m512d half_b = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, dx), _mm512_mul_pd(ocy, dy)), _mm512_mul_pd(ocz, dz));
+        __m512d k = _mm512_mul_pd(half_b, inv_a);
+        __m512d lx = _mm512_sub_pd(ocx, _mm512_mul_pd(k, dx));
+        __m512d ly = _mm512_sub_pd(ocy, _mm512_mul_pd(k, dy));
+        __m512d lz = _mm512_sub_pd(ocz, _mm512_mul_pd(k, dz));
+        __m512d disc = _mm512_sub_pd(r2, _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(lx, lx), _mm512_mul_pd(ly, ly)), _mm512_mul_pd(lz, lz)));
+        __mmask8 real_roots = _mm512_cmp_pd_mask(disc, zero, _CMP_GE_OQ);
+        if(!real_roots) {
+            index = _mm512_add_pd(index, step);
+            continue;
+        }
+        __m512d c = _mm512_sub_pd(_mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(ocx, ocx), _mm512_mul_pd(ocy, ocy)), _mm512_mul_pd(ocz, ocz)), r2);
+        __m512d sqrtd = _mm512_sqrt_pd(_mm512_mul_pd(a, _mm512_max_pd(disc, zero)));
+        __m512d signed_sqrtd = _mm512_castsi512_pd(_mm512_or_si512(_mm512_castpd_si512(sqrtd), _mm512_and_si512(_mm512_castpd_si512(half_b), sign)));
+        __m512d q = _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(_mm512_add_pd(half_b, signed_sqrtd)), sign)); //no xor_pd without avx512dq
+        __m512d t0 = _mm512_div_pd(c, q);
+        __m512d t1 = _mm512_mul_pd(q, inv_a);
+        __m512d root1 = _mm512_min_pd(t0, t1);
+        __m512d root2 = _mm512_max_pd(t0, t1);
+        __mmask8 in1 = real_roots & _mm512_cmp_pd_mask(root1, tmin, _CMP_GT_OQ) & _mm512_cmp_pd_mask(root1, best_t, _CMP_LT_OQ);
+        __mmask8 in2 = real_roots & _mm512_cmp_pd_mask(root2, tmin, _CMP_GT_OQ) & _mm512_cmp_pd_mask(root2, best_t, _CMP_LT_OQ);
+        __m512d root = _mm512_mask_blend_pd(in1, root2, root1);
+        __mmask8 hit = in1 | in2;
+        best_t = _mm512_mask_blend_pd(hit, best_t, root);
+        best_index = _mm512_mask_blend_pd(hit, best_index, index);
+        index = _mm512_add_pd(index, step);
+    }
+
+    alignas(64) double lane_t[8], lane_index[8];
+    _mm512_store_pd(lane_t, best_t);
+    _mm512_store_pd(lane_index, best_index);
+    return reduce_lanes(lane_t, lane_index, 8, t_max);
+}
+#pragma GCC diagnostic pop
+
+#else //RT_USE_FLOAT: same kernels on packed floats, twice the lanes
+
+__attribute__((target("sse2")))
+inline long sphere_batch_hit_sse2(const sphere_soa_view& v, const ray& r, float t_min, float& t_max) {
+    auto o = r.origin();
+    auto d = r.direction();
+    const __m128 ox = _mm_set1_ps(o.x()), oy = _mm_set1_ps(o.y()), oz = _mm_set1_ps(o.z());
+    const __m128 dx = _mm_set1_ps(d.x()), dy = _mm_set1_ps(d.y()), dz = _mm_set1_ps(d.z());
+    const __m128 a = _mm_set1_ps(d.length_squared());
+    const __m128 inv_a = _mm_set1_ps(1 / d.length_squared());
+    const __m128 tmin = _mm_set1_ps(t_min);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 best_t = _mm_set1_ps(t_max);
+    __m128 best_index = _mm_set1_ps(-1);
+    __m128 index = _mm_set_ps(3, 2, 1, 0);
+    const __m128 step = _mm_set1_ps(4);
+
+    for(size_t i = 0; i < v.count; i += 4) {
+        __m128 ocx = _mm_sub_ps(ox, _mm_load_ps(v.cx + i));
+        __m128 ocy = _mm_sub_ps(oy, _mm_load_ps(v.cy + i));
+        __m128 ocz = _mm_sub_ps(oz, _mm_load_ps(v.cz + i));
+        __m128 r2 = _mm_load_ps(v.radius2 + i);
+        __m128 half_b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+        __m128 k = _mm_mul_ps(half_b, inv_a);
+        __m128 lx = _mm_sub_ps(ocx, _mm_mul_ps(k, dx));
+        __m128 ly = _mm_sub_ps(ocy, _mm_mul_ps(k, dy));
+        __m128 lz = _mm_sub_ps(ocz, _mm_mul_ps(k, dz));
+        __m128 disc = _mm_sub_ps(r2, _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)), _mm_mul_ps(lz, lz)));
+        __m128 real_roots = _mm_cmpge_ps(disc, zero);
+        if(!_mm_movemask_ps(real_roots)) {
+            index = _mm_add_ps(index, step);
+            continue;
+        }
+        __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)), r2);
+        __m128 sqrtd = _mm_sqrt_ps(_mm_mul_ps(a, _mm_max_ps(disc, zero)));
+        __m128 q = _mm_xor_ps(_mm_add_ps(half_b, _mm_or_ps(sqrtd, _mm_and_ps(half_b, sign))), sign);
+        __m128 t0 = _mm_div_ps(c, q);
+        __m128 t1 = _mm_mul_ps(q, inv_a);
+        __m128 root1 = _mm_min_ps(t0, t1);
+        __m128 root2 = _mm_max_ps(t0, t1);
+        __m128 in1 = _mm_and_ps(real_roots, _mm_and_ps(_mm_cmpgt_ps(root1, tmin), _mm_cmplt_ps(root1, best_t)));
+        __m128 in2 = _mm_and_ps(real_roots, _mm_and_ps(_mm_cmpgt_ps(root2, tmin), _mm_cmplt_ps(root2, best_t)));
+        __m128 root = _mm_or_ps(_mm_and_ps(in1, root1), _mm_andnot_ps(in1, root2));
+        __m128 hit = _mm_or_ps(in1, in2);
+        best_t = _mm_or_ps(_mm_and_ps(hit, root), _mm_andnot_ps(hit, best_t));
+        best_index = _mm_or_ps(_mm_and_ps(hit, index), _mm_andnot_ps(hit, best_index));
+        index = _mm_add_ps(index, step);
+    }
+
+    alignas(16) float lane_t[4], lane_index[4];
+    _mm_store_ps(lane_t, best_t);
+    _mm_store_ps(lane_index, best_index);
+    return reduce_lanes(lane_t, lane_index, 4, t_max);
+}
+
+__attribute__((target("avx2")))
+inline long sphere_batch_hit_avx2(const sphere_soa_view& v, const ray& r, float t_min, float& t_max) {
+    auto o = r.origin();
+    auto d = r.direction();
+    const __m256 ox = _mm256_set1_ps(o.x()), oy = _mm256_set1_ps(o.y()), oz = _mm256_set1_ps(o.z());
+    const __m256 dx = _mm256_set1_ps(d.x()), dy = _mm256_set1_ps(d.y()), dz = _mm256_set1_ps(d.z());
+    const __m256 a = _mm256_set1_ps(d.length_squared());
+    const __m256 inv_a = _mm256_set1_ps(1 / d.length_squared());
+    const __m256 tmin = _mm256_set1_ps(t_min);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 best_t = _mm256_set1_ps(t_max);
+    __m256 best_index = _mm256_set1_ps(-1);
+    __m256 index = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m256 step = _mm256_set1_ps(8);
+
+    for(size_t i = 0; i < v.count; i += 8) {
+        __m256 ocx = _mm256_sub_ps(ox, _mm256_load_ps(v.cx + i));
+        __m256 ocy = _mm256_sub_ps(oy, _mm256_load_ps(v.cy + i));
+        __m256 ocz = _mm256_sub_ps(oz, _mm256_load_ps(v.cz + i));
+        __m256 r2 = _mm256_load_ps(v.radius2 + i);
+        __m256 half_b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)), _mm256_mul_ps(ocz, dz));
+        __m256 k = _mm256_mul_ps(half_b, inv_a);
+        __m256 lx = _mm256_sub_ps(ocx, _mm256_mul_ps(k, dx));
+        __m256 ly = _mm256_sub_ps(ocy, _mm256_mul_ps(k, dy));
+        __m256 lz = _mm256_sub_ps(ocz, _mm256_mul_ps(k, dz));
+        __m256 disc = _mm256_sub_ps(r2, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, lx), _mm256_mul_ps(ly, ly)), _mm256_mul_ps(lz, lz)));
+        __m256 real_roots = _mm256_cmp_ps(disc, zero, _CMP_GE_OQ);
+        if(!_mm256_movemask_ps(real_roots)) {
+            index = _mm256_add_ps(index, step);
+            continue;
+        }
+        __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz)), r2);
+        __m256 sqrtd = _mm256_sqrt_ps(_mm256_mul_ps(a, _mm256_max_ps(disc, zero)));
+        __m256 q = _mm256_xor_ps(_mm256_add_ps(half_b, _mm256_or_ps(sqrtd, _mm256_and_ps(half_b, sign))), sign);
+        __m256 t0 = _mm256_div_ps(c, q);
+        __m256 t1 = _mm256_mul_ps(q, inv_a);
+        __m256 root1 = _mm256_min_ps(t0, t1);
+        __m256 root2 = _mm256_max_ps(t0, t1);
+        __m256 in1 = _mm256_and_ps(real_roots, _mm256_and_ps(_mm256_cmp_ps(root1, tmin, _CMP_GT_OQ), _mm256_cmp_ps(root1, best_t, _CMP_LT_OQ)));
+        __m256 in2 = _mm256_and_ps(real_roots, _mm256_and_ps(_mm256_cmp_ps(root2, tmin, _CMP_GT_OQ), _mm256_cmp_ps(root2, best_t, _CMP_LT_OQ)));
+        __m256 root = _mm256_blendv_ps(root2, root1, in1);
+        __m256 hit = _mm256_or_ps(in1, in2);
+        best_t = _mm256_blendv_ps(best_t, root, hit);
+        best_index = _mm256_blendv_ps(best_index, index, hit);
+        index = _mm256_add_ps(index, step);
+    }
+
+    alignas(32) float lane_t[8], lane_index[8];
+    _mm256_store_ps(lane_t, best_t);
+    _mm256_store_ps(lane_index, best_index);
+    return reduce_lanes(lane_t, lane_index, 8, t_max);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+inline long sphere_batch_hit_avx512(const sphere_soa_view& v, const ray& r, float t_min, float& t_max) {
+    auto o = r.origin();
+    auto d = r.direction();
+    const __m512 ox = _mm512_set1_ps(o.x()), oy = _mm512_set1_ps(o.y()), oz = _mm512_set1_ps(o.z());
+    const __m512 dx = _mm512_set1_ps(d.x()), dy = _mm512_set1_ps(d.y()), dz = _mm512_set1_ps(d.z());
+    const __m512 a = _mm512_set1_ps(d.length_squared());
+    const __m512 inv_a = _mm512_set1_ps(1 / d.length_squared());
+    const __m512 tmin = _mm512_set1_ps(t_min);
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512i sign = _mm512_set1_epi32(static_cast<int>(0x80000000u));
+    __m512 best_t = _mm512_set1_ps(t_max);
+    __m512 best_index = _mm512_set1_ps(-1);
+    __m512 index = _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    const __m512 step = _mm512_set1_ps(16);
+
+    for(size_t i = 0; i < v.count; i += 16) {
+        __m512 ocx = _mm512_sub_ps(ox, _mm512_load_ps(v.cx + i));
+        __m512 ocy = _mm512_sub_ps(oy, _mm512_load_ps(v.cy + i));
+        __m512 ocz = _mm512_sub_ps(oz, _mm512_load_ps(v.cz + i));
+        __m512 r2 = _mm512_load_ps(v.radius2 + i);
+        __m512 half_b = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ocx, dx), _mm512_mul_ps(ocy, dy)), _mm512_mul_ps(ocz, dz));
+        __m512 k = _mm512_mul_ps(half_b, inv_a);
+        __m512 lx = _mm512_sub_ps(ocx, _mm512_mul_ps(k, dx));
+        __m512 ly = _mm512_sub_ps(ocy, _mm512_mul_ps(k, dy));
+        __m512 lz = _mm512_sub_ps(ocz, _mm512_mul_ps(k, dz));
+        __m512 disc = _mm512_sub_ps(r2, _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(lx, lx), _mm512_mul_ps(ly, ly)), _mm512_mul_ps(lz, lz)));
+        __mmask16 real_roots = _mm512_cmp_ps_mask(disc, zero, _CMP_GE_OQ);
+        if(!real_roots) {
+            index = _mm512_add_ps(index, step);
+            continue;
+        }
+        __m512 c = _mm512_sub_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ocx, ocx), _mm512_mul_ps(ocy, ocy)), _mm512_mul_ps(ocz, ocz)), r2);
+        __m512 sqrtd = _mm512_sqrt_ps(_mm512_mul_ps(a, _mm512_max_ps(disc, zero)));
+        __m512 signed_sqrtd = _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(sqrtd), _mm512_and_si512(_mm512_castps_si512(half_b), sign)));
+        __m512 q = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(_mm512_add_ps(half_b, signed_sqrtd)), sign));
+        __m512 t0 = _mm512_div_ps(c, q);
+        __m512 t1 = _mm512_mul_ps(q, inv_a);
+        __m512 root1 = _mm512_min_ps(t0, t1);
+        __m512 root2 = _mm512_max_ps(t0, t1);
+        __mmask16 in1 = real_roots & _mm512_cmp_ps_mask(root1, tmin, _CMP_GT_OQ) & _mm512_cmp_ps_mask(root1, best_t, _CMP_LT_OQ);
+        __mmask16 in2 = real_roots & _mm512_cmp_ps_mask(root2, tmin, _CMP_GT_OQ) & _mm512_cmp_ps_mask(root2, best_t, _CMP_LT_OQ);
+        __m512 root = _mm512_mask_blend_ps(in1, root2, root1);
+        __mmask16 hit = in1 | in2;
+        best_t = _mm512_mask_blend_ps(hit, best_t, root);
+        best_index = _mm512_mask_blend_ps(hit, best_index, index);
+        index = _mm512_add_ps(index, step);
+    }
+
+    alignas(64) float lane_t[16], lane_index[16];
+    _mm512_store_ps(lane_t, best_t);
+    _mm512_store_ps(lane_index, best_index);
+    return reduce_lanes(lane_t, lane_index, 16, t_max);
+}
+#pragma GCC diagnostic pop
+
+#endif
+
+#endif
+
+inline sphere_batch_kernel sphere_batch_kernel_for(simd_level level) {
+    //picks the kernel for level, falling back to the widest one the cpu actually supports
+    if(level > detected_simd_level())
+        level = detected_simd_level();
+    switch(level) {
+#ifdef RT_SIMD_X86
+        case simd_level::avx512: return sphere_batch_hit_avx512;
+        case simd_level::avx2: return sphere_batch_hit_avx2;
+        case simd_level::sse2: return sphere_batch_hit_sse2;
+#endif
+        default: return sphere_batch_hit_scalar;
+    }
+}
+
+class sphere_soa : public hittable { //a group of spheres stored as a structure of arrays
+    //centers, radii and material indices live in separate 64 byte aligned arrays so one ray can be
+    //tested against 2 (SSE2), 4 (AVX2) or 8 (AVX-512) spheres per instruction, twice that in float builds, picked at runtime
+    //meant as a leaf container: see make_sphere_groups for splitting a big sphere field into BVH-able groups
+    public:
+        static const int lane_padding = 64 / sizeof(real); //arrays are padded to the widest kernel, padding lanes never hit
+
+        sphere_soa() : kernel(sphere_batch_kernel_for(detected_simd_level())) {}
+
+        void add(const point3& center, double radius, shared_ptr<material> mat) {
+            if(count == cx.size()) {
+                //grow by a whole batch of never-hit lanes (NaN centers fail every comparison)
+                auto nan = std::numeric_limits<real>::quiet_NaN();
+                for(auto* array : {&cx, &cy, &cz, &radius2, &radii})
+                    array->resize(array->size() + lane_padding, nan);
+                mat_index.resize(mat_index.size() + lane_padding, 0);
+            }
+            cx[count] = center.x();
+            cy[count] = center.y();
+            cz[count] = center.z();
+            radii[count] = radius;
+            radius2[count] = radii[count]*radii[count]; //squared in real like sphere::hit, so both see the same sphere
+            mat_index[count] = material_slot(mat);
+            ++count;
+
+            auto rvec = vec3(fabs(radius), fabs(radius), fabs(radius));
+            bbox = aabb(bbox, aabb(center - rvec, center + rvec));
+        }
+
+        size_t size() const {return count;}
+
+        void set_simd_level(simd_level level) {kernel = sphere_batch_kernel_for(level);} //for benchmarks and debugging
+
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+            RT_STAT(hit_calls, 1);
+            if(count == 0)
+                return false;
+            RT_STAT(primitive_tests, count);
+            auto t_max = ray_t.max;
+            auto i = kernel(view(), r, ray_t.min, t_max);
+            if(i < 0)
+                return false;
+
+            //only the winning sphere fills in the record, same as sphere::hit
+            auto center = point3(cx[i], cy[i], cz[i]);
+            rec.t = t_max;
+            rec.p = r.at(rec.t);
+            vec3 outward_normal = (rec.p - center) / radii[i];
+            rec.set_face_normal(r, outward_normal);
+            rec.mat = &materials[mat_index[i]];
+            return true;
+        }
+
+        aabb bounding_box() const override {return bbox;}
+
+    private:
+        aligned_vector<real> cx, cy, cz;
+        aligned_vector<real> radius2; //what the kernels need
+        aligned_vector<real> radii; //signed, for the normal of hollow (negative radius) spheres
+        aligned_vector<uint32_t> mat_index;
+        std::vector<material> materials; //each distinct material once, by value next to each other
+        std::unordered_map<const material*, uint32_t> material_slots;
+        size_t count = 0;
+        sphere_batch_kernel kernel;
+        aabb bbox;
+
+        sphere_soa_view view() const {
+            //rounded up to a whole batch so every kernel can run without a remainder loop
+            auto padded = (count + lane_padding - 1) / lane_padding * lane_padding;
+            return sphere_soa_view{cx.data(), cy.data(), cz.data(), radius2.data(), padded};
+        }
+
+        uint32_t material_slot(const shared_ptr<material>& mat) {
+            auto found = material_slots.find(mat.get());
+            if(found != material_slots.end())
+                return found->second;
+            auto slot = static_cast<uint32_t>(materials.size());
+            materials.push_back(*mat);
+            material_slots[mat.get()] = slot;
+            return slot;
+        }
+};
+
+struct sphere_desc { //plain description of a sphere, for building sphere_soa groups
+    point3 center;
+    double radius;
+    shared_ptr<material> mat;
+};
+
+inline void split_sphere_groups(std::vector<sphere_desc>& spheres, size_t start, size_t end, size_t group_size, hittable_list& groups, scene_arena* arena) {
+    if(end - start <= group_size) {
+        auto group = arena ? arena->make<sphere_soa>() : make_shared<sphere_soa>();
+        for(size_t i = start; i < end; ++i)
+            group->add(spheres[i].center, spheres[i].radius, spheres[i].mat);
+        groups.add(group);
+        return;
+    }
+
+    //median split along the longest axis of the centers keeps each group spatially compact
+    aabb centers;
+    for(size_t i = start; i < end; ++i)
+        centers = aabb(centers, aabb(spheres[i].center, spheres[i].center));
+    int axis = centers.longest_axis();
+    size_t mid = start + (end - start) / 2;
+    std::nth_element(spheres.begin() + start, spheres.begin() + mid, spheres.begin() + end,
+        [axis](const sphere_desc& a, const sphere_desc& b) {return a.center[axis] < b.center[axis];});
+    split_sphere_groups(spheres, start, mid, group_size, groups, arena);
+    split_sphere_groups(spheres, mid, end, group_size, groups, arena);
+}
+
+inline hittable_list make_sphere_groups(std::vector<sphere_desc> spheres, size_t group_size = 16, scene_arena* arena = nullptr) {
+    //splits a sphere field into spatially compact sphere_soa groups of at most group_size,
+    //a BVH over the returned list then uses the groups as its leaves
+    //with an arena the groups are made in it and only live as long as it does, otherwise each is its own make_shared
+    hittable_list groups;
+    if(!spheres.empty())
+        split_sphere_groups(spheres, 0, spheres.size(), group_size, groups, arena);
+    return groups;
+}
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+
+/* render statistics
+
+compiled in only with -DRT_STATS, otherwise RT_STAT and RT_TIMED_SCOPE expand to nothing and cost nothing
+every thread counts into its own thread_local render_stats, which folds into a global total when the
+thread exits (the camera's pool threads exit at the end of each render), so counting never contends
+collect_stats() returns the global total plus the calling thread's own counts
+
+counters live where the work happens (hittables count their own hit calls, materials their scatters),
+timers only wrap top level work in the camera (a tile, the world intersection, a scatter) because
+nested hittables would count the same nanoseconds several times over
+
+*/
+
+#ifdef RT_STATS
+constexpr bool stats_enabled = true;
+#else
+constexpr bool stats_enabled = false;
+#endif
+
+constexpr int stat_material_kinds = 4; //one scatter counter per material_kind, see material.h
+
+struct render_stats {
+    long long primitive_tests = 0; //ray-sphere intersection tests
+    long long node_tests = 0; //ray-box tests inside the BVHs
+    long long hit_calls = 0; //hittable::hit calls, every level of the scene graph
+    long long scatter_calls[stat_material_kinds] = {}; //material::scatter calls by material_kind
+    long long sky_escapes = 0; //paths that left the scene
+    long long light_hits = 0; //paths that ended on an emitter
+    long long absorbed = 0; //paths a material absorbed (scatter returned false)
+    long long depth_cap_terminations = 0; //paths still going when max_depth ran out
+    long long roulette_terminations = 0; //paths ended by russian roulette
+    long long shadow_rays = 0; //light sampling's occlusion tests
+
+    long long tile_ns = 0; //time inside tiles, summed over threads
+    long long intersect_ns = 0; //time in the camera's world.hit calls
+    long long scatter_ns = 0; //time in the camera's material::scatter calls
+
+    void add(const render_stats& other) {
+        primitive_tests += other.primitive_tests;
+        node_tests += other.node_tests;
+        hit_calls += other.hit_calls;
+        for(int k = 0; k < stat_material_kinds; ++k)
+            scatter_calls[k] += other.scatter_calls[k];
+        sky_escapes += other.sky_escapes;
+        light_hits += other.light_hits;
+        absorbed += other.absorbed;
+        depth_cap_terminations += other.depth_cap_terminations;
+        roulette_terminations += other.roulette_terminations;
+        shadow_rays += other.shadow_rays;
+        tile_ns += other.tile_ns;
+        intersect_ns += other.intersect_ns;
+        scatter_ns += other.scatter_ns;
+    }
+};
+
+inline std::mutex& stats_lock() {
+    static std::mutex lock;
+    return lock;
+}
+
+inline render_stats& global_stats() {
+    static render_stats totals;
+    return totals;
+}
+
+struct thread_stats_slot { //merges a thread's counts into the global total when the thread ends
+    render_stats counts;
+
+    ~thread_stats_slot() {
+        std::lock_guard<std::mutex> guard(stats_lock());
+        global_stats().add(counts);
+    }
+};
+
+inline render_stats& thread_stats() {
+    static thread_local thread_stats_slot slot;
+    return slot.counts;
+}
+
+inline render_stats collect_stats() {
+    std::lock_guard<std::mutex> guard(stats_lock());
+    auto totals = global_stats();
+    totals.add(thread_stats());
+    return totals;
+}
+
+inline void reset_stats() {
+    std::lock_guard<std::mutex> guard(stats_lock());
+    global_stats() = render_stats();
+    thread_stats() = render_stats();
+}
+
+class scoped_timer { //adds the nanoseconds between construction and destruction to a counter
+    public:
+        explicit scoped_timer(long long& counter) : total(counter), start(std::chrono::steady_clock::now()) {}
+        ~scoped_timer() {
+            total += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        scoped_timer(const scoped_timer&) = delete;
+        scoped_timer& operator=(const scoped_timer&) = delete;
+
+    private:
+        long long& total;
+        std::chrono::steady_clock::time_point start;
+};
+
+inline void print_stats(std::ostream& out, const render_stats& s) {
+    static const char* kind_names[stat_material_kinds] = {"lambertian", "metal", "dielectric", "light"};
+    out << "hit calls: " << s.hit_calls << ", primitive tests: " << s.primitive_tests << ", node tests: " << s.node_tests << '\n';
+    out << "scatters:";
+    for(int k = 0; k < stat_material_kinds; ++k)
+        out << ' ' << kind_names[k] << ' ' << s.scatter_calls[k];
+    out << '\n';
+    out << "path ends: sky " << s.sky_escapes << ", light " << s.light_hits << ", absorbed " << s.absorbed << ", depth cap "
+        << s.depth_cap_terminations << ", roulette " << s.roulette_terminations << '\n';
+    if(s.shadow_rays > 0)
+        out << "shadow rays: " << s.shadow_rays << '\n';
+    out << "thread time: tiles " << s.tile_ns / 1e6 << " ms, intersection " << s.intersect_ns / 1e6
+        << " ms, scatter " << s.scatter_ns / 1e6 << " ms\n";
+}
+
+#define RT_STAT_CONCAT_(a, b) a##b
+#define RT_STAT_CONCAT(a, b) RT_STAT_CONCAT_(a, b)
+
+#ifdef RT_STATS
+#define RT_STAT(counter, amount) (thread_stats().counter += (amount))
+#define RT_TIMED_SCOPE(counter) scoped_timer RT_STAT_CONCAT(rt_timer_, __LINE__)(thread_stats().counter)
+#else
+#define RT_STAT(counter, amount) ((void)0)
+#define RT_TIMED_SCOPE(counter) ((void)0)
+#endif
+
+#endif
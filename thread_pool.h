@@ -0,0 +1,122 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class thread_pool { //fixed set of worker threads, each owning its own deque of tasks
+    //submitted tasks, from any number of threads, are dealt round-robin onto the worker deques
+    //a worker pops from the back of its own deque and, once that runs dry, steals from the front of
+    //another worker's deque, so cheap tiles (sky) and expensive tiles (glass) still balance out across cores
+    public:
+        explicit thread_pool(int thread_count) : queues(thread_count > 0 ? thread_count : 1) {
+            for(size_t i = 0; i < queues.size(); ++i)
+                workers.emplace_back([this, i] {worker_loop(i);});
+        }
+
+        ~thread_pool() {
+            {
+                std::lock_guard<std::mutex> guard(state_lock);
+                stopping = true;
+            }
+            work_available.notify_all();
+            for(auto& worker : workers)
+                worker.join();
+        }
+
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        int size() const {return static_cast<int>(queues.size());}
+
+        void submit(std::function<void()> task) {
+            size_t index;
+            {
+                //counted before it is visible, so a worker that pops it at once can't take the counters below zero
+                std::lock_guard<std::mutex> guard(state_lock);
+                index = next_queue++ % queues.size();
+                ++queued;
+                ++pending;
+            }
+            {
+                std::lock_guard<std::mutex> guard(queues[index].lock);
+                queues[index].tasks.push_back(std::move(task));
+            }
+            work_available.notify_one();
+        }
+
+        void wait() {
+            //block the calling thread until every submitted task has finished
+            std::unique_lock<std::mutex> guard(state_lock);
+            all_done.wait(guard, [this] {return pending == 0;});
+        }
+
+    private:
+        struct task_queue {
+            std::mutex lock;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        std::vector<task_queue> queues; //one per worker, index matches workers
+        std::vector<std::thread> workers;
+
+        std::mutex state_lock; //guards the round-robin cursor and the counters below, any thread may submit
+        size_t next_queue = 0;
+        std::condition_variable work_available;
+        std::condition_variable all_done;
+        size_t queued = 0; //tasks sitting in a deque
+        size_t pending = 0; //tasks submitted but not yet finished
+        bool stopping = false;
+
+        bool pop_own(size_t index, std::function<void()>& task) {
+            std::lock_guard<std::mutex> guard(queues[index].lock);
+            if(queues[index].tasks.empty())
+                return false;
+            task = std::move(queues[index].tasks.back());
+            queues[index].tasks.pop_back();
+            return true;
+        }
+
+        bool steal(size_t thief, std::function<void()>& task) {
+            for(size_t offset = 1; offset < queues.size(); ++offset) {
+                auto& victim = queues[(thief + offset) % queues.size()];
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if(!victim.tasks.empty()) {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void worker_loop(size_t index) {
+            while(true) {
+                std::function<void()> task;
+                if(pop_own(index, task) || steal(index, task)) {
+                    {
+                        std::lock_guard<std::mutex> guard(state_lock);
+                        --queued;
+                    }
+                    task();
+                    std::lock_guard<std::mutex> guard(state_lock);
+                    if(--pending == 0)
+                        all_done.notify_all();
+                    continue;
+                }
+
+                //nothing to run anywhere, sleep until a task is submitted or the pool shuts down
+                std::unique_lock<std::mutex> guard(state_lock);
+                work_available.wait(guard, [this] {return stopping || queued > 0;});
+                if(stopping && queued == 0)
+                    return;
+            }
+        }
+};
+
+#endif
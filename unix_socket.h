@@ -0,0 +1,135 @@
+#ifndef UNIX_SOCKET_H
+#define UNIX_SOCKET_H
+
+#include "image_writer.h"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* unix sockets
+
+the little the render service (rtserve.cpp) and its clients (rtctl.cpp, rtload.cpp) need from a local stream
+socket: listen on a path, connect to it, and exchange text lines. every exchange is one request line from the
+client, answered by response lines from the server until it closes the connection
+
+*/
+
+inline int listen_unix(const std::string& path, std::string& error) {
+    //a listening socket at path, replacing a stale socket file left by a server that didn't shut down. -1 on
+    //failure, which includes a path that holds anything but a socket and a socket some server still answers on
+    sockaddr_un address = {};
+    if(path.size() >= sizeof(address.sun_path)) {
+        error = path + ": socket path too long";
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0) {
+        error = std::string("socket: ") + std::strerror(errno);
+        return -1;
+    }
+    struct stat existing;
+    if(::lstat(path.c_str(), &existing) == 0) {
+        if(!S_ISSOCK(existing.st_mode)) {
+            error = path + ": exists and isn't a socket";
+            ::close(fd);
+            return -1;
+        }
+        //stale only if nobody is listening on it any more
+        int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int connected = probe < 0 ? -1 : ::connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        int probe_error = errno;
+        if(probe >= 0)
+            ::close(probe);
+        if(connected == 0 || probe_error != ECONNREFUSED) {
+            error = path + ": in use" + (connected == 0 ? " by a running server" : std::string(", ") + std::strerror(probe_error));
+            ::close(fd);
+            return -1;
+        }
+        ::unlink(path.c_str());
+    }
+    if(::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 64) != 0) {
+        error = path + ": " + std::strerror(errno);
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+inline int connect_unix(const std::string& path, std::string& error) {
+    sockaddr_un address = {};
+    if(path.size() >= sizeof(address.sun_path)) {
+        error = path + ": socket path too long";
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0) {
+        error = std::string("socket: ") + std::strerror(errno);
+        return -1;
+    }
+    if(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        error = path + ": " + std::strerror(errno);
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+class line_reader { //splits what arrives on a socket into lines
+    public:
+        explicit line_reader(int socket) : fd(socket) {}
+
+        bool next(std::string& line) {
+            //the next line without its '\n', false at the end of the stream (a last line without '\n' still counts)
+            //or once a line grows past max_line
+            while(true) {
+                auto end = buffer.find('\n', scanned);
+                if(end != std::string::npos) {
+                    line = buffer.substr(0, end);
+                    buffer.erase(0, end + 1);
+                    scanned = 0;
+                    return true;
+                }
+                scanned = buffer.size();
+                if(buffer.size() > max_line)
+                    return false;
+                char chunk[4096];
+                auto got = ::read(fd, chunk, sizeof(chunk));
+                if(got < 0 && errno == EINTR)
+                    continue;
+                if(got <= 0) {
+                    if(buffer.empty())
+                        return false;
+                    line.swap(buffer);
+                    buffer.clear();
+                    scanned = 0;
+                    return true;
+                }
+                buffer.append(chunk, static_cast<size_t>(got));
+            }
+        }
+
+    private:
+        static const size_t max_line = 65536;
+
+        int fd;
+        std::string buffer;
+        size_t scanned = 0; //buffer[0, scanned) holds no '\n'
+};
+
+inline bool send_line(int fd, const std::string& line) {
+    auto text = line + '\n';
+    return write_all(fd, text.data(), text.size());
+}
+
+#endif
@@ -2,59 +2,115 @@
 #define VEC3_H
 
 #include <cmath>
+#include <cstddef>
 #include <iostream>
 
+#include "sampler.h"
+#include "simd.h"
+
 using std::sqrt;
 
-class vec3 {
+//-DRT_SIMD_VEC3 stores a vector as 4 aligned lanes (the 4th always 0) and does its arithmetic with SSE for float and
+//AVX2 for double (when the build targets it, see the Makefile's imageoutput_simd), see vec3_simd.h. every operation
+//rounds exactly like the scalar one, in the same order, so both builds render the same image. types without a
+//SIMD form, and every type in the default build, keep the 3 scalar lanes
+template<typename T>
+struct vec3_storage {
+    static constexpr int lanes = 3;
+    static constexpr size_t alignment = alignof(T);
+};
+
+#if defined(RT_SIMD_VEC3) && defined(RT_SIMD_X86)
+#ifdef __SSE2__
+template<>
+struct vec3_storage<float> {
+    static constexpr int lanes = 4;
+    static constexpr size_t alignment = 16;
+};
+#define RT_SIMD_VEC3_FLOAT 1
+#endif
+#ifdef __AVX2__
+template<>
+struct vec3_storage<double> {
+    static constexpr int lanes = 4;
+    static constexpr size_t alignment = 32;
+};
+#define RT_SIMD_VEC3_DOUBLE 1
+#endif
+#endif
+
+template<typename T>
+inline void vec3_fill(T* e, T e0, T e1, T e2) {
+    e[0] = e0;
+    e[1] = e1;
+    e[2] = e2;
+    if(vec3_storage<T>::lanes > 3)
+        e[vec3_storage<T>::lanes - 1] = 0;
+}
+
+//the SIMD types write all 4 lanes with one store, so the vector load that usually follows a constructor
+//is forwarded from it instead of waiting for 3 scalar stores to reach the cache
+#ifdef RT_SIMD_VEC3_FLOAT
+inline void vec3_fill(float* e, float e0, float e1, float e2) {_mm_store_ps(e, _mm_set_ps(0, e2, e1, e0));}
+#endif
+#ifdef RT_SIMD_VEC3_DOUBLE
+inline void vec3_fill(double* e, double e0, double e1, double e2) {_mm256_store_pd(e, _mm256_set_pd(0, e2, e1, e0));}
+#endif
+
+template<typename T>
+struct identity_of {using type = T;}; //keeps a parameter out of template deduction, so vec * 0.5 works for float vectors too
+
+template<typename T>
+using scalar_of = typename identity_of<T>::type;
+
+template<typename T>
+class basic_vec3 { //3 component vector over T, vec3 is basic_vec3<real> (see rtweekend.h)
     public:
-        double e[3]; //could use float for smaller size less precision
+        using value_type = T;
+
+        alignas(vec3_storage<T>::alignment) T e[vec3_storage<T>::lanes]; //a 4th lane is padding, always 0
 
-        vec3() : e{0,0,0} {} //constructors
-        vec3(double e0, double e1, double e2) : e{e0,e1,e2} {}
+        basic_vec3() : e{} {} //constructors
+        basic_vec3(T e0, T e1, T e2) {vec3_fill(e, e0, e1, e2);}
+        template<typename U>
+        explicit basic_vec3(const basic_vec3<U>& v) {vec3_fill(e, static_cast<T>(v.e[0]), static_cast<T>(v.e[1]), static_cast<T>(v.e[2]));} //precision change
 
         //vector channels
-        double x() const {return e[0];}
-        double y() const {return e[1];}
-        double z() const {return e[2];}
-
-        //operators
-        vec3 operator-() const {return vec3(-e[0],-e[1],-e[2]);}
-        double operator[](int i) const {return e[i];}
-        double& operator[](int i) {return e[i];}
+        T x() const {return e[0];}
+        T y() const {return e[1];}
+        T z() const {return e[2];}
+
+        //operators, the compound ones go through the free functions below so vec3_simd.h covers them too
+        basic_vec3 operator-() const {return T(-1) * *this;} //-1 * x is exactly -x
+        T operator[](int i) const {return e[i];}
+        T& operator[](int i) {return e[i];}
         
-        vec3& operator+=(const vec3 &v) {
-            e[0] += v.e[0];
-            e[1] += v.e[1];
-            e[2] += v.e[2];
-            return *this;
+        basic_vec3& operator+=(const basic_vec3 &v) {
+            return *this = *this + v;
         }
 
-        vec3& operator*=(double t) {
-            e[0] *= t;
-            e[1] *= t;
-            e[2] *= t;
-            return *this;
+        basic_vec3& operator*=(T t) {
+            return *this = t * *this;
         }
 
-        vec3& operator/=(double t) {
+        basic_vec3& operator/=(T t) {
             return *this *= 1/t;
         }
 
-        double length() const {
+        T length() const {
             return sqrt(length_squared());
         }
 
-        double length_squared() const {
-            return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
+        T length_squared() const {
+            return dot(*this, *this);
         }
 
-        static vec3 random() { //to randomly bounce a ray
-            return vec3(random_double(), random_double(), random_double());
+        static basic_vec3 random() { //to randomly bounce a ray
+            return basic_vec3(random_double(), random_double(), random_double());
         }
 
-        static vec3 random(double min, double max) { //to randomly bounce a ray
-            return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
+        static basic_vec3 random(double min, double max) { //to randomly bounce a ray
+            return basic_vec3(random_double(min, max), random_double(min, max), random_double(min, max));
         }
 
         bool near_zero() const {
@@ -66,76 +122,64 @@ class vec3 {
     };
 
 
+    using vec3 = basic_vec3<real>;
     using point3 = vec3; //alias for clarity
 
     //utility functions
-    inline std::ostream& operator<<(std::ostream &out, const vec3 &v) {
+    template<typename T>
+    inline std::ostream& operator<<(std::ostream &out, const basic_vec3<T> &v) {
         return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
     }
 
-    inline vec3 operator+(const vec3 &u, const vec3 &v) {
-        return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+    template<typename T>
+    inline basic_vec3<T> operator+(const basic_vec3<T> &u, const basic_vec3<T> &v) {
+        return basic_vec3<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
     }
 
-    inline vec3 operator-(const vec3 &u, const vec3 &v) {
-        return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+    template<typename T>
+    inline basic_vec3<T> operator-(const basic_vec3<T> &u, const basic_vec3<T> &v) {
+        return basic_vec3<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
     }
 
-    inline vec3 operator*(const vec3 &u, const vec3 &v) {
-        return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+    template<typename T>
+    inline basic_vec3<T> operator*(const basic_vec3<T> &u, const basic_vec3<T> &v) {
+        return basic_vec3<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
     }
 
-    inline vec3 operator*(double t, const vec3 &v) {
-        return vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
+    template<typename T>
+    inline basic_vec3<T> operator*(scalar_of<T> t, const basic_vec3<T> &v) {
+        return basic_vec3<T>(t * v.e[0], t * v.e[1], t * v.e[2]);
     }
 
-    inline vec3 operator*(const vec3 &v, double t) {
+    template<typename T>
+    inline basic_vec3<T> operator*(const basic_vec3<T> &v, scalar_of<T> t) {
         return t * v;
     }
 
-    inline vec3 operator/(vec3 v, double t) {
+    template<typename T>
+    inline basic_vec3<T> operator/(basic_vec3<T> v, scalar_of<T> t) {
         return (1/t) * v;
     }
 
-    inline double dot(const vec3 &u, const vec3 &v) {
+    template<typename T>
+    inline T dot(const basic_vec3<T> &u, const basic_vec3<T> &v) {
         return u.e[0] * v.e[0] + u.e[1] * v.e[1] + u.e[2] * v.e[2];
     }
 
-    inline vec3 cross(const vec3 &u, const vec3 &v) {
-        return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+    template<typename T>
+    inline basic_vec3<T> cross(const basic_vec3<T> &u, const basic_vec3<T> &v) {
+        return basic_vec3<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
             u.e[2] * v.e[0] - u.e[0] * v.e[2],
             u.e[0] * v.e[1] - u.e[1] * v.e[0]);
     }
 
-    inline vec3 unit_vector(vec3 v) {
+    template<typename T>
+    inline basic_vec3<T> unit_vector(basic_vec3<T> v) {
         return v / v.length();
     }
 
-    inline vec3 random_in_unit_sphere() {
-        //rejection method for generating random vector on surface of a hemisphere
-        //  generate a random point in the unit cube (-1 to 1)
-        //  repeat until the point is in the unit sphere
-        //  normalize the vector, invert if on wrong hemisphere
-        while (true) {
-            auto p = vec3::random(-1,1);
-            if(p.length_squared() < 1)
-                return p;
-        }
-    }
-
-    inline vec3 random_unit_vector() { //normalize vector
-        return unit_vector(random_in_unit_sphere());
-    }
-
-    inline vec3 random_on_hemisphere(const vec3& normal) {
-        vec3 on_unit_sphere = random_unit_vector();
-        if(dot(on_unit_sphere, normal) > 0.0) //in same hemisphere as normal
-            return on_unit_sphere;
-        else
-            return -on_unit_sphere;
-    }
-
-    inline vec3 reflect(const vec3& v, const vec3& n) {
+    template<typename T>
+    inline basic_vec3<T> reflect(const basic_vec3<T>& v, const basic_vec3<T>& n) {
         //the ray reflection direction of a ray v is v+2b
         //b is orthogonal to the bounce point tangent and intersects with one end of v
         //the length of b is v dot n
@@ -143,12 +187,47 @@ class vec3 {
         return v -  2 * dot(v,n) * n;
     }
 
-    inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat) {
+    template<typename T>
+    inline basic_vec3<T> refract(const basic_vec3<T>& uv, const basic_vec3<T>& n, scalar_of<T> etai_over_etat) {
         //calculate direction of refracted ray
-        auto cos_theta = fmin(dot(-uv, n), 1.0);
-        vec3 r_out_perp = etai_over_etat * (uv + cos_theta*n);
-        vec3 r_out_parallel = -sqrt(fabs(1.0 - r_out_perp.length_squared())) * n;
+        T cos_theta = fmin(dot(-uv, n), 1.0);
+        basic_vec3<T> r_out_perp = etai_over_etat * (uv + cos_theta*n);
+        basic_vec3<T> r_out_parallel = -sqrt(fabs(1.0 - r_out_perp.length_squared())) * n;
         return r_out_perp + r_out_parallel;
     }
 
+#include "vec3_simd.h"
+
+    inline vec3 sphere_direction(double u, double v) {
+        //maps [0,1)^2 onto the unit sphere preserving area: z uniform in [-1,1], then the angle around z,
+        //so uniform (or stratified) points in the square give uniform (or stratified) directions.
+        //the angle is 2 * half with half in [-pi/2, pi/2), where sin and cos take libm's short path without
+        //a range reduction, then doubled: cos 2h = cos^2 h - sin^2 h, sin 2h = 2 sin h cos h
+        auto z = 1 - 2 * u;
+        auto r = std::sqrt(std::fmax(0.0, 1 - z * z));
+        auto half = 3.141592653589793 * (v - 0.5);
+        auto c = std::cos(half), s = std::sin(half);
+        return vec3(r * (c * c - s * s), r * (2 * s * c), z);
+    }
+
+    inline vec3 random_unit_vector(sampler& s) {
+        //one 2D draw of the sampler's pattern, no rejection loop and no normalization
+        double u, v;
+        s.sample_2d(u, v);
+        return sphere_direction(u, v);
+    }
+
+    inline vec3 random_in_unit_sphere(sampler& s) {
+        //a direction scaled by the cube root of a uniform draw, the radius distribution of a uniformly filled ball
+        auto direction = random_unit_vector(s);
+        return std::cbrt(s.sample_1d()) * direction;
+    }
+
+    inline vec3 random_on_hemisphere(const vec3& normal, sampler& s) {
+        //a unit vector mirrored into the normal's hemisphere by the sign of the dot product, no branch
+        vec3 on_unit_sphere = random_unit_vector(s);
+        return std::copysign(1.0, dot(on_unit_sphere, normal)) * on_unit_sphere;
+    }
+
+
 #endif
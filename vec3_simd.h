@@ -0,0 +1,116 @@
+#ifndef VEC3_SIMD_H
+#define VEC3_SIMD_H
+
+//SIMD forms of the vec3 operations for the types vec3_storage gives 4 lanes (-DRT_SIMD_VEC3, see vec3.h)
+//plain overloads, so they win over the templates whenever the type matches. lane 3 only ever mixes with
+//lane 3 and nothing reads it (dot and cross only combine lanes 0 to 2), so it can be left to whatever it becomes.
+//sums go (x + y) + z like the scalar code, so every result is bit for bit the scalar one
+//
+//included from vec3.h, after the generic operators
+
+#ifdef RT_SIMD_VEC3_DOUBLE
+
+inline __m256d vec3_load(const basic_vec3<double>& v) {return _mm256_load_pd(v.e);}
+
+inline basic_vec3<double> vec3_store(__m256d x) {
+    basic_vec3<double> r;
+    _mm256_store_pd(r.e, x);
+    return r;
+}
+
+inline basic_vec3<double> operator+(const basic_vec3<double>& u, const basic_vec3<double>& v) {
+    return vec3_store(_mm256_add_pd(vec3_load(u), vec3_load(v)));
+}
+
+inline basic_vec3<double> operator-(const basic_vec3<double>& u, const basic_vec3<double>& v) {
+    return vec3_store(_mm256_sub_pd(vec3_load(u), vec3_load(v)));
+}
+
+inline basic_vec3<double> operator*(const basic_vec3<double>& u, const basic_vec3<double>& v) {
+    return vec3_store(_mm256_mul_pd(vec3_load(u), vec3_load(v)));
+}
+
+inline basic_vec3<double> operator*(double t, const basic_vec3<double>& v) {
+    return vec3_store(_mm256_mul_pd(_mm256_set1_pd(t), vec3_load(v)));
+}
+
+inline basic_vec3<double> operator*(const basic_vec3<double>& v, double t) {
+    return t * v;
+}
+
+inline basic_vec3<double> operator/(const basic_vec3<double>& v, double t) {
+    return (1/t) * v;
+}
+
+inline double dot(const basic_vec3<double>& u, const basic_vec3<double>& v) {
+    auto p = _mm256_mul_pd(vec3_load(u), vec3_load(v));
+    auto xy = _mm256_castpd256_pd128(p);
+    auto z = _mm256_extractf128_pd(p, 1);
+    return _mm_cvtsd_f64(_mm_add_sd(_mm_add_sd(xy, _mm_unpackhi_pd(xy, xy)), z));
+}
+
+inline basic_vec3<double> cross(const basic_vec3<double>& u, const basic_vec3<double>& v) {
+    //u.yzx * v.zxy - u.zxy * v.yzx, lane 3 stays in place
+    auto a = vec3_load(u), b = vec3_load(v);
+    auto a_yzx = _mm256_permute4x64_pd(a, _MM_SHUFFLE(3,0,2,1));
+    auto a_zxy = _mm256_permute4x64_pd(a, _MM_SHUFFLE(3,1,0,2));
+    auto b_yzx = _mm256_permute4x64_pd(b, _MM_SHUFFLE(3,0,2,1));
+    auto b_zxy = _mm256_permute4x64_pd(b, _MM_SHUFFLE(3,1,0,2));
+    return vec3_store(_mm256_sub_pd(_mm256_mul_pd(a_yzx, b_zxy), _mm256_mul_pd(a_zxy, b_yzx)));
+}
+
+#endif
+
+#ifdef RT_SIMD_VEC3_FLOAT
+
+inline __m128 vec3_load(const basic_vec3<float>& v) {return _mm_load_ps(v.e);}
+
+inline basic_vec3<float> vec3_store(__m128 x) {
+    basic_vec3<float> r;
+    _mm_store_ps(r.e, x);
+    return r;
+}
+
+inline basic_vec3<float> operator+(const basic_vec3<float>& u, const basic_vec3<float>& v) {
+    return vec3_store(_mm_add_ps(vec3_load(u), vec3_load(v)));
+}
+
+inline basic_vec3<float> operator-(const basic_vec3<float>& u, const basic_vec3<float>& v) {
+    return vec3_store(_mm_sub_ps(vec3_load(u), vec3_load(v)));
+}
+
+inline basic_vec3<float> operator*(const basic_vec3<float>& u, const basic_vec3<float>& v) {
+    return vec3_store(_mm_mul_ps(vec3_load(u), vec3_load(v)));
+}
+
+inline basic_vec3<float> operator*(float t, const basic_vec3<float>& v) {
+    return vec3_store(_mm_mul_ps(_mm_set1_ps(t), vec3_load(v)));
+}
+
+inline basic_vec3<float> operator*(const basic_vec3<float>& v, float t) {
+    return t * v;
+}
+
+inline basic_vec3<float> operator/(const basic_vec3<float>& v, float t) {
+    return (1/t) * v;
+}
+
+inline float dot(const basic_vec3<float>& u, const basic_vec3<float>& v) {
+    auto p = _mm_mul_ps(vec3_load(u), vec3_load(v));
+    auto y = _mm_shuffle_ps(p, p, _MM_SHUFFLE(1,1,1,1));
+    auto z = _mm_movehl_ps(p, p);
+    return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(p, y), z));
+}
+
+inline basic_vec3<float> cross(const basic_vec3<float>& u, const basic_vec3<float>& v) {
+    auto a = vec3_load(u), b = vec3_load(v);
+    auto a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3,0,2,1));
+    auto a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3,1,0,2));
+    auto b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3,0,2,1));
+    auto b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3,1,0,2));
+    return vec3_store(_mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx)));
+}
+
+#endif
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "rtweekend.h"
+
+#include "color.h"
+#include "hittable.h"
+#include "material.h"
+#include "stats.h"
+
+#include <cstdint>
+#include <vector>
+
+/* wavefront integrator data
+
+instead of following one camera ray through all of its bounces before starting the next, the wavefront
+integrator keeps a whole batch of paths in flight and advances them one bounce at a time:
+  1. intersect every active path
+  2. bin the hits by material kind (a counting sort of path indices)
+  3. shade each bin in its own loop with the kind fixed at compile time (no per hit switch on the kind)
+  4. compact the surviving paths into the next batch
+a path carries the light it met so far (emitters, sampled lights, the sky) and hands it to the tile once it ends
+camera::render_tile_wavefront drives the loop, this file holds the per path state and the batch steps
+
+*/
+
+struct wavefront_path { //one camera sample in flight
+    ray r;
+    color throughput;
+    color radiance; //gathered so far
+    double scatter_pdf; //density of the last bounce's direction when light sampling, for the weight of the light it hits
+    vec3 scatter_normal; //the normal that bounce left from
+    uint32_t pixel; //index into the tile's accumulation buffer
+    sampler s; //each path owns its stream, so the order paths are shaded in doesn't change the image
+};
+
+struct wavefront_batch { //reused between bounces so a tile allocates once
+    std::vector<wavefront_path> paths;
+    std::vector<wavefront_path> next; //survivors of the current bounce
+    std::vector<hit_record> hits;
+    std::vector<uint32_t> bins[material_kind_count]; //path indices per material_kind
+};
+
+template<material_kind Kind, typename Continue, typename Finish>
+inline void shade_bin(wavefront_batch& batch, Continue&& keep_going, Finish&& finish, bool sample_lights) {
+    //shade every path in Kind's bin, all of them go through the same scatter code
+    //keep_going applies russian roulette and reports whether the path continues, finish takes the ones that end
+    for(auto k : batch.bins[static_cast<int>(Kind)]) {
+        auto& path = batch.paths[k];
+        const auto& rec = batch.hits[k];
+        ray scattered;
+        color attenuation;
+        if(!rec.mat->scatter_as<Kind>(path.r, rec, attenuation, scattered, path.s)) {
+            RT_STAT(absorbed, 1);
+            finish(path);
+            continue;
+        }
+        path.throughput = path.throughput * attenuation;
+        path.scatter_pdf = sample_lights && rec.mat->samples_lights() ? rec.mat->scatter_pdf(rec, scattered.direction()) : 0;
+        path.scatter_normal = rec.normal;
+        path.r = scattered;
+        if(keep_going(path))
+            batch.next.push_back(path);
+        else
+            finish(path);
+    }
+}
+
+#endif